@@ -1,34 +1,429 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "assert.h"
 #include "compress40.h"
 
 static void (*compress_or_decompress)(FILE *input) = compress40;
 
+/* Worker threads asked for with -j, or 0 */
+static unsigned threads = 0;
+
+/* Output denominator asked for with --maxval, or 0 */
+static unsigned maxval = 0;
+
+/* Whether --fixed asked for fixed-point compression */
+static int fixed = 0;
+
+/* Whether --entropy asked for the entropy-coded format 3 */
+static int entropy = 0;
+
+/* Block size asked for with --block, or 2 */
+static unsigned block = 2;
+
+/* Size asked for with --budget and RMS error with --rms, or 0 */
+static size_t budget = 0;
+static double rms = 0;
+
+/* Tile size asked for with --tile, or 0 */
+static unsigned tile = 0;
+
+/* Whether --thumbnail asked for a half-size image */
+static int thumbnail = 0;
+
+/* Whether --batch asked for a list of files */
+static int batch = 0;
+
+/* Rectangle asked for with --region */
+static int region = 0;
+static unsigned region_x, region_y, region_w, region_h;
+
+static void compress_parallel(FILE *input)
+{
+        /* The compressor writes to the descriptor, not through stdio */
+        fflush(stdout);
+        compress40_parallel(input, STDOUT_FILENO, threads);
+}
+
+static void decompress_parallel(FILE *input)
+{
+        decompress40_parallel(input, threads);
+}
+
+static void decompress_region(FILE *input)
+{
+        decompress40_region(input, region_x, region_y, region_w, region_h);
+}
+
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s -d [-s | -b | -j threads | "
+                "--region x,y,w,h | --thumbnail]\n"
+                "             [--maxval n] [filename]\n"
+                "       %s -c [-s | -b | -j threads] [--fixed] "
+                "[--entropy | --block n]\n"
+                "             [--budget bytes | --rms error | --tile n] "
+                "[filename]\n"
+                "       %s -c | -d --batch [-j threads] [options] "
+                "[input output ...]\n",
+                progname, progname, progname);
+        exit(1);
+}
+
+/* Warns that the image from 'name' could not be fitted to --budget or
+ * --rms, and was written at the nearest quantization instead
+ */
+static void warn_missed(const char *progname, const char *name)
+{
+        if (budget != 0) {
+                fprintf(stderr, "%s: warning: %s does not fit in %zu bytes; "
+                        "wrote the smallest file instead\n", progname,
+                        name, budget);
+        } else {
+                fprintf(stderr, "%s: warning: %s cannot get down to an RMS "
+                        "error of %g; wrote the least error instead\n",
+                        progname, name, rms);
+        }
+}
+
+/* Reads a manifest of "input output" lines, each holding two paths
+ * separated by blanks; empty lines are skipped. Returns the files and
+ * puts their number in *count.
+ */
+static Compress40_file *read_manifest(FILE *fp, size_t *count,
+                                      const char *progname)
+{
+        Compress40_file *files = NULL;
+        size_t n = 0, room = 0;
+        char *line = NULL;
+        size_t line_size = 0;
+        unsigned lineno = 0;
+
+        while (getline(&line, &line_size, fp) != -1) {
+                lineno++;
+                char *input = strtok(line, " \t\r\n");
+                if (input == NULL) {
+                        continue;
+                }
+                char *output = strtok(NULL, " \t\r\n");
+                if (output == NULL || strtok(NULL, " \t\r\n") != NULL) {
+                        fprintf(stderr, "%s: line %u of the manifest needs "
+                                "an input and an output path\n", progname,
+                                lineno);
+                        exit(1);
+                }
+                if (n == room) {
+                        room = room == 0 ? 64 : 2 * room;
+                        files = realloc(files, room * sizeof(*files));
+                        assert(files != NULL);
+                }
+                files[n].input = strdup(input);
+                files[n].output = strdup(output);
+                assert(files[n].input != NULL && files[n].output != NULL);
+                files[n].failed = 0;
+                files[n].missed = 0;
+                n++;
+        }
+        free(line);
+        *count = n;
+        return files;
+}
+
+/* Compresses or decompresses the files named by the "input output" pairs
+ * on the command line from argv[i] on, or else by the manifest on stdin,
+ * and reports every one that failed. Returns the exit status.
+ */
+static int run_batch(int argc, char *argv[], int i, int decompress)
+{
+        Compress40_file *files;
+        size_t count;
+
+        if (i < argc) {
+                if ((argc - i) % 2 != 0) {
+                        fprintf(stderr, "%s: --batch needs an output path "
+                                "for every input\n", argv[0]);
+                        exit(1);
+                }
+                count = (argc - i) / 2;
+                files = malloc(count * sizeof(*files));
+                assert(files != NULL);
+                for (size_t n = 0; n < count; n++) {
+                        files[n].input = argv[i + 2 * n];
+                        files[n].output = argv[i + 2 * n + 1];
+                        files[n].failed = 0;
+                        files[n].missed = 0;
+                }
+        } else {
+                files = read_manifest(stdin, &count, argv[0]);
+        }
+
+        compress40_batch(files, count, threads > 0 ? threads : 1,
+                         decompress);
+
+        int status = EXIT_SUCCESS;
+        for (size_t n = 0; n < count; n++) {
+                if (files[n].failed != 0) {
+                        fprintf(stderr, "%s: %s -> %s: %s\n", argv[0],
+                                files[n].input, files[n].output,
+                                strerror(files[n].failed));
+                        status = EXIT_FAILURE;
+                } else if (files[n].missed) {
+                        warn_missed(argv[0], files[n].input);
+                }
+        }
+
+        /* Paths from a manifest were copied */
+        if (i == argc) {
+                for (size_t n = 0; n < count; n++) {
+                        free((char *)files[n].input);
+                        free((char *)files[n].output);
+                }
+        }
+        free(files);
+        return status;
+}
+
 int main(int argc, char *argv[])
 {
         int i;
+        int streaming = 0;
+        int blocked = 0;
 
         for (i = 1; i < argc; i++) {
                 if (strcmp(argv[i], "-c") == 0) {
                         compress_or_decompress = compress40;
                 } else if (strcmp(argv[i], "-d") == 0) {
                         compress_or_decompress = decompress40;
+                } else if (strcmp(argv[i], "-s") == 0) {
+                        streaming = 1;
+                } else if (strcmp(argv[i], "-b") == 0) {
+                        blocked = 1;
+                } else if (strcmp(argv[i], "-j") == 0) {
+                        char *end;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        long n = strtol(argv[++i], &end, 10);
+                        if (*end != '\0' || n < 1 || n > 1024) {
+                                fprintf(stderr,
+                                        "%s: -j needs a thread count "
+                                        "from 1 to 1024\n", argv[0]);
+                                exit(1);
+                        }
+                        threads = n;
+                } else if (strcmp(argv[i], "--maxval") == 0) {
+                        char *end;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        long n = strtol(argv[++i], &end, 10);
+                        if (*end != '\0' || n < 1 || n > 65535) {
+                                fprintf(stderr,
+                                        "%s: --maxval needs a number "
+                                        "from 1 to 65535\n", argv[0]);
+                                exit(1);
+                        }
+                        maxval = n;
+                } else if (strcmp(argv[i], "--fixed") == 0) {
+                        fixed = 1;
+                } else if (strcmp(argv[i], "--entropy") == 0) {
+                        entropy = 1;
+                } else if (strcmp(argv[i], "--block") == 0) {
+                        char *end;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        long n = strtol(argv[++i], &end, 10);
+                        if (*end != '\0' || (n != 4 && n != 8)) {
+                                fprintf(stderr,
+                                        "%s: --block needs 4 or 8\n",
+                                        argv[0]);
+                                exit(1);
+                        }
+                        block = n;
+                } else if (strcmp(argv[i], "--budget") == 0) {
+                        char *end;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        unsigned long long n = strtoull(argv[++i], &end,
+                                                        10);
+                        if (*end != '\0' || *argv[i] == '-' || n < 1 ||
+                            n > (size_t)-1) {
+                                fprintf(stderr,
+                                        "%s: --budget needs a size in "
+                                        "bytes\n", argv[0]);
+                                exit(1);
+                        }
+                        budget = n;
+                } else if (strcmp(argv[i], "--rms") == 0) {
+                        char *end;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        rms = strtod(argv[++i], &end);
+                        if (*end != '\0' || !(rms > 0 && rms <= 1)) {
+                                fprintf(stderr,
+                                        "%s: --rms needs an error above 0 "
+                                        "and at most 1\n", argv[0]);
+                                exit(1);
+                        }
+                } else if (strcmp(argv[i], "--tile") == 0) {
+                        char *end;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        long n = strtol(argv[++i], &end, 10);
+                        if (*end != '\0' || n < 16 || n > 65536 ||
+                            n % 2 != 0) {
+                                fprintf(stderr,
+                                        "%s: --tile needs an even number "
+                                        "from 16 to 65536\n", argv[0]);
+                                exit(1);
+                        }
+                        tile = n;
+                } else if (strcmp(argv[i], "--batch") == 0) {
+                        batch = 1;
+                } else if (strcmp(argv[i], "--thumbnail") == 0) {
+                        thumbnail = 1;
+                } else if (strcmp(argv[i], "--region") == 0) {
+                        char extra;
+                        if (i + 1 == argc) {
+                                usage(argv[0]);
+                        }
+                        if (sscanf(argv[++i], "%u,%u,%u,%u%c", &region_x,
+                                   &region_y, &region_w, &region_h,
+                                   &extra) != 4) {
+                                fprintf(stderr,
+                                        "%s: --region needs x,y,w,h\n",
+                                        argv[0]);
+                                exit(1);
+                        }
+                        region = 1;
                 } else if (*argv[i] == '-') {
                         fprintf(stderr, "%s: unknown option '%s'\n",
                                 argv[0], argv[i]);
                         exit(1);
-                } else if (argc - i > 2) {
-                        fprintf(stderr, "Usage: %s -d [filename]\n"
-                                "       %s -c [filename]\n",
-                                argv[0], argv[0]);
-                        exit(1);
+                } else if (!batch && argc - i > 2) {
+                        usage(argv[0]);
                 } else {
                         break;
                 }
         }
-        assert(argc - i <= 1);    /* at most one file on command line */
+        /* at most one file on command line, except for a batch */
+        assert(batch || argc - i <= 1);
+        if (region && compress_or_decompress != decompress40) {
+                fprintf(stderr, "%s: --region only works with -d\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (thumbnail && compress_or_decompress != decompress40) {
+                fprintf(stderr, "%s: --thumbnail only works with -d\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (thumbnail && (region || streaming || blocked ||
+                          threads > 0)) {
+                fprintf(stderr, "%s: --thumbnail does not work with -s, "
+                        "-b, -j or --region\n", argv[0]);
+                exit(1);
+        }
+        if (batch && (region || thumbnail || blocked)) {
+                fprintf(stderr, "%s: --batch does not work with -b, "
+                        "--region or --thumbnail\n", argv[0]);
+                exit(1);
+        }
+        if (maxval != 0 && compress_or_decompress == compress40) {
+                fprintf(stderr, "%s: --maxval only works with -d\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (fixed && compress_or_decompress != compress40) {
+                fprintf(stderr, "%s: --fixed only works with -c\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (entropy && compress_or_decompress != compress40) {
+                fprintf(stderr, "%s: --entropy only works with -c\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (block != 2 && compress_or_decompress != compress40) {
+                fprintf(stderr, "%s: --block only works with -c\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (block != 2 && (fixed || entropy)) {
+                fprintf(stderr, "%s: --block does not work with --fixed "
+                        "or --entropy\n", argv[0]);
+                exit(1);
+        }
+        if ((budget != 0 || rms != 0) &&
+            compress_or_decompress != compress40) {
+                fprintf(stderr, "%s: --budget and --rms only work with "
+                        "-c\n", argv[0]);
+                exit(1);
+        }
+        if ((budget != 0 || rms != 0) && (fixed || block != 2)) {
+                fprintf(stderr, "%s: --budget and --rms do not work with "
+                        "--fixed or --block\n", argv[0]);
+                exit(1);
+        }
+        if (budget != 0 && rms != 0) {
+                fprintf(stderr, "%s: --budget and --rms do not work "
+                        "together\n", argv[0]);
+                exit(1);
+        }
+        if (tile != 0 && compress_or_decompress != compress40) {
+                fprintf(stderr, "%s: --tile only works with -c\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (tile != 0 && (block != 2 || budget != 0 || rms != 0)) {
+                fprintf(stderr, "%s: --tile does not work with --block, "
+                        "--budget or --rms\n", argv[0]);
+                exit(1);
+        }
+        decompress40_maxval(maxval);
+        compress40_fixed(fixed);
+        compress40_entropy(entropy);
+        compress40_block(block);
+        if (rms != 0) {
+                compress40_rms(rms);
+        } else {
+                compress40_budget(budget);
+        }
+        compress40_tile(tile);
+        if (batch) {
+                return run_batch(argc, argv, i,
+                                 compress_or_decompress == decompress40);
+        }
+
+        /* Only the strip compressors have fixed-point, format 3, format 4,
+         * format 5 and format 6 versions
+         */
+        if ((fixed || entropy || block != 2 || budget != 0 || rms != 0 ||
+             tile != 0) && threads == 0) {
+                streaming = 1;
+        }
+        if (thumbnail) {
+                compress_or_decompress = decompress40_thumbnail;
+        } else if (region) {
+                compress_or_decompress = decompress_region;
+        } else if (threads > 0 && compress_or_decompress == compress40) {
+                compress_or_decompress = compress_parallel;
+        } else if (threads > 0 && compress_or_decompress == decompress40) {
+                compress_or_decompress = decompress_parallel;
+        } else if (streaming && compress_or_decompress == compress40) {
+                compress_or_decompress = compress40_stream;
+        } else if (streaming && compress_or_decompress == decompress40) {
+                compress_or_decompress = decompress40_stream;
+        } else if (blocked && compress_or_decompress == compress40) {
+                compress_or_decompress = compress40_blocked;
+        } else if (blocked && compress_or_decompress == decompress40) {
+                compress_or_decompress = decompress40_blocked;
+        }
         if (i < argc) {
                 FILE *fp = fopen(argv[i], "r");
                 assert(fp != NULL);
@@ -37,6 +432,9 @@ int main(int argc, char *argv[])
         } else {
                 compress_or_decompress(stdin);
         }
+        if ((budget != 0 || rms != 0) && !compress40_target_met()) {
+                warn_missed(argv[0], i < argc ? argv[i] : "the image");
+        }
 
         return EXIT_SUCCESS; 
 }
@@ -1,5 +1,6 @@
 #include <string.h>
 
+#include "a2methods.h"
 #include <a2blocked.h>
 #include "uarray2b.h"
 
@@ -51,6 +52,45 @@ static void map_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
     UArray2b_map(array2, (applyfun *) apply, cl);
 }
 
+// within a block, the part of each row is contiguous; blocks at the right
+// and bottom edges may be cut short by the width and height
+static void map_rows(A2 array2, A2Methods_rowapplyfun apply, void *cl)
+{
+    int w = UArray2b_width(array2);
+    int h = UArray2b_height(array2);
+    int bs = UArray2b_blocksize(array2);
+
+    for (int bj = 0; bj < h; bj += bs) {
+        for (int bi = 0; bi < w; bi += bs) {
+            int n = w - bi < bs ? w - bi : bs;
+            int rows = h - bj < bs ? h - bj : bs;
+            for (int j = bj; j < bj + rows; j++) {
+                apply(bi, j, n, array2, UArray2b_at(array2, bi, j), cl);
+            }
+        }
+    }
+}
+
+struct block_closure {
+    A2Methods_blockapplyfun *apply;
+    void *cl;
+};
+
+static void apply_block(int col, int row, int width, int height,
+                        UArray2b_T array2, void *block, void *vcl)
+{
+    struct block_closure *cl = vcl;
+    cl->apply(col, row, width, height, array2, block,
+              UArray2b_blocksize(array2), cl->cl);
+}
+
+// each block is contiguous, with rows blocksize elements apart
+static void map_blocks(A2 array2, A2Methods_blockapplyfun apply, void *cl)
+{
+    struct block_closure mycl = { apply, cl };
+    UArray2b_map_blocks(array2, apply_block, &mycl);
+}
+
 struct small_closure {
     A2Methods_smallapplyfun *apply;
     void *cl;
@@ -89,6 +129,8 @@ static struct A2Methods_T uarray2_methods_blocked_struct = {
     NULL,			// small_map_col_major
     small_map_block_major,
     small_map_block_major,	// small_map_default
+    map_rows,
+    map_blocks,
 };
 
 // finally the payoff: here is the exported pointer to the struct
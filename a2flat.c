@@ -0,0 +1,157 @@
+/*      a2flat.c
+ *
+ *      Implementation file for A2Methods that uses the flat UArray2f
+ *      Authors: Aryan Pandey and Arnav Kothari
+ *      COMP40: arith
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "a2flat.h"
+#include "uarray2f.h"
+
+/************************************************/
+/* Define a private version of each function in */
+/* A2Methods_T that we implement.               */
+/************************************************/
+
+typedef A2Methods_UArray2 A2;    /* private abbreviation */
+
+static A2Methods_UArray2 new(int width, int height, int size)
+{
+        return UArray2f_new(width, height, size);
+}
+
+static A2Methods_UArray2 new_with_blocksize(int width, int height, 
+                                            int size, int blocksize)
+{
+        (void) blocksize;
+        return UArray2f_new(width, height, size);
+}
+
+static void a2free(A2 * array2p)
+{
+        UArray2f_free((UArray2f_T *)array2p);
+}
+
+static int width(A2 array2)
+{
+        return UArray2f_width(array2);
+}
+static int height(A2 array2)
+{
+        return UArray2f_height(array2);
+}
+static int size(A2 array2)
+{
+        return UArray2f_size(array2);
+}
+
+static int blocksize(A2 array2)
+{       
+        (void) array2;
+        return 1;
+}
+
+static A2Methods_Object *at(A2 array2, int i, int j)
+{
+        return UArray2f_at(array2, i, j);
+}
+
+
+static void map_row_major(A2Methods_UArray2 uarray2,
+                          A2Methods_applyfun apply,
+                          void *cl)
+{
+        UArray2f_map_row_major(uarray2, (UArray2f_applyfun*)apply, cl);
+}
+
+static void map_col_major(A2Methods_UArray2 uarray2,
+                          A2Methods_applyfun apply,
+                          void *cl)
+{
+        UArray2f_map_col_major(uarray2, (UArray2f_applyfun*)apply, cl);
+}
+
+static void map_rows(A2Methods_UArray2 uarray2,
+                     A2Methods_rowapplyfun apply,
+                     void *cl)
+{
+        int w = UArray2f_width(uarray2);
+        int h = UArray2f_height(uarray2);
+        if (w == 0) {
+                return;
+        }
+        for (int j = 0; j < h; j++) {
+                apply(0, j, w, uarray2, UArray2f_row(uarray2, j), cl);
+        }
+}
+
+static void map_blocks(A2Methods_UArray2 uarray2,
+                       A2Methods_blockapplyfun apply,
+                       void *cl)
+{
+        int w = UArray2f_width(uarray2);
+        int h = UArray2f_height(uarray2);
+        if (w == 0 || h == 0) {
+                return;
+        }
+        /* Every row is in the one allocation, so the array is one block */
+        apply(0, 0, w, h, uarray2, UArray2f_row(uarray2, 0), w, cl);
+}
+
+struct small_closure {
+        A2Methods_smallapplyfun *apply; 
+        void                    *cl;
+};
+
+static void apply_small(int i, int j, UArray2f_T uarray2,
+                        void *elem, void *vcl)
+{
+        struct small_closure *cl = vcl;
+        (void)i;
+        (void)j;
+        (void)uarray2;
+        cl->apply(elem, cl->cl);
+}
+
+static void small_map_row_major(A2Methods_UArray2        a2,
+                                A2Methods_smallapplyfun  apply,
+                                void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        UArray2f_map_row_major(a2, apply_small, &mycl);
+}
+
+static void small_map_col_major(A2Methods_UArray2        a2,
+                                A2Methods_smallapplyfun  apply,
+                                void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        UArray2f_map_col_major(a2, apply_small, &mycl);
+}
+
+static struct A2Methods_T uarray2_methods_flat_struct = {
+        new,
+        new_with_blocksize,
+        a2free,
+        width,
+        height,
+        size,
+        blocksize,
+        at,
+        map_row_major,
+        map_col_major,
+        NULL,
+        map_row_major,
+        small_map_row_major,
+        small_map_col_major,
+        NULL,
+        small_map_row_major,
+        map_rows,
+        map_blocks,
+};
+
+/* here is the exported pointer to the struct */
+
+A2Methods_T uarray2_methods_flat = &uarray2_methods_flat_struct;
@@ -0,0 +1,16 @@
+/*      a2flat.h
+ *
+ *      Interface for the A2Methods_T that uses the flat UArray2 in
+ *      uarray2f.h; a drop-in replacement for uarray2_methods_plain
+ *      Authors: Aryan Pandey and Arnav Kothari
+ *      COMP40: arith
+ */
+
+#ifndef A2FLAT_INCLUDED
+#define A2FLAT_INCLUDED
+
+#include "a2methods.h"
+
+extern A2Methods_T uarray2_methods_flat;
+
+#endif
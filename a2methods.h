@@ -0,0 +1,101 @@
+#ifndef A2METHODS_INCLUDED
+#define A2METHODS_INCLUDED
+
+/*
+ * a2methods.h
+ *
+ * The COMP40 polymorphic 2D array interface, with two additions at the
+ * end of the method suite: map_rows, which visits an array a run of
+ * adjacent elements at a time instead of one element at a time, and
+ * map_blocks, which visits it a rectangle at a time. Because they are
+ * the last members, an initializer of struct A2Methods_T written before
+ * them still compiles and leaves them NULL, but only if it is compiled
+ * against this header: a suite built against the course's shorter
+ * a2methods.h has no room for them, and reading either member of it
+ * reads past its end. Every suite linked with code that uses them must
+ * include this header first.
+ */
+
+#define T A2Methods_UArray2
+typedef void *T;        /* an unknown sort of 2D array */
+
+typedef void A2Methods_Object;  /* an unknown sort of element */
+
+/* apply function for a full map: gets coordinates, array and element */
+typedef void A2Methods_applyfun(int i, int j, T array2,
+                                A2Methods_Object *ptr, void *cl);
+typedef void A2Methods_mapfun(T array2, A2Methods_applyfun apply, void *cl);
+
+/* apply function for a small map: gets only the element */
+typedef void A2Methods_smallapplyfun(A2Methods_Object *ptr, void *cl);
+typedef void A2Methods_smallmapfun(T a2, A2Methods_smallapplyfun apply,
+                                   void *cl);
+
+/* apply function for map_rows: elements (i, j) through (i + n - 1, j)
+ * are adjacent in memory, starting at 'first', so the client can walk
+ * them with a pointer
+ */
+typedef void A2Methods_rowapplyfun(int i, int j, int n, T array2,
+                                   A2Methods_Object *first, void *cl);
+typedef void A2Methods_rowmapfun(T array2, A2Methods_rowapplyfun apply,
+                                 void *cl);
+
+/* apply function for map_blocks: the w by h rectangle whose top left
+ * element is (i, j) starts at 'first', and each of its rows starts
+ * 'stride' elements after the one above
+ */
+typedef void A2Methods_blockapplyfun(int i, int j, int w, int h, T array2,
+                                     A2Methods_Object *first, int stride,
+                                     void *cl);
+typedef void A2Methods_blockmapfun(T array2, A2Methods_blockapplyfun apply,
+                                   void *cl);
+
+typedef struct A2Methods_T {
+        /* creates a distinct 2D array of memory cells, each of the given
+         * 'size'; each cell is uninitialized; if the array is blocked,
+         * new picks the block size itself
+         */
+        T (*new)(int width, int height, int size);
+        T (*new_with_blocksize)(int width, int height, int size,
+                                int blocksize);
+
+        void (*free)(T *array2p);
+
+        /* observe properties of the array */
+        int (*width)    (T array2);
+        int (*height)   (T array2);
+        int (*size)     (T array2);
+        int (*blocksize)(T array2);     /* 1 for an unblocked array */
+
+        /* return a pointer to the cell in column i, row j */
+        A2Methods_Object *(*at)(T array2, int i, int j);
+
+        /* mapping functions; any that the array cannot do well is NULL */
+        A2Methods_mapfun *map_row_major;
+        A2Methods_mapfun *map_col_major;
+        A2Methods_mapfun *map_block_major;
+        A2Methods_mapfun *map_default;  /* the best of the above */
+
+        A2Methods_smallmapfun *small_map_row_major;
+        A2Methods_smallmapfun *small_map_col_major;
+        A2Methods_smallmapfun *small_map_block_major;
+        A2Methods_smallmapfun *small_map_default;
+
+        /* calls apply once per run of adjacent elements in a row, in
+         * the array's default order: every row whole and in row-major
+         * order for an unblocked array, and the part of each row inside
+         * a block, block by block, for a blocked one; every element is
+         * in exactly one run
+         */
+        A2Methods_rowmapfun *map_rows;
+
+        /* calls apply once per block of a blocked array, in block-major
+         * order, with the part of the block inside the array; an
+         * unblocked array whose rows are all in one allocation is one
+         * block; NULL if the rows are not
+         */
+        A2Methods_blockmapfun *map_blocks;
+} *A2Methods_T;
+
+#undef T
+#endif
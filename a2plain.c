@@ -8,6 +8,7 @@
 
 #include <string.h>
 #include <assert.h>
+#include "a2methods.h"
 #include <a2plain.h>
 #include <uarray2.h>
 
@@ -74,6 +75,21 @@ static void map_col_major(A2Methods_UArray2 uarray2,
         UArray2_map_col_major(uarray2, (UArray2_applyfun*)apply, cl);
 }
 
+static void map_rows(A2Methods_UArray2 uarray2,
+                     A2Methods_rowapplyfun apply,
+                     void *cl)
+{
+        /* Each row is one Hanson UArray_T, so it is contiguous */
+        int w = UArray2_width(uarray2);
+        int h = UArray2_height(uarray2);
+        if (w == 0) {
+                return;
+        }
+        for (int j = 0; j < h; j++) {
+                apply(0, j, w, uarray2, UArray2_at(uarray2, 0, j), cl);
+        }
+}
+
 struct small_closure {
         A2Methods_smallapplyfun *apply; 
         void                    *cl;
@@ -122,6 +138,8 @@ static struct A2Methods_T uarray2_methods_plain_struct = {
         small_map_col_major,
         NULL,
         small_map_row_major,
+        map_rows,
+        NULL,           /* map_blocks: each row is a separate UArray */
 };
 
 /* here is the exported pointer to the struct */
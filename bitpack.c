@@ -4,13 +4,13 @@
  * Authors: Aryan Pandey and Arnav Kothari 
  * Date: 12/22/2019
  * COMP40: arith
+ *
+ * The work is done by the inline functions in bitpack_inline.h; these
+ * are the out-of-line versions for callers of the bitpack.h interface.
  */
 
 #include "bitpack.h"
-#include <stdio.h>
-#include <math.h>
-#include "except.h"
-#include "assert.h"
+#include "bitpack_inline.h"
 
 Except_T Bitpack_Overflow = { "Overflow packing bits" };
 
@@ -23,19 +23,7 @@ Except_T Bitpack_Overflow = { "Overflow packing bits" };
  */
 bool Bitpack_fitsu(uint64_t n, unsigned width) 
 {
-    assert(width <= 64);
-    if (width == 0) {
-        return false;
-    }
-    
-    /* Range is the maximum value that the unsigned int
-     * can hold within the bounds of the width bits
-     */
-    uint64_t range = pow(2, width) - 1;
-    if (n <= range) {
-        return true;
-    }
-    return false;
+    return Bitpack_fitsu_inline(n, width);
 }
 /* 
  * Function: Bitpack_fitss
@@ -46,16 +34,7 @@ bool Bitpack_fitsu(uint64_t n, unsigned width)
  */
 bool Bitpack_fitss(int64_t n, unsigned width) 
 {
-    assert(width <= 64);
-    if (width == 0) {
-        return false;
-    }
-
-    int range = pow(2, width - 1) - 1;
-    if (n >= (-range - 1) && n <= range) {
-        return true;
-    }
-    return false;
+    return Bitpack_fitss_inline(n, width);
 }
 /* 
  * Function: Bitpack_getu
@@ -66,20 +45,7 @@ bool Bitpack_fitss(int64_t n, unsigned width)
  */
 uint64_t Bitpack_getu(uint64_t word, unsigned width, unsigned lsb)
 {
-    assert(width + lsb <= 64);
-    if (width == 0) {
-        return 0;
-    }
- 
-    /* Create mask to extract desired field */
-    uint64_t mask = ~0;
-    mask = mask >> (64 - width) << lsb;
-
-    /* Extract value */
-    word = word & mask; 
-    word = word >> lsb;
-
-    return word;
+    return Bitpack_getu_inline(word, width, lsb);
 }
 
 /* 
@@ -91,29 +57,7 @@ uint64_t Bitpack_getu(uint64_t word, unsigned width, unsigned lsb)
  */
 int64_t Bitpack_gets(uint64_t word, unsigned width, unsigned lsb) 
 {
-    assert(width + lsb <= 64);
-    if (width == 0) {
-        return 0;
-    }
-
-    /* Use getu to get the actual bits in the field */
-    int64_t signed_word = Bitpack_getu(word, width, lsb);
-
-    /* Get value of the signed bit */
-    int64_t sig_bit = signed_word >> (width - 1);
-
-    /* If positive, return as is */
-    if (sig_bit == 0) {
-        return signed_word;
-    }
-    
-    /* If negative, flip significant bits to represent
-       negative number */
-    uint64_t mask = ~0;
-    mask = mask << width;
-    signed_word = signed_word | mask;
-
-    return signed_word;
+    return Bitpack_gets_inline(word, width, lsb);
 }
 /* 
  * Function: Bitpack_newu
@@ -126,32 +70,7 @@ int64_t Bitpack_gets(uint64_t word, unsigned width, unsigned lsb)
  */
 uint64_t Bitpack_newu(uint64_t word, unsigned width, unsigned lsb, uint64_t value) 
 {
-    assert(width + lsb <= 64);
-    
-    /* Raise overflow exception if value does not fit
-     * within given width
-     */
-    if  (!Bitpack_fitsu(value, width)) {
-        RAISE(Bitpack_Overflow);
-    }
-
-    uint64_t mask = ~0;
-    mask = mask >> (64 - width) << lsb;
-
-    /* Shift value into appropriate lsb position */
-    value = value << lsb;
-
-    /* Overwrite respective field of the mask with appropriate value */
-    value = value & mask;
-
-    /* Clear out respective field in the word with a mask */
-    mask = ~mask; 
-    word = word & mask;
-
-    /* Overwrite appropriate field of the word with respective value
-     * and return
-     */
-    return word | value;
+    return Bitpack_newu_inline(word, width, lsb, value);
 }
 
 /* 
@@ -165,29 +84,5 @@ uint64_t Bitpack_newu(uint64_t word, unsigned width, unsigned lsb, uint64_t valu
  */
 uint64_t Bitpack_news(uint64_t word, unsigned width, unsigned lsb, int64_t value)
 {
-    assert(width + lsb <= 64);
-
-    /* Checks if given value fits in the width range */
-    if (!Bitpack_fitss(value, width)) {
-        RAISE(Bitpack_Overflow);
-    }
-        assert(width + lsb <= 64);
-    
-    uint64_t mask = ~0;
-    mask = mask >> (64 - width) << lsb;
-
-    /* Shift value into appropriate lsb position */
-    value = value << lsb;
-
-    /* Overwrite respective field of the mask with appropriate value */
-    value = value & mask;
-
-    /* Clear out respective field in the word with a mask */
-    mask = ~mask; 
-    word = word & mask;
-
-    /* Overwrite appropriate field of the word with respective value
-     * and return
-     */
-    return word | value;
+    return Bitpack_news_inline(word, width, lsb, value);
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+/* bitpack_inline.h
+ *
+ * Inline versions of the bitpack.h functions for use in inner loops
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Each function here behaves like the bitpack.h function of the same
+ * name without the _inline suffix, but it is defined in the header so
+ * the compiler can inline it and fold constant widths and lsbs, and
+ * every range check is done with integer shifts instead of pow().
+ *
+ * The _unchecked variants skip the range check and the assertion on
+ * width + lsb. They are for callers that have already made sure the
+ * value fits, such as the fixed codeword layout in compress40.c. Their
+ * width must be between 1 and 64; a value that does not fit is
+ * silently truncated instead of raising Bitpack_Overflow.
+ */
+
+#ifndef BITPACK_INLINE_INCLUDED
+#define BITPACK_INLINE_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "assert.h"
+#include "except.h"
+#include "bitpack.h"
+
+/* A mask of 'width' ones in the low bits; width is 1 to 64 */
+static inline uint64_t Bitpack_mask(unsigned width)
+{
+    return ~(uint64_t)0 >> (64 - width);
+}
+
+static inline bool Bitpack_fitsu_inline(uint64_t n, unsigned width)
+{
+    assert(width <= 64);
+    if (width == 0) {
+        return false;
+    }
+    return width == 64 || (n >> width) == 0;
+}
+
+/* n fits iff n + 2^(width - 1) is in [0, 2^width), done in unsigned */
+static inline bool Bitpack_fitss_inline(int64_t n, unsigned width)
+{
+    assert(width <= 64);
+    if (width == 0) {
+        return false;
+    }
+    if (width == 64) {
+        return true;
+    }
+    return (((uint64_t)n + ((uint64_t)1 << (width - 1))) >> width) == 0;
+}
+
+static inline uint64_t Bitpack_getu_inline(uint64_t word, unsigned width,
+                                           unsigned lsb)
+{
+    assert(width + lsb <= 64);
+    if (width == 0) {
+        return 0;
+    }
+    return (word >> lsb) & Bitpack_mask(width);
+}
+
+/* Moves the field to the top of the word, then shifts it back down
+ * arithmetically so the sign bit is copied into the high bits
+ */
+static inline int64_t Bitpack_gets_inline(uint64_t word, unsigned width,
+                                          unsigned lsb)
+{
+    assert(width + lsb <= 64);
+    if (width == 0) {
+        return 0;
+    }
+    return (int64_t)(word << (64 - width - lsb)) >> (64 - width);
+}
+
+static inline uint64_t Bitpack_newu_unchecked(uint64_t word, unsigned width,
+                                              unsigned lsb, uint64_t value)
+{
+    uint64_t mask = Bitpack_mask(width) << lsb;
+    return (word & ~mask) | ((value << lsb) & mask);
+}
+
+static inline uint64_t Bitpack_news_unchecked(uint64_t word, unsigned width,
+                                              unsigned lsb, int64_t value)
+{
+    return Bitpack_newu_unchecked(word, width, lsb, (uint64_t)value);
+}
+
+static inline uint64_t Bitpack_newu_inline(uint64_t word, unsigned width,
+                                           unsigned lsb, uint64_t value)
+{
+    assert(width + lsb <= 64);
+    if (!Bitpack_fitsu_inline(value, width)) {
+        RAISE(Bitpack_Overflow);
+    }
+    return Bitpack_newu_unchecked(word, width, lsb, value);
+}
+
+static inline uint64_t Bitpack_news_inline(uint64_t word, unsigned width,
+                                           unsigned lsb, int64_t value)
+{
+    assert(width + lsb <= 64);
+    if (!Bitpack_fitss_inline(value, width)) {
+        RAISE(Bitpack_Overflow);
+    }
+    return Bitpack_newu_unchecked(word, width, lsb, (uint64_t)value);
+}
+
+#endif
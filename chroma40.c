@@ -0,0 +1,45 @@
+/* chroma40.c
+ *
+ * Implementation file for the batch chroma quantizer in chroma40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ */
+
+#include <stdlib.h>
+#include "assert.h"
+#include "chroma40.h"
+
+/*
+ * Function: Chroma40_index_batch
+ * Purpose: Quantizes n chroma averages to their 4-bit indices
+ * Parameters: An array of n chroma values, an array of n unsigneds for
+ *             the indices, and n
+ * Returns: Nothing
+ * Expectations: Arrays are not NULL unless n is 0
+ */
+void Chroma40_index_batch(const float *chroma, unsigned *index, unsigned n)
+{
+    assert(n == 0 || (chroma != NULL && index != NULL));
+
+    /* Every element runs the same 15 compares, so this vectorizes */
+    for (unsigned k = 0; k < n; k++) {
+        index[k] = Chroma40_index(chroma[k]);
+    }
+}
+
+/*
+ * Function: Chroma40_value_batch
+ * Purpose: Dequantizes n 4-bit chroma indices
+ * Parameters: An array of n indices, an array of n floats for the chroma
+ *             values, and n
+ * Returns: Nothing
+ * Expectations: Arrays are not NULL unless n is 0
+ */
+void Chroma40_value_batch(const unsigned *index, float *chroma, unsigned n)
+{
+    assert(n == 0 || (chroma != NULL && index != NULL));
+
+    for (unsigned k = 0; k < n; k++) {
+        chroma[k] = Chroma40_value(index[k]);
+    }
+}
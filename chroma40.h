@@ -0,0 +1,54 @@
+/* chroma40.h
+ *
+ * Interface for quantizing the average Pb and Pr of a block to the
+ * 4-bit chroma index stored in a codeword, and back
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * This is an in-tree replacement for Arith40_index_of_chroma and
+ * Arith40_chroma_of_index with the same 16 levels and the same answers:
+ * a value maps to the nearest level, and a value exactly halfway between
+ * two levels maps to the lower one. The scalar functions are inline and
+ * branch-free so the compiler can fold them into the codeword loops; the
+ * batch functions do a whole array per call and are written so the
+ * compiler can vectorize them.
+ */
+
+#ifndef CHROMA40_INCLUDED
+#define CHROMA40_INCLUDED
+
+#include <math.h>
+
+#define CHROMA40_LEVELS 16
+
+static const float Chroma40_levels[CHROMA40_LEVELS] = {
+    -0.35, -0.20, -0.15, -0.10, -0.077, -0.055, -0.033, -0.011,
+     0.011,  0.033,  0.055,  0.077,  0.10,  0.15,  0.20,  0.35
+};
+
+/* Index of the level nearest x. The distances to the sorted levels fall
+ * and then rise, so the nearest level's index is the number of steps
+ * along the table that get strictly closer to x.
+ */
+static inline unsigned Chroma40_index(float x)
+{
+    unsigned index = 0;
+    for (unsigned i = 0; i + 1 < CHROMA40_LEVELS; i++) {
+        index += fabsf(x - Chroma40_levels[i + 1]) <
+                 fabsf(x - Chroma40_levels[i]);
+    }
+    return index;
+}
+
+/* Chroma value of a 4-bit index */
+static inline float Chroma40_value(unsigned index)
+{
+    return Chroma40_levels[index & (CHROMA40_LEVELS - 1)];
+}
+
+extern void Chroma40_index_batch(const float *chroma, unsigned *index,
+                                 unsigned n);
+extern void Chroma40_value_batch(const unsigned *index, float *chroma,
+                                 unsigned n);
+
+#endif
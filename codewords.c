@@ -0,0 +1,544 @@
+/* codewords.c
+ *
+ * Implementation file for the codeword writer and reader in codewords.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "assert.h"
+#include "codewords.h"
+
+#define T Codewords_T
+
+/*
+ * Struct to hold a writer or a reader
+ * Contains - whether it writes or reads
+ *            the descriptor a writer flushes to, or -1 for a writer
+ *            that keeps everything in memory, or the FILE a reader
+ *            refills its buffer from
+ *            a buffer and the number of bytes in it: for a writer, the
+ *            bytes queued so far; for a reader, the bytes read ahead
+ *            the size of a writer's buffer
+ *            the offset of the next unread byte in a reader's buffer
+ *            the mapping of a reader's whole input file, or NULL, and
+ *            whether it is instead memory the reader owns
+ *            whether a reader's input is a regular file, and the file
+ *            offset of its first codeword
+ */
+struct T {
+        int writing;
+        int fd;
+        FILE *fp;
+        size_t used;
+        unsigned char *buf;
+        size_t size;
+        size_t pos;
+        unsigned char *map;
+        size_t map_len;
+        int owned;
+        int random;
+        off_t start;
+};
+
+static void refill(T words);
+
+/* Big-endian load; compilers turn the shifts into one load and a byte
+ * swap on little-endian machines
+ */
+static inline uint32_t load_be32(const unsigned char *p)
+{
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+               (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+/*
+ * Function: Codewords_new_writer
+ * Purpose: Creates an empty writer for a file descriptor
+ * Parameters: An open file descriptor
+ * Returns: A new Codewords_T
+ * Expectations: fd is not negative
+ */
+T Codewords_new_writer(int fd)
+{
+        assert(fd >= 0);
+
+        T words = malloc(sizeof(*words));
+        assert(words != NULL);
+        words->writing = 1;
+        words->fd = fd;
+        words->fp = NULL;
+        words->used = 0;
+        words->buf = malloc(CODEWORDS_BUFSIZE);
+        assert(words->buf != NULL);
+        words->size = CODEWORDS_BUFSIZE;
+        words->pos = 0;
+        words->map = NULL;
+        words->map_len = 0;
+        words->owned = 0;
+        words->random = 0;
+        words->start = 0;
+
+        return words;
+}
+
+/*
+ * Function: Codewords_new_buffer
+ * Purpose: Creates an empty writer that keeps what is queued in memory,
+ *          growing its buffer instead of flushing it
+ * Parameters: None
+ * Returns: A new Codewords_T, to be released with Codewords_take
+ */
+T Codewords_new_buffer(void)
+{
+        T words = malloc(sizeof(*words));
+        assert(words != NULL);
+        words->writing = 1;
+        words->fd = -1;
+        words->fp = NULL;
+        words->used = 0;
+        words->size = 4096;
+        words->buf = malloc(words->size);
+        assert(words->buf != NULL);
+        words->pos = 0;
+        words->map = NULL;
+        words->map_len = 0;
+        words->owned = 0;
+        words->random = 0;
+        words->start = 0;
+
+        return words;
+}
+
+/*
+ * Function: Codewords_take
+ * Purpose: Frees a writer made by Codewords_new_buffer, keeping its bytes
+ * Parameters: Pointer to the Codewords_T and where to put the number of
+ *             bytes
+ * Returns: Everything queued, in a malloc'd buffer the caller frees
+ * Expectations: wordsp and *wordsp are not NULL
+ */
+unsigned char *Codewords_take(T *wordsp, size_t *n)
+{
+        assert(wordsp != NULL && *wordsp != NULL && n != NULL);
+
+        T words = *wordsp;
+        assert(words->writing && words->fd < 0);
+        unsigned char *bytes = words->buf;
+        *n = words->used;
+        free(words);
+        *wordsp = NULL;
+        return bytes;
+}
+
+/*
+ * Function: Codewords_new_reader
+ * Purpose: Creates a reader for the codewords from the current position
+ *          of 'fp' to its end. A regular file is mapped whole, and the
+ *          reader starts at the offset ftell reports, which accounts for
+ *          anything stdio has already buffered. Anything else is read
+ *          through 'fp' in CODEWORDS_BUFSIZE blocks.
+ * Parameters: An open FILE pointer
+ * Returns: A new Codewords_T
+ * Expectations: fp is not NULL
+ */
+T Codewords_new_reader(FILE *fp)
+{
+        assert(fp != NULL);
+
+        T words = malloc(sizeof(*words));
+        assert(words != NULL);
+        words->writing = 0;
+        words->fd = fileno(fp);
+        words->fp = fp;
+        words->used = 0;
+        words->buf = NULL;
+        words->size = 0;
+        words->pos = 0;
+        words->map = NULL;
+        words->map_len = 0;
+        words->owned = 0;
+        words->random = 0;
+        words->start = 0;
+
+        struct stat st;
+        off_t start = ftello(fp);
+        if (start >= 0 && fstat(words->fd, &st) == 0 &&
+            S_ISREG(st.st_mode)) {
+                words->random = 1;
+                words->start = start;
+        }
+        if (words->random && st.st_size > start) {
+                void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                 words->fd, 0);
+                if (map != MAP_FAILED) {
+                        madvise(map, st.st_size, MADV_SEQUENTIAL);
+                        words->map = map;
+                        words->map_len = st.st_size;
+
+                        /* The mapping serves as the read-ahead buffer */
+                        words->buf = words->map;
+                        words->used = words->map_len;
+                        words->pos = start;
+                        return words;
+                }
+        }
+
+        words->buf = malloc(CODEWORDS_BUFSIZE);
+        assert(words->buf != NULL);
+        return words;
+}
+
+/*
+ * Function: Codewords_new_memory
+ * Purpose: Creates a reader for codewords already in memory, such as
+ *          those an entropy-coded image decodes to. The bytes serve as
+ *          the mapping of a regular file would, so the reader has random
+ *          access.
+ * Parameters: A malloc'd buffer of n bytes, which the reader takes over
+ *             and frees
+ * Returns: A new Codewords_T
+ * Expectations: bytes is not NULL
+ */
+T Codewords_new_memory(unsigned char *bytes, size_t n)
+{
+        assert(bytes != NULL);
+
+        T words = malloc(sizeof(*words));
+        assert(words != NULL);
+        words->writing = 0;
+        words->fd = -1;
+        words->fp = NULL;
+        words->used = n;
+        words->buf = bytes;
+        words->size = n;
+        words->pos = 0;
+        words->map = bytes;
+        words->map_len = n;
+        words->owned = 1;
+        words->random = 1;
+        words->start = 0;
+
+        return words;
+}
+
+/*
+ * Function: Codewords_free
+ * Purpose: Flushes a writer, then frees a writer or reader
+ * Parameters: Pointer to the Codewords_T to free
+ * Returns: Nothing
+ * Expectations: wordsp and *wordsp are not NULL
+ */
+void Codewords_free(T *wordsp)
+{
+        assert(wordsp != NULL && *wordsp != NULL);
+
+        T words = *wordsp;
+        if (words->writing) {
+                Codewords_flush(words);
+        }
+        if (words->map != NULL && !words->owned) {
+                munmap(words->map, words->map_len);
+        } else {
+                free(words->buf);
+        }
+        free(words);
+        *wordsp = NULL;
+}
+
+/*
+ * Function: Codewords_put
+ * Purpose: Queues one codeword in big-endian order
+ * Parameters: The writer and the codeword
+ * Returns: Nothing
+ * Expectations: words is not NULL
+ */
+void Codewords_put(T words, uint32_t word)
+{
+        assert(words != NULL && words->writing);
+
+        if (words->used + 4 > words->size) {
+                Codewords_flush(words);
+        }
+
+        unsigned char *p = words->buf + words->used;
+        p[0] = word >> 24;
+        p[1] = word >> 16;
+        p[2] = word >> 8;
+        p[3] = word;
+        words->used += 4;
+}
+
+/*
+ * Function: Codewords_put_row
+ * Purpose: Queues n codewords in big-endian order
+ * Parameters: The writer, an array of codewords and its length
+ * Returns: Nothing
+ * Expectations: words is not NULL; row is not NULL unless n is 0
+ */
+void Codewords_put_row(T words, const uint32_t *row, size_t n)
+{
+        assert(words != NULL && words->writing);
+        assert(n == 0 || row != NULL);
+
+        while (n > 0) {
+                if (words->used + 4 > words->size) {
+                        Codewords_flush(words);
+                }
+
+                /* As many words as fit before the next flush */
+                size_t room = (words->size - words->used) / 4;
+                size_t count = n < room ? n : room;
+                unsigned char *p = words->buf + words->used;
+                for (size_t k = 0; k < count; k++) {
+                        p[4 * k]     = row[k] >> 24;
+                        p[4 * k + 1] = row[k] >> 16;
+                        p[4 * k + 2] = row[k] >> 8;
+                        p[4 * k + 3] = row[k];
+                }
+                words->used += 4 * count;
+                row += count;
+                n -= count;
+        }
+}
+
+/*
+ * Function: Codewords_write
+ * Purpose: Queues n raw bytes
+ * Parameters: The writer, the bytes and their count
+ * Returns: Nothing
+ * Expectations: words is not NULL; bytes is not NULL unless n is 0
+ */
+void Codewords_write(T words, const void *bytes, size_t n)
+{
+        assert(words != NULL && words->writing);
+        assert(n == 0 || bytes != NULL);
+
+        const unsigned char *src = bytes;
+        while (n > 0) {
+                if (words->used == words->size) {
+                        Codewords_flush(words);
+                }
+                size_t room = words->size - words->used;
+                size_t count = n < room ? n : room;
+                memcpy(words->buf + words->used, src, count);
+                words->used += count;
+                src += count;
+                n -= count;
+        }
+}
+
+/*
+ * Function: Codewords_flush
+ * Purpose: Writes the queued bytes to the descriptor, retrying short
+ *          and interrupted writes; a writer that keeps everything in
+ *          memory doubles its buffer instead
+ * Parameters: The writer
+ * Returns: Nothing
+ * Expectations: words is not NULL; write(2) does not fail
+ */
+void Codewords_flush(T words)
+{
+        assert(words != NULL && words->writing);
+
+        if (words->fd < 0) {
+                /* Room for at least one more codeword */
+                if (words->size - words->used < 4) {
+                        words->size *= 2;
+                        words->buf = realloc(words->buf, words->size);
+                        assert(words->buf != NULL);
+                }
+                return;
+        }
+
+        size_t done = 0;
+        while (done < words->used) {
+                ssize_t n = write(words->fd, words->buf + done,
+                                  words->used - done);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                assert(n > 0);
+                done += n;
+        }
+        words->used = 0;
+}
+
+/*
+ * Function: Codewords_get
+ * Purpose: Loads the next big-endian codeword
+ * Parameters: The reader
+ * Returns: The codeword
+ * Expectations: words is a reader with a codeword left
+ */
+uint32_t Codewords_get(T words)
+{
+        assert(words != NULL && !words->writing);
+
+        if (words->used - words->pos < 4) {
+                refill(words);
+        }
+        uint32_t word = load_be32(words->buf + words->pos);
+        words->pos += 4;
+        return word;
+}
+
+/*
+ * Function: Codewords_get_row
+ * Purpose: Loads the next n big-endian codewords
+ * Parameters: The reader, an array for the codewords and its length
+ * Returns: Nothing
+ * Expectations: words is a reader with n codewords left; row is not
+ *               NULL unless n is 0
+ */
+void Codewords_get_row(T words, uint32_t *row, size_t n)
+{
+        assert(words != NULL && !words->writing);
+        assert(n == 0 || row != NULL);
+
+        while (n > 0) {
+                if (words->used - words->pos < 4) {
+                        refill(words);
+                }
+
+                /* As many whole words as are buffered */
+                size_t have = (words->used - words->pos) / 4;
+                size_t count = n < have ? n : have;
+                const unsigned char *p = words->buf + words->pos;
+                for (size_t k = 0; k < count; k++) {
+                        row[k] = load_be32(p + 4 * k);
+                }
+                words->pos += 4 * count;
+                row += count;
+                n -= count;
+        }
+}
+
+/*
+ * Function: Codewords_skip
+ * Purpose: Moves past the next n codewords without loading them. A
+ *          mapped reader just moves its position; an unmapped reader
+ *          seeks past whatever is not buffered if the input is a regular
+ *          file, and reads and drops it otherwise.
+ * Parameters: The reader and the number of codewords to skip
+ * Returns: Nothing
+ * Expectations: words is a reader with n codewords left
+ */
+void Codewords_skip(T words, size_t n)
+{
+        assert(words != NULL && !words->writing);
+
+        size_t bytes = 4 * n;
+        size_t left = words->used - words->pos;
+        if (bytes <= left) {
+                words->pos += bytes;
+                return;
+        }
+        assert(words->map == NULL);
+        bytes -= left;
+        words->used = 0;
+        words->pos = 0;
+
+        if (words->random) {
+                int err = fseeko(words->fp, bytes, SEEK_CUR);
+                assert(err == 0);
+                return;
+        }
+        while (bytes > 0) {
+                size_t chunk = bytes < CODEWORDS_BUFSIZE ? bytes
+                                                         : CODEWORDS_BUFSIZE;
+                size_t got = fread(words->buf, 1, chunk, words->fp);
+                assert(got > 0);
+                bytes -= got;
+        }
+}
+
+/*
+ * Function: Codewords_random_access
+ * Purpose: Tells whether Codewords_get_at can be used on a reader
+ * Parameters: The reader
+ * Returns: 1 if the input is a regular file, 0 otherwise
+ */
+int Codewords_random_access(T words)
+{
+        assert(words != NULL && !words->writing);
+        return words->random;
+}
+
+/*
+ * Function: Codewords_get_at
+ * Purpose: Loads n codewords starting with codeword number 'first',
+ *          counting from where the reader started, from the mapping or
+ *          with pread(2). It neither uses nor moves the reader's position
+ *          and changes nothing in the reader, so threads may call it at
+ *          the same time.
+ * Parameters: The reader, the number of the first codeword, an array for
+ *             the codewords and its length
+ * Returns: Nothing
+ * Expectations: The reader has random access and the input holds all n
+ *               codewords
+ */
+void Codewords_get_at(T words, size_t first, uint32_t *row, size_t n)
+{
+        assert(words != NULL && !words->writing && words->random);
+        assert(n == 0 || row != NULL);
+
+        off_t offset = words->start + (off_t)first * 4;
+        if (words->map != NULL) {
+                assert((size_t)offset + 4 * n <= words->map_len);
+                const unsigned char *p = words->map + offset;
+                for (size_t k = 0; k < n; k++) {
+                        row[k] = load_be32(p + 4 * k);
+                }
+                return;
+        }
+
+        /* Read the bytes into the row itself, then swap them in place */
+        unsigned char *bytes = (unsigned char *)row;
+        size_t done = 0;
+        while (done < 4 * n) {
+                ssize_t got = pread(words->fd, bytes + done, 4 * n - done,
+                                    offset + done);
+                if (got < 0 && errno == EINTR) {
+                        continue;
+                }
+                assert(got > 0);
+                done += got;
+        }
+        for (size_t k = 0; k < n; k++) {
+                row[k] = load_be32(bytes + 4 * k);
+        }
+}
+
+/*
+ * Function: refill
+ * Purpose: Moves the unread tail of a reader's buffer to the front and
+ *          reads more bytes after it until at least one whole codeword
+ *          is buffered
+ * Parameters: The reader
+ * Returns: Nothing
+ * Expectations: The input has another codeword; a mapped reader already
+ *               holds its whole input, so for it this is always an error
+ */
+static void refill(T words)
+{
+        assert(words->map == NULL);
+
+        size_t left = words->used - words->pos;
+        memmove(words->buf, words->buf + words->pos, left);
+        words->used = left;
+        words->pos = 0;
+
+        while (words->used < 4) {
+                size_t n = fread(words->buf + words->used, 1,
+                                 CODEWORDS_BUFSIZE - words->used, words->fp);
+                assert(n > 0);
+                words->used += n;
+        }
+}
@@ -0,0 +1,91 @@
+/* codewords.h
+ *
+ * Interface for writing and reading a stream of 32-bit big-endian
+ * codewords
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * A writer stores each codeword big-endian into a large buffer and
+ * hands the buffer to write(2) only when it fills, so a whole image goes
+ * out in a few large writes instead of four putchar calls per block.
+ * Nothing goes through stdio; a client that has also printed to the
+ * same descriptor with stdio must fflush before creating the writer.
+ *
+ * A reader memory-maps its input when it is a regular file and loads
+ * each codeword straight from the mapped bytes. For a pipe or terminal
+ * it falls back to reading large blocks into a buffer. A reader can
+ * also be made for codewords already decoded into memory, and a writer
+ * for codewords that are to stay in memory.
+ */
+
+#ifndef CODEWORDS_INCLUDED
+#define CODEWORDS_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define T Codewords_T
+typedef struct T *T;
+
+/* Bytes buffered before each write(2), or per read of an unmapped input */
+#define CODEWORDS_BUFSIZE (1 << 18)
+
+extern T    Codewords_new_writer(int fd);
+
+/* A writer that keeps everything queued in memory; Codewords_take frees
+ * it and hands back the bytes, in a malloc'd buffer of *n bytes
+ */
+extern T    Codewords_new_buffer(void);
+extern unsigned char *Codewords_take(T *wordsp, size_t *n);
+
+/* Reads the codewords that start at the current position of 'fp',
+ * which is typically just past a header read with stdio
+ */
+extern T    Codewords_new_reader(FILE *fp);
+
+/* Reads the codewords in the n bytes at 'bytes', a malloc'd buffer that the
+ * reader frees along with itself
+ */
+extern T    Codewords_new_memory(unsigned char *bytes, size_t n);
+
+/* Flushes anything a writer still has buffered, then frees the writer
+ * or reader; the descriptor or FILE is left open
+ */
+extern void Codewords_free      (T *wordsp);
+
+/* Queues one codeword, most significant byte first */
+extern void Codewords_put       (T words, uint32_t word);
+
+/* Queues n codewords, most significant byte first */
+extern void Codewords_put_row   (T words, const uint32_t *row, size_t n);
+
+/* Queues n raw bytes, such as a text header */
+extern void Codewords_write     (T words, const void *bytes, size_t n);
+
+/* Writes out everything queued so far; it is a checked runtime error
+ * for write(2) to fail
+ */
+extern void Codewords_flush     (T words);
+
+/* Return the next codeword, or the next n into 'row'; it is a checked
+ * runtime error to read past the end of the input
+ */
+extern uint32_t Codewords_get   (T words);
+extern void Codewords_get_row   (T words, uint32_t *row, size_t n);
+
+/* Moves past the next n codewords; for a mapped or seekable input this
+ * does no I/O
+ */
+extern void Codewords_skip      (T words, size_t n);
+
+/* A reader of a regular file can also load any n codewords by their
+ * position, counting from where the reader started, without moving the
+ * reader; Codewords_get_at is safe to call from several threads
+ */
+extern int  Codewords_random_access(T words);
+extern void Codewords_get_at    (T words, size_t first, uint32_t *row,
+                                 size_t n);
+
+#undef T
+#endif
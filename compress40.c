@@ -12,61 +12,316 @@
 #include "assert.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include "pnm.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+/* Ahead of pnm.h, so that the in-tree a2methods.h (with map_rows) is the
+ * one that gets included */
 #include "a2methods.h"
+#include "pnm.h"
 #include "bitpack.h"
-#include "a2plain.h"
+#include "bitpack_inline.h"
+#include "a2flat.h"
 #include "a2blocked.h"
-#include "arith40.h"
+#include "chroma40.h"
+#include "ppmrows.h"
+#include "dct40.h"
+#include "fixed40.h"
+#include "codewords.h"
+#include "entropy40.h"
+#include "transform40.h"
+#include "rate40.h"
+#include "tiles40.h"
+#include "stripes.h"
 #include <math.h>
 
-const int DENOM = 30000;
 // const unsigned SCALED_UINT = 9;
 // const int SCALED_INT = 5;
 // const unsigned INDEX_UINT = 4;
 
-typedef struct Pixel_float {
-    float red, green, blue;
-} *Pixel_float;
-
-typedef struct Component_vid {
-    float y, pb, pr;
-} *Component_vid;
-    
-typedef struct dct_elem {
-    float average_pb, average_pr, a, b, c, d;
-} *dct_elem;
 typedef struct A2_with_methods {
     A2Methods_UArray2 a2;
     A2Methods_T methods;
 } *A2_with_methods;
 
+/* The source image of compress40, as the raw samples of a PPM raster */
+typedef struct Raster {
+    const unsigned char *samples;
+    size_t row_bytes;
+    unsigned sample_bytes;
+    float denom;
+} *Raster;
+
+/* Scratch space for compress_strip, one per thread */
+typedef struct Strip_buffers {
+    Dct40_planes planes;    /* one block row; Pr follows Pb */
+    unsigned *index;        /* quantized Pb averages, then Pr averages */
+    Fixed40_fields fields;  /* the same block row, quantized by Fixed40 */
+} *Strip_buffers;
+
+/* Scratch space of compress_stream and decompress_stream, which a worker
+ * of compress40_batch keeps from one image to the next. The buffers only
+ * grow; 'strip' is made again for an image of another width.
+ */
+typedef struct Stream_buffers {
+    unsigned width;         /* trimmed width 'strip' was made for */
+    Strip_buffers strip;
+    struct Pnm_rgb *rgb;    /* two rows of pixels */
+    size_t pixels;
+    uint32_t *words;        /* one block row of codewords */
+    size_t nwords;
+    unsigned char *raw;     /* two packed rows, when decoding */
+    size_t raw_bytes;
+    unsigned denom;         /* denominator 'fixed' was made for */
+    Fixed40_T fixed;
+} *Stream_buffers;
+
+/* What the fields of a codeword are multiplied by: a is Y times y_scale
+ * and b, c and d are coefficients times coef_scale
+ */
+typedef struct Quant {
+    unsigned y_scale, coef_scale;
+} Quant;
+
+/* The quantization of formats 2 and 3 */
+static const Quant Format2_quant = { 511, 50 };
+
+/* What the text header of a compressed image says */
+typedef struct Header {
+    unsigned format;            /* 2 to 6 */
+    unsigned width, height;     /* even, except in format 4 */
+    unsigned block;             /* side of a block, 2 except in format 4 */
+    Quant quant;                /* Format2_quant, except in format 5 */
+    unsigned tile;              /* side of a tile in format 6, else 0 */
+} Header;
+
+/* Closure of Read_from_disk */
+typedef struct Disk_reader {
+    Codewords_T in;
+    const Quant *quant;
+} *Disk_reader;
+
+/* Denominator of the images the decompressors write; 0 stands for DENOM */
+static unsigned out_maxval = 0;
+
+/* Whether the strip compressors use the fixed-point arithmetic */
+static int fixed_point = 0;
+
+/* Whether the strip compressors write entropy-coded format 3 */
+static int entropy_coded = 0;
+
+/* Side of the blocks the strip compressors use; anything but 2 means
+ * format 4
+ */
+static unsigned block_size = 2;
+
+/* Target of the rate-controlled format 5, a size in bytes or an RMS
+ * error; the strip compressors write format 5 when either is nonzero
+ */
+static size_t rate_bytes = 0;
+static double rate_rms = 0;
+
+/* Side of the tiles of format 6, which the strip compressors write when
+ * it is nonzero
+ */
+static unsigned tile_size = 0;
+
+/* Whether the last image compress40_stream_fd wrote in format 5 met its
+ * target; 1 if it was in another format
+ */
+static int target_met = 1;
+
+/* Side of a block of the blocked component video array. It must be
+ * even so that no 2x2 block straddles two blocks; 32 x 32 pixels of
+ * component video is 12KB, which leaves room in L1 for the pixels and
+ * DCT elements that go with it.
+ */
+#define CV_BLOCKSIZE 32
+
+/* Bytes of pixels in one stripe of compress40_parallel or
+ * decompress40_parallel
+ */
+#define STRIPE_BYTES (1 << 20)
+
+/* Codewords whose chroma indices unpack_chroma gathers before each pair
+ * of Chroma40_value_batch calls
+ */
+#define CHROMA_CHUNK 256
+
+/* One slot in the ring of stripes of compress40_parallel and
+ * decompress40_parallel
+ */
+struct Stripe {
+    unsigned block_rows;    /* block rows in this stripe */
+    struct Pnm_rgb *rgb;    /* source rows, or 2 decoded rows */
+    uint32_t *words;        /* block_rows rows of codewords */
+    unsigned char *raw;     /* 2 * block_rows packed rows, when decoding */
+    Strip_buffers buffers;
+};
+
+/* What the workers of a parallel compressor or decompressor share;
+ * none of it changes once they start
+ */
+typedef struct Stripe_job {
+    unsigned src_width, width;
+    float denom;
+    Fixed40_T fixed;        /* tables for denom, if fixed_point is set */
+    unsigned stripe_rows;   /* block rows in every stripe but the last */
+    Codewords_T in;         /* input, if workers may read it themselves */
+    Ppmrows_T ppm;          /* output of a decompressor */
+    Quant quant;            /* quantization of a decompressor's input */
+} *Stripe_job;
+
+/* One slot in the ring of tiles of compress_tiled and decompress_tiled,
+ * or the only one when there are no worker threads
+ */
+typedef struct Tile_slot {
+    unsigned col;           /* column of the tile in the current tile row */
+    uint32_t *words;        /* one block row of the tile */
+    unsigned width;         /* the side of a tile */
+    Strip_buffers full;     /* for tiles of the full width */
+    Strip_buffers edge;     /* for a narrower last column, if any */
+    unsigned char *bytes;   /* the compressed tile */
+    size_t size;
+} *Tile_slot;
+
+/* What the workers of compress_tiled and decompress_tiled share; only
+ * 'row' changes, between tile rows, while no tile is posted
+ */
+typedef struct Tile_job {
+    Tiles40_T tiles;
+    unsigned row;           /* the tile row being worked on */
+    struct Pnm_rgb *rgb;    /* its pixels, from column x0 on */
+    size_t stride;          /* pixels from one row of rgb to the next */
+    unsigned x0;
+    float denom;            /* source denominator of a compressor */
+    Fixed40_T fixed;        /* tables for denom, if fixed_point is set */
+    unsigned maxval;        /* output denominator of a decompressor */
+    FILE *input;            /* input of a decompressor */
+    unsigned char **kept;   /* every compressed tile, in order */
+    size_t nkept;
+} *Tile_job;
+
+/* One slot in the ring of files of compress40_batch */
+typedef struct Batch_slot {
+    Compress40_file *file;
+    Stream_buffers buffers;
+} *Batch_slot;
+
 /* Compression functions */
-void RGB_to_CV();
-void CV_to_DCT();
-void pack_and_print();
+void compress_arrays(FILE *input, int blocked);
+A2Methods_T cv_array_methods(int blocked, unsigned width, unsigned height);
+void RGB_to_CV(int i, int j, int n, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, void *cl);
+void CV_to_DCT(int i, int j, int w, int h, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, int stride, void *cl);
+void pack_and_print(int i, int j, int n, A2Methods_UArray2 dct_array,
+                    A2Methods_Object *first, void *cl);
 void Write_to_disk();
 
 /* Helper function for compression */
-void RGB_to_float(Pnm_rgb rgb, Pixel_float pix, float denom);
+void write_header(Codewords_T out, const Header *header);
+void put_codewords(Codewords_T out, Entropy40_T coder, const uint32_t *words,
+                   size_t n);
+void finish_codewords(Codewords_T *outp, Entropy40_T *coderp);
+void print_codeword(dct_elem element, Codewords_T out);
+uint32_t pack_codeword(dct_elem element, unsigned pb, unsigned pr);
+uint32_t pack_fields(unsigned a, int b, int c, int d, unsigned pb,
+                     unsigned pr);
+void compress_strip(const struct Pnm_rgb *top, const struct Pnm_rgb *bottom,
+                    unsigned width, float denom, Strip_buffers buffers,
+                    uint32_t *words);
+void compress_strip_fixed(const struct Pnm_rgb *top,
+                          const struct Pnm_rgb *bottom, unsigned width,
+                          Fixed40_T fixed, Strip_buffers buffers,
+                          uint32_t *words);
+void compress_transform(FILE *input, int fd);
+int compress_rate(FILE *input, int fd);
+void compress_tiled(FILE *input, int fd, unsigned threads);
+void compress_tile(void *slot, unsigned seq, void *cl);
+void keep_tile(Tile_slot slot, Tile_job job);
+void rate_strip(const struct Raster *image, unsigned j, unsigned blocks,
+                struct Component_vid *top, struct Component_vid *bottom,
+                struct dct_elem *dct);
+Strip_buffers strip_buffers_new(unsigned width);
+void strip_buffers_free(Strip_buffers *buffersp);
+void **stripe_slots_new(unsigned nslots, size_t pixels, size_t words,
+                        size_t raw_bytes, unsigned width);
+void stripe_slots_free(void **slots, unsigned nslots);
+void compress_stripe(void *slot, unsigned seq, void *cl);
+int compress_stream(FILE *input, int fd, Stream_buffers buffers);
 
 unsigned int quantize_Y(float y);
 int quantize_coef(float x);
 
 /* Decompression functions */
-void CV_to_RGB();
-void DCT_to_CV(int i, int j, A2Methods_UArray2 cv_array,
-               A2Methods_Object *elem, void *cl);
+void decompress_arrays(FILE *input, int blocked);
+void CV_to_RGB(int i, int j, int n, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, void *cl);
+void DCT_to_CV(int i, int j, int w, int h, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, int stride, void *cl);
+void write_row(int i, int j, int n, A2Methods_UArray2 rgb_array,
+               A2Methods_Object *first, void *cl);
 
 /* Helper functions for decompression */
-void float_to_RGB(Pnm_rgb rgb, Pixel_float pix);
+void read_header(FILE *input, Header *header);
+Codewords_T open_codewords(FILE *input, const Header *header);
+void unpack_codeword(uint32_t word, const Quant *quant, dct_elem element);
+void unpack_chroma(const uint32_t *words, unsigned n, float *pb, float *pr);
+void unpack_row(const uint32_t *words, unsigned blocks, const Quant *quant,
+                Dct40_planes planes);
+void decompress_strip(const uint32_t *words, unsigned width,
+                      const Quant *quant, Dct40_planes planes,
+                      struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                      unsigned maxval);
+void decompress_strip_bytes(const uint32_t *words, unsigned width,
+                            const Quant *quant, Dct40_planes planes,
+                            unsigned char *top, unsigned char *bottom);
+void decompress_stripe(void *slot, unsigned seq, void *cl);
+void decompress_stream(FILE *input, FILE *output, Stream_buffers buffers);
+void decompress_transform(FILE *input, FILE *output, unsigned width,
+                          unsigned height, unsigned block, unsigned x,
+                          unsigned y, unsigned w, unsigned h);
+void decompress_tiled(FILE *input, FILE *output, const Header *header,
+                      unsigned threads, unsigned x, unsigned y, unsigned w,
+                      unsigned h);
+void decompress_tile(void *slot, unsigned seq, void *cl);
+void stream_tile_row(Tile_job job, Tile_slot slot, unsigned col0,
+                     unsigned col_end, Ppmrows_T rows, unsigned first,
+                     unsigned last, unsigned x, unsigned w);
+Codewords_T open_tile(unsigned char *bytes, size_t size, Header *header);
+void unpack_averages(const uint32_t *words, unsigned n, const Quant *quant,
+                     struct Component_vid *cv);
+void thumbnail_tiled(FILE *input, const Header *header);
+void thumbnail_transform(FILE *input, unsigned width, unsigned height,
+                         unsigned block);
+
+/* Helper functions for tiles */
+void **tile_slots_new(unsigned nslots, Tiles40_T tiles, unsigned tile);
+void tile_slots_free(void **slots, unsigned nslots);
+void work_tile_row(Stripes_T stripes, void **slots, unsigned first,
+                   unsigned end, Stripes_work *work, Tile_job job,
+                   void (*done)(Tile_slot slot, Tile_job job));
+unsigned output_maxval(void);
+
+/* Helper functions for compress40_batch */
+Stream_buffers stream_buffers_new(void);
+void stream_buffers_free(Stream_buffers *buffersp);
+void stream_buffers_fit(Stream_buffers buffers, size_t pixels,
+                        unsigned width, size_t raw_bytes);
+Fixed40_T stream_buffers_fixed(Stream_buffers buffers, unsigned denom);
+void *grow_buffer(void *buffer, size_t *have, size_t need, size_t size);
+void batch_file(void *slot, unsigned seq, void *cl);
 
 void print_float(int i, int j, A2Methods_UArray2 image, 
                   A2Methods_Object *elem, void *cl);
-void Read_from_disk(int i, int j, A2Methods_UArray2 image, 
-                  A2Methods_Object *elem, void *cl);
-float get_Y(unsigned y);
-float get_coef(int x);
+void Read_from_disk(int i, int j, int n, A2Methods_UArray2 dct_array,
+                    A2Methods_Object *first, void *cl);
+void *span(const struct A2Methods_T *methods, A2Methods_UArray2 array2,
+           int i, int j, int n);
+float get_Y(unsigned y, unsigned scale);
+float get_coef(int x, unsigned scale);
 
 /*
  * Function: compress40
@@ -79,396 +334,2564 @@ float get_coef(int x);
  *               asserts that the pointers to those objects are not NULL.
  */
 void compress40(FILE *input) {
-    A2Methods_T methods = uarray2_methods_plain;
-    assert(methods != NULL);
-
-    A2Methods_mapfun *map = methods->map_row_major;
-    assert(map != NULL);
+    compress_arrays(input, 0);
+}
 
-    Pnm_ppm image;
-    image = Pnm_ppmread(input, methods);
-    //
+/*
+ * Function: compress40_blocked
+ * Purpose: Compresses like compress40, but keeps the component video
+ *          image in CV_BLOCKSIZE blocks so that each 2x2 block is worked
+ *          on while its pixels are still in cache, however wide the
+ *          image is. Output is byte-for-byte the same as compress40.
+ * Parameters: Takes a FILE pointer for input
+ * Returns: Void
+ * Expectations: Same as compress40
+ */
+void compress40_blocked(FILE *input) {
+    compress_arrays(input, 1);
+}
 
-    A2Methods_UArray2 cv_array = methods->new(image->width, image->height, 
-                                   sizeof(struct Component_vid));
+/*
+ * Function: compress_arrays
+ * Purpose: Does the work of compress40 and compress40_blocked
+ * Parameters: Takes a FILE pointer for input and whether the component
+ *             video array is blocked
+ * Returns: Void
+ * Expectations: Asserts that the arrays and closure are allocated and
+ *               that their methods can map by rows and by blocks
+ */
+void compress_arrays(FILE *input, int blocked) {
+    /* The codewords are written in row-major order, so only the
+     * component video array may be blocked
+     */
+    A2Methods_T methods = uarray2_methods_flat;
+    assert(methods != NULL && methods->map_rows != NULL);
+
+    /* The pixels stay as the file's own samples, mapped when it can be */
+    Ppmrows_T ppm = Ppmrows_new(input);
+    struct Raster image;
+    image.samples = Ppmrows_raster(ppm);
+    image.row_bytes = Ppmrows_row_bytes(ppm);
+    image.sample_bytes = Ppmrows_sample_bytes(ppm);
+    image.denom = Ppmrows_denominator(ppm);
+
+    /* An odd last row or column has no 2x2 block and is trimmed */
+    unsigned width = Ppmrows_width(ppm) - Ppmrows_width(ppm) % 2;
+    unsigned height = Ppmrows_height(ppm) - Ppmrows_height(ppm) % 2;
+
+    A2Methods_T cv_methods = cv_array_methods(blocked, width, height);
+    assert(cv_methods->map_rows != NULL && cv_methods->map_blocks != NULL);
+    A2Methods_UArray2 cv_array = cv_methods->new_with_blocksize(width,
+                                   height, sizeof(struct Component_vid),
+                                   CV_BLOCKSIZE);
     assert(cv_array != NULL);
     
-    map(cv_array, RGB_to_CV, image);
+    cv_methods->map_rows(cv_array, RGB_to_CV, &image);
 
-    A2Methods_UArray2 dct_array = methods->new(image->width / 2, image->height / 2, sizeof(struct dct_elem));
+    A2Methods_UArray2 dct_array = methods->new(width / 2, height / 2, sizeof(struct dct_elem));
     assert(dct_array != NULL);
     A2_with_methods dct = malloc(sizeof(*dct));
     assert(dct != NULL);
     dct->a2 = dct_array;
     dct->methods = methods;
     
-    printf("COMP40 Compressed image format 2\n%u %u", 816, 458);
-    printf("\n");
-    map(cv_array, CV_to_DCT, dct);
+    /* Codewords bypass stdio, so nothing may be left in its buffer */
+    fflush(stdout);
+    Codewords_T out = Codewords_new_writer(STDOUT_FILENO);
+    Header header = { 2, width, height, 2, Format2_quant, 0 };
+    write_header(out, &header);
+    cv_methods->map_blocks(cv_array, CV_to_DCT, dct);
     //map(dct_array, print_float, NULL);
-    map(dct_array, pack_and_print, methods);
-    // Pnm_ppmwrite(stdout, image);
-    Pnm_ppmfree(&image);
-    methods->free(&cv_array);
+    methods->map_rows(dct_array, pack_and_print, out);
+    Codewords_free(&out);
+    Ppmrows_free(&ppm);
+    cv_methods->free(&cv_array);
     methods->free(&dct_array);
     free(dct);
 }
-/* RGB_to_CV
- * Input: Two ints to represent col and row
- *        A pointer to a A2Methouds_Uarray2
- *        A pointer to element in the current index
- *        A pointer to a Pnm_ppm object as closure
- * Does:  It is an apply function that changes the pixels
- *        currently stored as RGB values to component video 
- *        representation and stores it in cv_array for 
- *        every pixel index
- * Returns: Nothing
+
+/* cv_array_methods
+ * Input: Whether the component video array should be blocked, and its
+ *        width and height
+ * Does:  Picks the methods for it; an empty image cannot be blocked
+ * Returns: The methods
  */
-void RGB_to_CV(int i, int j, A2Methods_UArray2 cv_array,
-               A2Methods_Object *elem, void *cl) 
+A2Methods_T cv_array_methods(int blocked, unsigned width, unsigned height)
 {
-    (void) cv_array;
-    assert(elem != NULL && cl != NULL);
-    
-    /* Expects a pointer to a Pnm_ppm as closure */
-    Pnm_ppm image = cl;
-
-    /* Assert correct pointer assigned */
-    assert(sizeof(*image) == sizeof(struct  Pnm_ppm));
-    
-    /* Assign rgb_pix to contain pixel values at location i, j */
-    Pnm_rgb rgb_pix = image->methods->at(image->pixels, i, j);
-
-    /* Declare new struct that stores floats */
-    Pixel_float float_pix = malloc(sizeof(*float_pix));
-    assert(float_pix != NULL);
-
-    RGB_to_float(rgb_pix, float_pix, image->denominator);
-    
-    /* Set new struct pointer to current elem in array */
-    Component_vid pixels = elem;
-    pixels->y = 0.299 * float_pix->red + 0.587 * float_pix->green + 0.114 * float_pix->blue;
-    pixels->pb = -0.168736 * float_pix->red - 0.331264 * float_pix->green + 0.5 * float_pix->blue;
-    pixels->pr = 0.5 * float_pix->red - 0.418688 * float_pix->green - 0.081312 * float_pix->blue;
-
-    free(float_pix);
+    if (blocked && width > 0 && height > 0) {
+        return uarray2_methods_blocked;
+    }
+    return uarray2_methods_flat;
 }
 
-void RGB_to_float(Pnm_rgb rgb, Pixel_float pix, float denom) 
-{
-    float r, g, b;
-
-    r = rgb->red;
-    g = rgb->green;
-    b = rgb->blue;
-    
-    r = r / denom;
-    g = g / denom;
-    b = b / denom;
-
-    pix->red = r;
-    pix->green = g;
-    pix->blue = b;
+/*
+ * Function: compress40_stream
+ * Purpose: Compresses a PPM image one 2-pixel-tall strip at a time. Two
+ *          source rows are read, turned into a row of DCT blocks by the
+ *          vector kernel in dct40.c and printed before the next strip is
+ *          read, so memory is O(width) however tall the image is. Output
+ *          is byte-for-byte the same as compress40.
+ * Parameters: Takes a FILE pointer for input
+ * Returns: Void
+ * Expectations: Asserts that each strip buffer is allocated; raises
+ *               Pnm_Badformat if the input is not a PPM image
+ */
+void compress40_stream(FILE *input) {
+    /* Codewords bypass stdio, so nothing may be left in its buffer */
+    fflush(stdout);
+    compress40_stream_fd(input, STDOUT_FILENO);
 }
-void CV_to_DCT(int i, int j, A2Methods_UArray2 cv_array,
-               A2Methods_Object *elem, void *cl)
-{
-    (void) elem;
-    A2_with_methods DCT = cl;
-    A2Methods_UArray2 dct_array = DCT->a2;
-    A2Methods_T methods = DCT->methods;
 
-    if (i % 2 == 0 && j % 2 == 0){
-        float pb_sum = 0, pr_sum = 0;
-        float y1, y2, y3, y4;
-
-        Component_vid cv_elem;
-        
-        cv_elem = methods->at(cv_array, i, j);
-        pb_sum += cv_elem->pb;
-        pr_sum += cv_elem->pr;
-        y1 = cv_elem->y;
-
-        cv_elem = methods->at(cv_array, i+1, j);
-        pb_sum += cv_elem->pb;
-        pr_sum += cv_elem->pr;
-        y2 = cv_elem->y;
-
-        cv_elem = methods->at(cv_array, i, j+1);
-        pb_sum += cv_elem->pb;
-        pr_sum += cv_elem->pr;
-        y3 = cv_elem->y;
+/*
+ * Function: compress40_stream_fd
+ * Purpose: Does the work of compress40_stream, writing the compressed
+ *          image to any file descriptor through a Codewords_T
+ * Parameters: Takes a FILE pointer for input and an open descriptor
+ *             for output
+ * Returns: Void
+ * Expectations: Same as compress40_stream; fd is open for writing
+ */
+void compress40_stream_fd(FILE *input, int fd) {
+    Stream_buffers buffers = stream_buffers_new();
+    target_met = compress_stream(input, fd, buffers);
+    stream_buffers_free(&buffers);
+}
 
-        cv_elem = methods->at(cv_array, i+1, j+1);
-        pb_sum += cv_elem->pb;
-        pr_sum += cv_elem->pr;
-        y4 = cv_elem->y;
+/*
+ * Function: compress_stream
+ * Purpose: Does the work of compress40_stream_fd in buffers that may be
+ *          left over from another image, growing them if they are too
+ *          small. Formats 4, 5 and 6 have buffers of their own and do not
+ *          use them.
+ * Parameters: Takes a FILE pointer for input, an open descriptor for
+ *             output and the buffers
+ * Returns: 0 if the image is in format 5 and does not meet its target,
+ *          otherwise 1
+ * Expectations: Same as compress40_stream_fd
+ */
+int compress_stream(FILE *input, int fd, Stream_buffers buffers) {
+    if (block_size != 2) {
+        compress_transform(input, fd);
+        return 1;
+    }
+    if (rate_bytes != 0 || rate_rms != 0) {
+        return compress_rate(input, fd);
+    }
+    if (tile_size != 0) {
+        compress_tiled(input, fd, 0);
+        return 1;
+    }
 
-        dct_elem element = methods->at(dct_array, i / 2, j / 2);
-        element->average_pb = pb_sum / 4.0;
-        element->average_pr = pr_sum / 4.0;
-        element->a = (y4 + y3 + y2 + y1) / 4.0;
-        element->b = (y4 + y3 - y2 - y1)/ 4.0;
-        element->c = (y4 - y3 + y2 - y1) / 4.0;
-        element->d = (y4 - y3 - y2 + y1) / 4.0;
+    Ppmrows_T rows = Ppmrows_new(input);
+
+    unsigned src_width = Ppmrows_width(rows);
+    float denom = Ppmrows_denominator(rows);
+
+    /* An odd last row or column has no 2x2 block and is trimmed */
+    unsigned width = src_width - src_width % 2;
+    unsigned height = Ppmrows_height(rows) - Ppmrows_height(rows) % 2;
+
+    stream_buffers_fit(buffers, 2 * (size_t)src_width, width, 0);
+    struct Pnm_rgb *rgb_top = buffers->rgb;
+    struct Pnm_rgb *rgb_bottom = rgb_top + src_width;
+    Fixed40_T fixed = fixed_point ? stream_buffers_fixed(buffers, denom)
+                                  : NULL;
+    uint32_t *words = buffers->words;
+
+    Codewords_T out = Codewords_new_writer(fd);
+    Header header = { entropy_coded ? 3 : 2, width, height, 2,
+                      Format2_quant, 0 };
+    write_header(out, &header);
+    Entropy40_T coder = entropy_coded ? Entropy40_new(width / 2, height / 2)
+                                      : NULL;
+
+    for (unsigned j = 0; j < height; j += 2) {
+        Ppmrows_read(rows, rgb_top);
+        Ppmrows_read(rows, rgb_bottom);
+        if (fixed != NULL) {
+            compress_strip_fixed(rgb_top, rgb_bottom, width, fixed,
+                                 buffers->strip, words);
+        } else {
+            compress_strip(rgb_top, rgb_bottom, width, denom,
+                           buffers->strip, words);
+        }
+        put_codewords(out, coder, words, width / 2);
     }
+
+    finish_codewords(&out, &coder);
+    Ppmrows_free(&rows);
+    return 1;
 }
-void pack_and_print(int i, int j, A2Methods_UArray2 dct_array, A2Methods_Object *elem, void *cl)
+
+/*
+ * Function: compress_strip
+ * Purpose: Turns one 2-pixel-tall strip into a row of codewords. Every
+ *          compressor that works a strip at a time goes through here,
+ *          which is what keeps their output identical.
+ * Parameters: The top and bottom source rows, the trimmed width, the
+ *             source denominator, scratch buffers made for this width
+ *             and room for width / 2 codewords
+ * Returns: Void
+ */
+void compress_strip(const struct Pnm_rgb *top, const struct Pnm_rgb *bottom,
+                    unsigned width, float denom, Strip_buffers buffers,
+                    uint32_t *words)
 {
-    (void) dct_array;
-    (void) cl;
-    (void) i;
-    (void) j;
-    assert(dct_array != NULL);
-    assert(elem != NULL);
-    assert(cl != NULL);
-    dct_elem element = elem;
-    unsigned a = quantize_Y(element->a);
-    int b = quantize_coef(element->b);
-    int c = quantize_coef(element->c);
-    int d = quantize_coef(element->d);
-
-    unsigned pb = Arith40_index_of_chroma(element->average_pb);
-    unsigned pr = Arith40_index_of_chroma(element->average_pr);
-
-    int32_t word = 0;
-    word = Bitpack_newu(word, 4, 0, pr);
-    word = Bitpack_newu(word, 4, 4, pb);
-    word = Bitpack_news(word, 5, 8, d);
-    word = Bitpack_news(word, 5, 13, c);
-    word = Bitpack_news(word, 5, 18, b);
-    word = Bitpack_newu(word, 9, 23, a);
-
-    char c0, c1, c2, c3;
-    c0 = Bitpack_getu(word, 8, 0);
-    c1 = Bitpack_getu(word, 8, 8);
-    c2 = Bitpack_getu(word, 8, 16);
-    c3 = Bitpack_getu(word, 8, 24);
-    putchar(c3);
-    putchar(c2);
-    putchar(c1);
-    putchar(c0);
-    //printf("\n");
+    unsigned blocks = width / 2;
+    Dct40_planes planes = buffers->planes;
+    Dct40_forward(top, bottom, blocks, denom, planes);
+
+    /* The Pr plane follows the Pb plane, so one call quantizes both */
+    Chroma40_index_batch(planes.pb, buffers->index, width);
+
+    for (unsigned i = 0; i < blocks; i++) {
+        struct dct_elem element = {
+            planes.pb[i], planes.pr[i],
+            planes.a[i], planes.b[i], planes.c[i], planes.d[i]
+        };
+        words[i] = pack_codeword(&element, buffers->index[i],
+                                 buffers->index[blocks + i]);
+    }
 }
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void CV_to_RGB (int i, int j, A2Methods_UArray2 cv_array,
-               A2Methods_Object *elem, void *cl) 
-{
-    (void) cv_array;
-    Pnm_ppm image = cl;
-    Component_vid component_pixels = elem;
 
-    Pixel_float float_pixels = malloc(sizeof(*float_pixels));
-    assert(float_pixels != NULL);
-
-    float_pixels->red = (float)1.0 * component_pixels->y + (float)0.0 * component_pixels->pb + (float)1.402 * component_pixels->pr;
-    float_pixels->green = (float)1.0 * component_pixels->y - (float)0.344136 * component_pixels->pb - (float)0.714136 * component_pixels->pr;
-    float_pixels->blue = (float)1.0 * component_pixels->y + (float)1.772 * component_pixels->pb + (float)0.0 * component_pixels->pr;
+/*
+ * Function: compress_strip_fixed
+ * Purpose: compress_strip in fixed-point arithmetic. The codewords match
+ *          compress_strip's except for a field whose float value sits
+ *          right at a rounding boundary, which may come out one higher
+ *          or lower.
+ * Parameters: The top and bottom source rows, the trimmed width, the
+ *             Fixed40 tables for the source denominator, scratch buffers
+ *             made for this width and room for width / 2 codewords
+ * Returns: Void
+ */
+void compress_strip_fixed(const struct Pnm_rgb *top,
+                          const struct Pnm_rgb *bottom, unsigned width,
+                          Fixed40_T fixed, Strip_buffers buffers,
+                          uint32_t *words)
+{
+    Fixed40_fields fields = buffers->fields;
+    Fixed40_forward(fixed, top, bottom, width / 2, fields);
 
-    if (float_pixels->red > 1.0) {
-        float_pixels->red = 1.0;
-    }
-    if (float_pixels->red < 0){
-        float_pixels->red = 0.0;
-    }
-    if (float_pixels->blue > 1.0) {
-        float_pixels->blue = 1.0;
-    }
-    if (float_pixels->blue < 0){
-        float_pixels->blue = 0.0;
+    for (unsigned i = 0; i < width / 2; i++) {
+        words[i] = pack_fields(fields.a[i], fields.b[i], fields.c[i],
+                               fields.d[i], fields.pb[i], fields.pr[i]);
     }
-    if (float_pixels->green > 1.0) {
-        float_pixels->green = 1.0;
-    }
-    if (float_pixels->green < 0){
-        float_pixels->green = 0.0;
+}
+
+/*
+ * Function: compress_transform
+ * Purpose: Compresses a PPM image into format 4, in block_size by
+ *          block_size blocks, one block row at a time. A partial block at
+ *          the right or bottom edge is filled out by repeating the last
+ *          column or row, so no pixel is trimmed and the header records
+ *          the image's own width and height.
+ * Parameters: Takes a FILE pointer for input and an open descriptor for
+ *             output
+ * Returns: Void
+ * Expectations: block_size is supported by Transform40; raises
+ *               Pnm_Badformat if the input is not a PPM image
+ */
+void compress_transform(FILE *input, int fd)
+{
+    Ppmrows_T rows = Ppmrows_new(input);
+
+    unsigned width = Ppmrows_width(rows);
+    unsigned height = Ppmrows_height(rows);
+    float denom = Ppmrows_denominator(rows);
+    unsigned n = block_size;
+
+    unsigned blocks = (width + n - 1) / n;
+    unsigned block_rows = (height + n - 1) / n;
+    size_t stride = (size_t)blocks * n;
+    size_t nwords = (size_t)blocks * Transform40_words(n);
+
+    struct Pnm_rgb *rgb = malloc(n * stride * sizeof(*rgb) + 1);
+    assert(rgb != NULL);
+    uint32_t *words = malloc(nwords * sizeof(*words) + 1);
+    assert(words != NULL);
+    Transform40_T transform = Transform40_new(n, blocks);
+
+    Codewords_T out = Codewords_new_writer(fd);
+    Header header = { 4, width, height, n, Format2_quant, 0 };
+    write_header(out, &header);
+
+    for (unsigned r = 0; r < block_rows; r++) {
+        for (unsigned i = 0; i < n; i++) {
+            struct Pnm_rgb *row = rgb + i * stride;
+            if (r * n + i >= height) {
+                memcpy(row, row - stride, stride * sizeof(*row));
+                continue;
+            }
+            Ppmrows_read(rows, row);
+            for (size_t col = width; col < stride; col++) {
+                row[col] = row[width - 1];
+            }
+        }
+        Transform40_forward(transform, rgb, stride, blocks, denom, words);
+        Codewords_put_row(out, words, nwords);
     }
 
-    Pnm_rgb rgb_pixels = image->methods->at(image->pixels, i, j);
-    float_to_RGB(rgb_pixels, float_pixels);
+    Codewords_free(&out);
+    Transform40_free(&transform);
+    free(rgb);
+    free(words);
+    Ppmrows_free(&rows);
+}
 
-    free(float_pixels);
+/* rate_strip
+ * Input: The raster of an image, the block row to convert, its width in
+ *        blocks, room for two rows of component video and for its blocks
+ * Does:  Turns the two rows of the block row into component video and
+ *        then into blocks
+ * Returns: Nothing
+ */
+void rate_strip(const struct Raster *image, unsigned j, unsigned blocks,
+                struct Component_vid *top, struct Component_vid *bottom,
+                struct dct_elem *dct)
+{
+    const unsigned char *raw = image->samples + 2 * (size_t)j *
+                               image->row_bytes;
+    Dct40_raw_to_CV(raw, image->sample_bytes, top, 2 * blocks,
+                    image->denom);
+    Dct40_raw_to_CV(raw + image->row_bytes, image->sample_bytes, bottom,
+                    2 * blocks, image->denom);
+    Dct40_CV_to_DCT(top, bottom, blocks, dct);
 }
-void float_to_RGB(Pnm_rgb rgb, Pixel_float pix) 
+
+/*
+ * Function: compress_rate
+ * Purpose: Compresses a PPM image into format 5 with the quantization
+ *          that meets rate_bytes or rate_rms. A first pass over the image
+ *          shows every block to a Rate40_T, which picks the scales, and a
+ *          second quantizes the blocks with them and entropy-codes the
+ *          codewords as format 3 does.
+ * Parameters: Takes a FILE pointer for input and an open descriptor for
+ *             output
+ * Returns: Whether the target was met, as far as the Rate40_T can tell;
+ *          if it was not, the smallest file or the one with the least
+ *          error has been written
+ * Expectations: One of rate_bytes and rate_rms is nonzero; raises
+ *               Pnm_Badformat if the input is not a PPM image
+ */
+int compress_rate(FILE *input, int fd)
 {
+    /* Both passes read the file's own samples, mapped when it can be */
+    Ppmrows_T ppm = Ppmrows_new(input);
+    struct Raster image;
+    image.samples = Ppmrows_raster(ppm);
+    image.row_bytes = Ppmrows_row_bytes(ppm);
+    image.sample_bytes = Ppmrows_sample_bytes(ppm);
+    image.denom = Ppmrows_denominator(ppm);
+
+    /* An odd last row or column has no 2x2 block and is trimmed */
+    unsigned width = Ppmrows_width(ppm) - Ppmrows_width(ppm) % 2;
+    unsigned height = Ppmrows_height(ppm) - Ppmrows_height(ppm) % 2;
+    unsigned blocks = width / 2;
+
+    struct Component_vid *top = malloc(width * sizeof(*top) + 1);
+    assert(top != NULL);
+    struct Component_vid *bottom = malloc(width * sizeof(*bottom) + 1);
+    assert(bottom != NULL);
+    struct dct_elem *dct = malloc(blocks * sizeof(*dct) + 1);
+    assert(dct != NULL);
+    uint32_t *words = malloc(blocks * sizeof(*words) + 1);
+    assert(words != NULL);
 
-    unsigned int r, g, b;
-    r = (pix->red * DENOM);
-    g = (pix->green * DENOM);
-    b = (pix->blue * DENOM);
+    Rate40_T rate = Rate40_new(blocks, height / 2);
+    for (unsigned j = 0; j < height / 2; j++) {
+        rate_strip(&image, j, blocks, top, bottom, dct);
+        Rate40_put(rate, top, bottom, dct);
+    }
 
-    
-    if (pix->red * DENOM - (float)r >= 0.5) {
-        r++;
+    /* The budget is for the whole file, header included, and no header
+     * is longer than the one with the widest scales
+     */
+    Header header = { 5, width, height, 2, { 511, 511 }, 0 };
+    Rate40_scales scales;
+    if (rate_bytes != 0) {
+        size_t header_bytes = snprintf(NULL, 0,
+                                       "COMP40 Compressed image format "
+                                       "5\n%u %u %u %u\n", width, height,
+                                       header.quant.y_scale,
+                                       header.quant.coef_scale);
+        scales = Rate40_for_bytes(rate, rate_bytes > header_bytes
+                                        ? rate_bytes - header_bytes : 0);
+    } else {
+        scales = Rate40_for_rms(rate, rate_rms);
     }
-    if (pix->green * DENOM - (float)g >= 0.5) {
-        g++;
+    Rate40_free(&rate);
+    header.quant.y_scale = scales.y;
+    header.quant.coef_scale = scales.coef;
+
+    Codewords_T out = Codewords_new_writer(fd);
+    write_header(out, &header);
+    Entropy40_T coder = Entropy40_new(blocks, height / 2);
+    for (unsigned j = 0; j < height / 2; j++) {
+        rate_strip(&image, j, blocks, top, bottom, dct);
+        for (unsigned i = 0; i < blocks; i++) {
+            words[i] = pack_fields(Rate40_quantize_y(dct[i].a, scales.y),
+                                   Rate40_quantize_coef(dct[i].b,
+                                                        scales.coef),
+                                   Rate40_quantize_coef(dct[i].c,
+                                                        scales.coef),
+                                   Rate40_quantize_coef(dct[i].d,
+                                                        scales.coef),
+                                   Chroma40_index(dct[i].average_pb),
+                                   Chroma40_index(dct[i].average_pr));
+        }
+        put_codewords(out, coder, words, blocks);
     }
-    if (pix->blue * DENOM - (float)b >= 0.5) {
-        b++;
-    } 
-    /*
-    FILE *fp = fopen("test.txt", "a");
-    assert(fp);
-    fprintf(fp, "%u %u %u\n", r,g,b);
-    fclose(fp); */
+    finish_codewords(&out, &coder);
 
-    rgb->red = r;
-    rgb->green = g;
-    rgb->blue = b;
+    free(top);
+    free(bottom);
+    free(dct);
+    free(words);
+    Ppmrows_free(&ppm);
+    return scales.met;
 }
+
 /*
- * Function: decompress40
- * Purpose: Takes in a FILE pointer and decompresses the data by reversing
- *          and counteracting the operations used to compress the file. 
- * Parameters: Takes a FILE pointer for input
+ * Function: compress_tiled
+ * Purpose: Compresses a PPM image into format 6, tile_size by tile_size
+ *          tiles that are each compressed on their own into format 2, or
+ *          format 3 if entropy_coded is set. The source is read a tile
+ *          row at a time and every tile is kept in memory until the
+ *          last, since the index that comes first needs all their sizes.
+ * Parameters: Takes a FILE pointer for input, an open descriptor for
+ *             output and the number of worker threads, or 0 to compress
+ *             every tile on the calling thread
  * Returns: Void
- * Expectations: Asserts that the map and methods pointers are not NULL.
- *               Also, after a new cv_array, dct_array, and rgb_array are made,
- *               and dct and pixmap is malloced, asserts that the pointers to 
- *               those objects are not NULL.
+ * Expectations: tile_size is even and not 0; raises Pnm_Badformat if
+ *               the input is not a PPM image
  */
-void decompress40(FILE *input) {
+void compress_tiled(FILE *input, int fd, unsigned threads)
+{
+    Ppmrows_T ppm = Ppmrows_new(input);
+
+    struct Tile_job job;
+    job.stride = Ppmrows_width(ppm);
+    job.x0 = 0;
+    job.denom = Ppmrows_denominator(ppm);
+    job.fixed = fixed_point ? Fixed40_new(job.denom) : NULL;
+    job.maxval = 0;
+    job.input = NULL;
+
+    /* An odd last row or column has no 2x2 block and is trimmed */
+    unsigned width = Ppmrows_width(ppm) - Ppmrows_width(ppm) % 2;
+    unsigned height = Ppmrows_height(ppm) - Ppmrows_height(ppm) % 2;
+    job.tiles = Tiles40_new(width, height, tile_size);
+    unsigned cols = Tiles40_cols(job.tiles);
+    unsigned tile_rows = Tiles40_rows(job.tiles);
+    job.kept = malloc((size_t)cols * tile_rows * sizeof(*job.kept) + 1);
+    assert(job.kept != NULL);
+    job.nkept = 0;
+
+    unsigned rows = height < tile_size ? height : tile_size;
+    job.rgb = malloc((size_t)rows * job.stride * sizeof(*job.rgb) + 1);
+    assert(job.rgb != NULL);
+
+    unsigned nslots = threads > 0 ? 2 * threads : 1;
+    void **slots = tile_slots_new(nslots, job.tiles, tile_size);
+    Stripes_T stripes = threads > 0 ? Stripes_new(threads, nslots, slots,
+                                                  compress_tile, &job)
+                                    : NULL;
+
+    for (job.row = 0; job.row < tile_rows; job.row++) {
+        unsigned x, y, w, h;
+        Tiles40_rect(job.tiles, 0, job.row, &x, &y, &w, &h);
+        for (unsigned i = 0; i < h; i++) {
+            Ppmrows_read(ppm, job.rgb + i * job.stride);
+        }
+        work_tile_row(stripes, slots, 0, cols, compress_tile, &job,
+                      keep_tile);
+    }
 
-    A2Methods_T methods = uarray2_methods_plain;
-    assert(methods != NULL);
+    Codewords_T out = Codewords_new_writer(fd);
+    Header header = { 6, width, height, 2, Format2_quant, tile_size };
+    write_header(out, &header);
+    Tiles40_write(job.tiles, out);
+    for (size_t k = 0; k < job.nkept; k++) {
+        uint64_t offset;
+        size_t size;
+        Tiles40_locate(job.tiles, k % cols, k / cols, &offset, &size);
+        Codewords_write(out, job.kept[k], size);
+        free(job.kept[k]);
+    }
+    Codewords_free(&out);
 
-    A2Methods_mapfun *map = methods->map_row_major;
-    assert(map != NULL);
+    if (stripes != NULL) {
+        Stripes_free(&stripes);
+    }
+    tile_slots_free(slots, nslots);
+    if (job.fixed != NULL) {
+        Fixed40_free(&job.fixed);
+    }
+    Tiles40_free(&job.tiles);
+    free(job.kept);
+    free(job.rgb);
+    Ppmrows_free(&ppm);
+}
 
-    unsigned height, width;
-    int read = fscanf(input, "COMP40 Compressed image format 2\n%u %u", &width, &height);
-    assert(read == 2);
-    int c = getc(input);
-    assert(c = '\n');
+/* compress_tile
+ * Input: A Tile_slot naming a column of the current tile row, its
+ *        sequence number, and the Tile_job of compress_tiled as closure
+ * Does:  Compresses the tile into a complete format 2 or 3 image in the
+ *        slot's bytes; may run on a worker thread
+ * Returns: Nothing
+ */
+void compress_tile(void *slot, unsigned seq, void *cl)
+{
+    (void) seq;
+    Tile_slot tile = slot;
+    Tile_job job = cl;
+
+    unsigned x, y, w, h;
+    Tiles40_rect(job->tiles, tile->col, job->row, &x, &y, &w, &h);
+    Strip_buffers buffers = w == tile->width ? tile->full : tile->edge;
+
+    Codewords_T out = Codewords_new_buffer();
+    Header header = { entropy_coded ? 3 : 2, w, h, 2, Format2_quant, 0 };
+    write_header(out, &header);
+    Entropy40_T coder = entropy_coded ? Entropy40_new(w / 2, h / 2) : NULL;
+
+    for (unsigned j = 0; j < h; j += 2) {
+        const struct Pnm_rgb *top = job->rgb + j * job->stride + x;
+        const struct Pnm_rgb *bottom = top + job->stride;
+        if (job->fixed != NULL) {
+            compress_strip_fixed(top, bottom, w, job->fixed, buffers,
+                                 tile->words);
+        } else {
+            compress_strip(top, bottom, w, job->denom, buffers,
+                           tile->words);
+        }
+        put_codewords(out, coder, tile->words, w / 2);
+    }
 
-    A2Methods_UArray2 rgb_array = methods->new(width, height, sizeof(struct Pnm_rgb));
-    assert(rgb_array != NULL);
-    Pnm_ppm pixmap = malloc(sizeof(*pixmap));
-    assert(pixmap != NULL);
-    pixmap->width = width;
-    pixmap->height = height;
-    pixmap->denominator = DENOM;
-    pixmap->methods = methods;
-    pixmap->pixels = rgb_array;
+    if (coder != NULL) {
+        Entropy40_write(coder, out);
+        Entropy40_free(&coder);
+    }
+    tile->bytes = Codewords_take(&out, &tile->size);
+}
 
-    A2Methods_UArray2 dct_array = methods->new(width / 2, height / 2, sizeof(struct dct_elem));
-    assert(dct_array != NULL);
-    A2Methods_UArray2 cv_array = methods->new(width, height, sizeof(struct Component_vid));
-    assert(cv_array != NULL);
+/* keep_tile
+ * Input: A Tile_slot that compress_tile has filled and the Tile_job
+ * Does:  Adds the tile to the index and moves its bytes to job->kept
+ * Returns: Nothing
+ */
+void keep_tile(Tile_slot slot, Tile_job job)
+{
+    Tiles40_add(job->tiles, slot->size);
+    job->kept[job->nkept++] = slot->bytes;
+    slot->bytes = NULL;
+}
 
-    map(dct_array, Read_from_disk, input);
-    //map(dct_array, print_float, NULL);
+/* tile_slots_new
+ * Input: The number of slots, the tiles of the image and their side
+ * Does:  Allocates the slots of a ring of tiles, with buffers for the
+ *        full tile width and for the width of the last column
+ * Returns: An array of nslots pointers to struct Tile_slot
+ */
+void **tile_slots_new(unsigned nslots, Tiles40_T tiles, unsigned tile)
+{
+    unsigned edge = 0;
+    if (Tiles40_cols(tiles) > 0 && Tiles40_rows(tiles) > 0) {
+        unsigned x, y, h;
+        Tiles40_rect(tiles, Tiles40_cols(tiles) - 1, 0, &x, &y, &edge, &h);
+    }
 
-    A2_with_methods dct = malloc(sizeof(*dct));
-    assert(dct != NULL);
-    dct->a2 = dct_array;
-    dct->methods = methods;
+    void **slots = malloc(nslots * sizeof(*slots));
+    assert(slots != NULL);
+    for (unsigned k = 0; k < nslots; k++) {
+        Tile_slot slot = malloc(sizeof(*slot));
+        assert(slot != NULL);
+        slot->col = 0;
+        slot->words = malloc(tile / 2 * sizeof(*slot->words));
+        assert(slot->words != NULL);
+        slot->width = tile;
+        slot->full = strip_buffers_new(tile);
+        slot->edge = edge != tile ? strip_buffers_new(edge) : NULL;
+        slot->bytes = NULL;
+        slot->size = 0;
+        slots[k] = slot;
+    }
+    return slots;
+}
 
-    map(cv_array, DCT_to_CV, dct);
+/* tile_slots_free
+ * Input: Slots made by tile_slots_new and their number
+ * Does:  Frees every slot, along with any bytes one still holds
+ * Returns: Nothing
+ */
+void tile_slots_free(void **slots, unsigned nslots)
+{
+    for (unsigned k = 0; k < nslots; k++) {
+        Tile_slot slot = slots[k];
+        free(slot->words);
+        strip_buffers_free(&slot->full);
+        if (slot->edge != NULL) {
+            strip_buffers_free(&slot->edge);
+        }
+        free(slot->bytes);
+        free(slot);
+    }
+    free(slots);
+}
 
-    map(cv_array, CV_to_RGB, pixmap);
+/*
+ * Function: work_tile_row
+ * Purpose: Runs 'work' on columns [first, end) of the current tile row
+ *          of a Tile_job, on the workers of a Stripes_T if there is one
+ *          and otherwise in the only slot, and hands every slot it is
+ *          done with to 'done', in column order. When job->input is set
+ *          the bytes of each tile are loaded into its slot first, on the
+ *          calling thread.
+ * Parameters: The Stripes_T or NULL, its slots, the columns, the work
+ *             function, the Tile_job it was made with, and 'done' or
+ *             NULL
+ * Returns: Nothing
+ * Expectations: No tile is posted on entry, and none is on return
+ */
+void work_tile_row(Stripes_T stripes, void **slots, unsigned first,
+                   unsigned end, Stripes_work *work, Tile_job job,
+                   void (*done)(Tile_slot slot, Tile_job job))
+{
+    Tile_slot slot;
+    for (unsigned col = first; col < end; col++) {
+        if (stripes == NULL) {
+            slot = slots[0];
+        } else {
+            /* Make room by finishing with the oldest tiles */
+            while ((slot = Stripes_claim(stripes)) == NULL) {
+                slot = Stripes_oldest(stripes);
+                if (done != NULL) {
+                    done(slot, job);
+                }
+                Stripes_release(stripes);
+            }
+        }
+
+        slot->col = col;
+        if (job->input != NULL) {
+            slot->bytes = Tiles40_load(job->tiles, job->input, col,
+                                       job->row, &slot->size);
+        }
+        if (stripes == NULL) {
+            work(slot, col - first, job);
+            if (done != NULL) {
+                done(slot, job);
+            }
+        } else {
+            Stripes_post(stripes);
+        }
+    }
 
-    Pnm_ppmwrite(stdout, pixmap);
+    while (stripes != NULL && (slot = Stripes_oldest(stripes)) != NULL) {
+        if (done != NULL) {
+            done(slot, job);
+        }
+        Stripes_release(stripes);
+    }
+}
 
-    Pnm_ppmfree(&pixmap);
+/* strip_buffers_new
+ * Input: The trimmed width of the image
+ * Does:  Allocates the scratch space compress_strip needs for a strip
+ * Returns: The new buffers
+ */
+Strip_buffers strip_buffers_new(unsigned width)
+{
+    Strip_buffers buffers = malloc(sizeof(*buffers));
+    assert(buffers != NULL);
+    buffers->planes = Dct40_planes_new(width / 2);
+    buffers->fields = Fixed40_fields_new(width / 2);
+    buffers->index = malloc(width * sizeof(*buffers->index) + 1);
+    assert(buffers->index != NULL);
+    return buffers;
+}
 
-    methods->free(&cv_array);
-    methods->free(&dct_array);
+/* strip_buffers_free
+ * Input: A pointer to buffers made by strip_buffers_new
+ * Does:  Frees them and sets the pointer to NULL
+ * Returns: Nothing
+ */
+void strip_buffers_free(Strip_buffers *buffersp)
+{
+    assert(buffersp != NULL && *buffersp != NULL);
+    Dct40_planes_free(&(*buffersp)->planes);
+    Fixed40_fields_free(&(*buffersp)->fields);
+    free((*buffersp)->index);
+    free(*buffersp);
+    *buffersp = NULL;
 }
+
 /*
- * Function: Read_from_disk
- * Purpose: apply function that is use to map through the disk and read data 
- * Parameters: integer value for index i and j, pointer to A2Methods_UArray2 
- *             image object, pointer to the element, and a void pointer for the
- *             closure
- *             
+ * Function: compress40_parallel
+ * Purpose: Compresses a PPM image on 'threads' worker threads. The main
+ *          thread reads the image a stripe of block rows at a time into
+ *          a Stripes_T ring of 2 * threads slots, workers compress the
+ *          stripes with compress_strip, and the main thread writes the
+ *          finished stripes in order. Output is byte-for-byte the same
+ *          as compress40 for any number of threads.
+ * Parameters: Takes a FILE pointer for input, an open descriptor for
+ *             output and the number of worker threads
  * Returns: Void
- * Expectations: Asserts that the read is of size 6.
+ * Expectations: threads is at least 1; raises Pnm_Badformat if the
+ *               input is not a PPM image
  */
-void Read_from_disk(int i, int j, A2Methods_UArray2 image, 
-                  A2Methods_Object *elem, void *cl) 
-{
-    (void) i;
-    (void) j;
-    (void) image;
-    
-    FILE *input = cl;
-    dct_elem element = elem;
- //   uint32_t word = 0;
-    char c0 = fgetc(input);
-    char c1 = fgetc(input);
-    char c2 = fgetc(input);
-    char c3 = fgetc(input);
+void compress40_parallel(FILE *input, int fd, unsigned threads) {
+    assert(threads >= 1);
 
+    /* Formats 4 and 5 have no parallel compressor yet */
+    if (block_size != 2 || rate_bytes != 0 || rate_rms != 0) {
+        compress40_stream_fd(input, fd);
+        return;
+    }
+    if (tile_size != 0) {
+        compress_tiled(input, fd, threads);
+        return;
+    }
 
-    uint32_t lit_word = 0;
-    lit_word = Bitpack_news(lit_word, 8, 0, c3);
-    lit_word = Bitpack_news(lit_word, 8, 8, c2);
-    lit_word = Bitpack_news(lit_word, 8, 16, c1);
-    lit_word = Bitpack_news(lit_word, 8, 24, c0);
+    Ppmrows_T rows = Ppmrows_new(input);
+
+    struct Stripe_job job;
+    job.src_width = Ppmrows_width(rows);
+    job.denom = Ppmrows_denominator(rows);
+    job.fixed = fixed_point ? Fixed40_new(job.denom) : NULL;
+    job.in = NULL;
+    job.ppm = NULL;
+    job.quant = Format2_quant;
+
+    /* An odd last row or column has no 2x2 block and is trimmed */
+    job.width = job.src_width - job.src_width % 2;
+    unsigned height = Ppmrows_height(rows) - Ppmrows_height(rows) % 2;
+    unsigned blocks = job.width / 2;
+
+    /* Stripes hold about STRIPE_BYTES of source pixels each */
+    size_t strip_bytes = 2 * (size_t)job.src_width * sizeof(struct Pnm_rgb);
+    job.stripe_rows = STRIPE_BYTES / strip_bytes;
+    if (job.stripe_rows == 0) {
+        job.stripe_rows = 1;
+    }
+    unsigned block_rows = height / 2;
+    unsigned count = (block_rows + job.stripe_rows - 1) / job.stripe_rows;
+
+    unsigned nslots = 2 * threads;
+    void **slots = stripe_slots_new(nslots,
+                                    2 * (size_t)job.stripe_rows * job.src_width,
+                                    (size_t)job.stripe_rows * blocks, 0,
+                                    job.width);
+    Stripes_T stripes = Stripes_new(threads, nslots, slots,
+                                    compress_stripe, &job);
+
+    Codewords_T out = Codewords_new_writer(fd);
+    Header header = { entropy_coded ? 3 : 2, job.width, height, 2,
+                      Format2_quant, 0 };
+    write_header(out, &header);
+    Entropy40_T coder = entropy_coded ? Entropy40_new(blocks, block_rows)
+                                      : NULL;
+
+    struct Stripe *stripe;
+    for (unsigned seq = 0; seq < count; seq++) {
+        /* Make room by writing out the oldest stripes */
+        while ((stripe = Stripes_claim(stripes)) == NULL) {
+            stripe = Stripes_oldest(stripes);
+            put_codewords(out, coder, stripe->words,
+                          (size_t)stripe->block_rows * blocks);
+            Stripes_release(stripes);
+        }
+
+        stripe->block_rows = block_rows - seq * job.stripe_rows;
+        if (stripe->block_rows > job.stripe_rows) {
+            stripe->block_rows = job.stripe_rows;
+        }
+        for (unsigned k = 0; k < 2 * stripe->block_rows; k++) {
+            Ppmrows_read(rows, stripe->rgb + (size_t)k * job.src_width);
+        }
+        Stripes_post(stripes);
+    }
+    Stripes_close(stripes);
 
-    //printf("%d\n", lit_word);
+    while ((stripe = Stripes_oldest(stripes)) != NULL) {
+        put_codewords(out, coder, stripe->words,
+                      (size_t)stripe->block_rows * blocks);
+        Stripes_release(stripes);
+    }
 
-    float a = get_Y(Bitpack_getu(lit_word, 9, 23));
-    //printf("%lu\n", Bitpack_getu(lit_word, 9, 23));
-    float b = get_coef(Bitpack_gets(lit_word, 5, 18));
-    float c = get_coef(Bitpack_gets(lit_word, 5, 13));
-    float d = get_coef(Bitpack_gets(lit_word, 5, 8));
+    finish_codewords(&out, &coder);
+    Stripes_free(&stripes);
+    stripe_slots_free(slots, nslots);
+    if (job.fixed != NULL) {
+        Fixed40_free(&job.fixed);
+    }
+    Ppmrows_free(&rows);
+}
 
-    float pb = Arith40_chroma_of_index(Bitpack_getu(lit_word, 4, 4));
-    float pr = Arith40_chroma_of_index(Bitpack_getu(lit_word, 4, 0));
+/* compress_stripe
+ * Input: A struct Stripe of source rows, its sequence number, and the
+ *        Stripe_job of compress40_parallel as closure
+ * Does:  Compresses every strip of the stripe into its words; runs on a
+ *        worker thread
+ * Returns: Nothing
+ */
+void compress_stripe(void *slot, unsigned seq, void *cl)
+{
+    (void) seq;
+    struct Stripe *stripe = slot;
+    Stripe_job job = cl;
+    size_t src_width = job->src_width;
+
+    for (unsigned r = 0; r < stripe->block_rows; r++) {
+        const struct Pnm_rgb *top = stripe->rgb + 2 * r * src_width;
+        const struct Pnm_rgb *bottom = top + src_width;
+        uint32_t *words = stripe->words + (size_t)r * (job->width / 2);
+        if (job->fixed != NULL) {
+            compress_strip_fixed(top, bottom, job->width, job->fixed,
+                                 stripe->buffers, words);
+        } else {
+            compress_strip(top, bottom, job->width, job->denom,
+                           stripe->buffers, words);
+        }
+    }
+}
 
-    element->a = a;
-    element->b = b;
-    element->c = c;
-    element->d = d;
-    element->average_pb = pb;
-    element->average_pr = pr;
+/* stripe_slots_new
+ * Input: The number of slots, the pixels, codewords and packed bytes
+ *        each slot holds, and the trimmed width for its Strip_buffers
+ * Does:  Allocates the slots of a Stripes_T ring
+ * Returns: An array of nslots pointers to struct Stripe
+ */
+void **stripe_slots_new(unsigned nslots, size_t pixels, size_t words,
+                        size_t raw_bytes, unsigned width)
+{
+    void **slots = malloc(nslots * sizeof(*slots));
+    assert(slots != NULL);
+
+    for (unsigned k = 0; k < nslots; k++) {
+        struct Stripe *stripe = malloc(sizeof(*stripe));
+        assert(stripe != NULL);
+        stripe->block_rows = 0;
+        stripe->rgb = malloc(pixels * sizeof(*stripe->rgb) + 1);
+        assert(stripe->rgb != NULL);
+        stripe->words = malloc(words * sizeof(*stripe->words) + 1);
+        assert(stripe->words != NULL);
+        stripe->raw = malloc(raw_bytes + 1);
+        assert(stripe->raw != NULL);
+        stripe->buffers = strip_buffers_new(width);
+        slots[k] = stripe;
+    }
+    return slots;
+}
 
+/* stripe_slots_free
+ * Input: Slots made by stripe_slots_new and their number
+ * Does:  Frees every slot and the array
+ * Returns: Nothing
+ */
+void stripe_slots_free(void **slots, unsigned nslots)
+{
+    for (unsigned k = 0; k < nslots; k++) {
+        struct Stripe *stripe = slots[k];
+        free(stripe->rgb);
+        free(stripe->words);
+        free(stripe->raw);
+        strip_buffers_free(&stripe->buffers);
+        free(stripe);
+    }
+    free(slots);
 }
 
-void DCT_to_CV(int i, int j, A2Methods_UArray2 cv_array,
-               A2Methods_Object *elem, void *cl)
+/*
+ * Function: compress40_batch
+ * Purpose: Compresses or decompresses every file of a list on 'threads'
+ *          worker threads, one file to a thread at a time. The files go
+ *          through a Stripes_T ring of 2 * threads slots, each with its
+ *          own Stream_buffers that stay allocated from one file to the
+ *          next, so a run of small images costs no more than their
+ *          codewords. A file that cannot be opened, or whose output
+ *          cannot be written, is marked failed and the rest go on.
+ * Parameters: The files, their number, the number of worker threads and
+ *             whether to decompress rather than compress
+ * Returns: Nothing
+ * Expectations: threads is at least 1; raises Pnm_Badformat, or fails a
+ *               checked runtime error, if an input is not a PPM image or
+ *               a compressed image as the single-file functions would
+ */
+void compress40_batch(Compress40_file *files, size_t count,
+                      unsigned threads, int decompress)
 {
-    (void) elem;
-    A2_with_methods DCT = cl;
-    A2Methods_UArray2 dct_array = DCT->a2;
-    A2Methods_T methods = DCT->methods;
+    assert(threads >= 1 && (files != NULL || count == 0));
+
+    unsigned nslots = 2 * threads;
+    void **slots = malloc(nslots * sizeof(*slots));
+    assert(slots != NULL);
+    for (unsigned k = 0; k < nslots; k++) {
+        Batch_slot slot = malloc(sizeof(*slot));
+        assert(slot != NULL);
+        slot->file = NULL;
+        slot->buffers = stream_buffers_new();
+        slots[k] = slot;
+    }
+    Stripes_T stripes = Stripes_new(threads, nslots, slots, batch_file,
+                                    &decompress);
+
+    for (size_t n = 0; n < count; n++) {
+        /* Files finish in any order, and nothing is written in between */
+        Batch_slot slot;
+        while ((slot = Stripes_claim(stripes)) == NULL) {
+            Stripes_oldest(stripes);
+            Stripes_release(stripes);
+        }
+        slot->file = &files[n];
+        Stripes_post(stripes);
+    }
+    Stripes_close(stripes);
+    while (Stripes_oldest(stripes) != NULL) {
+        Stripes_release(stripes);
+    }
 
-    if (i % 2 == 0 && j % 2 == 0){
-    
-        Component_vid cv_elem;
-        dct_elem dct_element = methods->at(dct_array, i / 2, j / 2);
+    Stripes_free(&stripes);
+    for (unsigned k = 0; k < nslots; k++) {
+        Batch_slot slot = slots[k];
+        stream_buffers_free(&slot->buffers);
+        free(slot);
+    }
+    free(slots);
+}
 
-        float a = dct_element->a;
-        float b = dct_element->b;
-        float c = dct_element->c;
-        float d = dct_element->d;
-        
-        cv_elem = methods->at(cv_array, i, j);
-        cv_elem->pb = dct_element->average_pb;
-        cv_elem->pr = dct_element->average_pr;
-        cv_elem->y = a - b - c + d;
+/* batch_file
+ * Input: A Batch_slot holding the next file, its sequence number, and a
+ *        pointer to whether compress40_batch decompresses as closure
+ * Does:  Compresses or decompresses the file into its output with the
+ *        slot's buffers, or sets its 'failed' to the errno of whatever
+ *        could not be opened or written; sets its 'missed' if it was
+ *        compressed in format 5 and missed its target. Runs on a worker
+ *        thread
+ * Returns: Nothing
+ */
+void batch_file(void *slot, unsigned seq, void *cl)
+{
+    (void) seq;
+    Batch_slot batch = slot;
+    Compress40_file *file = batch->file;
+    int decompress = *(int *)cl;
+
+    file->failed = 0;
+    file->missed = 0;
+    FILE *input = fopen(file->input, "r");
+    if (input == NULL) {
+        file->failed = errno;
+        return;
+    }
 
-        cv_elem = methods->at(cv_array, i+1, j);
-        cv_elem->pb = dct_element->average_pb;
-        cv_elem->pr = dct_element->average_pr;
-        cv_elem->y = a - b + c - d;
+    if (decompress) {
+        FILE *output = fopen(file->output, "w");
+        if (output == NULL) {
+            file->failed = errno;
+        } else {
+            decompress_stream(input, output, batch->buffers);
+            if (fclose(output) != 0) {
+                file->failed = errno;
+            }
+        }
+    } else {
+        int fd = open(file->output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            file->failed = errno;
+        } else {
+            file->missed = !compress_stream(input, fd, batch->buffers);
+            if (close(fd) != 0) {
+                file->failed = errno;
+            }
+        }
+    }
+    fclose(input);
+}
+
+/* stream_buffers_new
+ * Does:  Makes empty buffers for compress_stream and decompress_stream,
+ *        which stream_buffers_fit grows to the first image they are used
+ *        for
+ * Returns: The new buffers
+ */
+Stream_buffers stream_buffers_new(void)
+{
+    Stream_buffers buffers = calloc(1, sizeof(*buffers));
+    assert(buffers != NULL);
+    return buffers;
+}
 
-        cv_elem = methods->at(cv_array, i, j+1);
-        cv_elem->pb = dct_element->average_pb;
-        cv_elem->pr = dct_element->average_pr;
-        cv_elem->y = a + b - c - d;
+/* stream_buffers_free
+ * Input: A pointer to buffers made by stream_buffers_new
+ * Does:  Frees them and sets the pointer to NULL
+ * Returns: Nothing
+ */
+void stream_buffers_free(Stream_buffers *buffersp)
+{
+    assert(buffersp != NULL && *buffersp != NULL);
+    Stream_buffers buffers = *buffersp;
+    if (buffers->strip != NULL) {
+        strip_buffers_free(&buffers->strip);
+    }
+    if (buffers->fixed != NULL) {
+        Fixed40_free(&buffers->fixed);
+    }
+    free(buffers->rgb);
+    free(buffers->words);
+    free(buffers->raw);
+    free(buffers);
+    *buffersp = NULL;
+}
 
-        cv_elem = methods->at(cv_array, i+1, j+1);
-        cv_elem->pb = dct_element->average_pb;
-        cv_elem->pr = dct_element->average_pr;
-        cv_elem->y = a + b + c + d;
+/* stream_buffers_fit
+ * Input: Buffers made by stream_buffers_new, the pixels of the two rows
+ *        of a strip, the trimmed width and the bytes of two packed rows
+ * Does:  Grows the buffers that are too small and makes the strip
+ *        buffers again if they are for another width
+ * Returns: Nothing
+ */
+void stream_buffers_fit(Stream_buffers buffers, size_t pixels,
+                        unsigned width, size_t raw_bytes)
+{
+    buffers->rgb = grow_buffer(buffers->rgb, &buffers->pixels, pixels,
+                               sizeof(*buffers->rgb));
+    buffers->words = grow_buffer(buffers->words, &buffers->nwords,
+                                 width / 2, sizeof(*buffers->words));
+    buffers->raw = grow_buffer(buffers->raw, &buffers->raw_bytes,
+                               raw_bytes, 1);
+
+    /* compress_strip needs the Pr plane right after the Pb plane */
+    if (buffers->strip == NULL || buffers->width != width) {
+        if (buffers->strip != NULL) {
+            strip_buffers_free(&buffers->strip);
+        }
+        buffers->strip = strip_buffers_new(width);
+        buffers->width = width;
     }
 }
 
+/* stream_buffers_fixed
+ * Input: Buffers made by stream_buffers_new and a source denominator
+ * Does:  Makes the Fixed40 tables for the denominator, unless the
+ *        buffers already hold them
+ * Returns: The tables, which belong to the buffers
+ */
+Fixed40_T stream_buffers_fixed(Stream_buffers buffers, unsigned denom)
+{
+    if (buffers->fixed == NULL || buffers->denom != denom) {
+        if (buffers->fixed != NULL) {
+            Fixed40_free(&buffers->fixed);
+        }
+        buffers->fixed = Fixed40_new(denom);
+        buffers->denom = denom;
+    }
+    return buffers->fixed;
+}
 
+/* grow_buffer
+ * Input: A buffer from malloc, or NULL, a pointer to how many elements
+ *        of 'size' bytes it has room for, and how many it needs
+ * Does:  Replaces it with one that has room for 'need' if it is too
+ *        small, without keeping what it held
+ * Returns: The buffer to use from now on
+ */
+void *grow_buffer(void *buffer, size_t *have, size_t need, size_t size)
+{
+    if (buffer != NULL && need <= *have) {
+        return buffer;
+    }
+    free(buffer);
+    buffer = malloc(need * size + 1);
+    assert(buffer != NULL);
+    *have = need;
+    return buffer;
+}
+
+/* RGB_to_CV
+ * Input: Two ints to represent col and row, and a run of n pixels
+ *        A pointer to a A2Methouds_Uarray2
+ *        A pointer to the first element of the run
+ *        A pointer to a Raster as closure
+ * Does:  It is an apply function that changes the pixels
+ *        currently stored as raw RGB samples to component video 
+ *        representation and stores it in cv_array for 
+ *        every pixel index
+ * Returns: Nothing
+ */
+void RGB_to_CV(int i, int j, int n, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, void *cl)
+{
+    (void) cv_array;
+    assert(first != NULL && cl != NULL);
+
+    Raster image = cl;
+    const unsigned char *raw = image->samples + j * image->row_bytes +
+                               (size_t)i * 3 * image->sample_bytes;
+    Dct40_raw_to_CV(raw, image->sample_bytes, first, n, image->denom);
+}
+
+/* CV_to_DCT
+ * Input: A w by h rectangle of component video pixels at (i, j) whose
+ *        rows are 'stride' pixels apart, and the DCT array with its
+ *        methods as closure
+ * Does:  Turns every 2x2 block of the rectangle into its DCT element
+ * Returns: Nothing
+ */
+void CV_to_DCT(int i, int j, int w, int h, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, int stride, void *cl)
+{
+    (void) cv_array;
+    A2_with_methods DCT = cl;
+    A2Methods_UArray2 dct_array = DCT->a2;
+    A2Methods_T methods = DCT->methods;
+
+    /* Even block sizes keep every 2x2 block inside one rectangle */
+    assert(i % 2 == 0 && j % 2 == 0 && w % 2 == 0 && h % 2 == 0);
+
+    for (int r = 0; r < h; r += 2) {
+        Component_vid top = (Component_vid)first + (size_t)r * stride;
+        Component_vid bottom = top + stride;
+        dct_elem dct = span(methods, dct_array, i / 2, (j + r) / 2, w / 2);
+        if (dct != NULL) {
+            Dct40_CV_to_DCT(top, bottom, w / 2, dct);
+            continue;
+        }
+        for (int k = 0; k < w / 2; k++) {
+            block_to_DCT(&top[2 * k], &top[2 * k + 1],
+                         &bottom[2 * k], &bottom[2 * k + 1],
+                         methods->at(dct_array, i / 2 + k, (j + r) / 2));
+        }
+    }
+}
+
+void pack_and_print(int i, int j, int n, A2Methods_UArray2 dct_array,
+                    A2Methods_Object *first, void *cl)
+{
+    (void) i;
+    (void) j;
+    assert(dct_array != NULL);
+    assert(first != NULL);
+    assert(cl != NULL);
+
+    dct_elem dct = first;
+    for (int k = 0; k < n; k++) {
+        print_codeword(&dct[k], cl);
+    }
+}
+
+/* write_header
+ * Input: The codeword writer and the header to write
+ * Does:  Queues the text header of the compressed format: the format,
+ *        the width and height, then the block size for format 4, the Y
+ *        and coefficient scales for format 5 or the tile size for
+ *        format 6
+ * Returns: Nothing
+ */
+void write_header(Codewords_T out, const Header *header)
+{
+    char header_text[96];
+    int len = snprintf(header_text, sizeof(header_text),
+                       "COMP40 Compressed image format %u\n%u %u",
+                       header->format, header->width, header->height);
+    assert(len > 0 && (size_t)len < sizeof(header_text));
+    if (header->format == 4) {
+        len += snprintf(header_text + len, sizeof(header_text) - len,
+                        " %u", header->block);
+    } else if (header->format == 5) {
+        len += snprintf(header_text + len, sizeof(header_text) - len,
+                        " %u %u", header->quant.y_scale,
+                        header->quant.coef_scale);
+    } else if (header->format == 6) {
+        len += snprintf(header_text + len, sizeof(header_text) - len,
+                        " %u", header->tile);
+    }
+    len += snprintf(header_text + len, sizeof(header_text) - len, "\n");
+    assert((size_t)len < sizeof(header_text));
+    Codewords_write(out, header_text, len);
+}
+
+/* put_codewords
+ * Input: The codeword writer, the entropy coder or NULL, and n codewords
+ * Does:  Queues the codewords as they are for format 2, or hands them to
+ *        the coder, which holds the whole image, for format 3
+ * Returns: Nothing
+ */
+void put_codewords(Codewords_T out, Entropy40_T coder, const uint32_t *words,
+                   size_t n)
+{
+    if (coder != NULL) {
+        Entropy40_put(coder, words, n);
+    } else {
+        Codewords_put_row(out, words, n);
+    }
+}
+
+/* finish_codewords
+ * Input: Pointers to the codeword writer and to the entropy coder or NULL
+ * Does:  Writes out what the coder holds, if there is one, then frees
+ *        both
+ * Returns: Nothing
+ */
+void finish_codewords(Codewords_T *outp, Entropy40_T *coderp)
+{
+    if (*coderp != NULL) {
+        Entropy40_write(*coderp, *outp);
+        Entropy40_free(coderp);
+    }
+    Codewords_free(outp);
+}
+
+/* print_codeword
+ * Input: A pointer to a dct_elem and the codeword writer
+ * Does:  Quantizes the block, packs it into a 32-bit codeword and queues
+ *        the codeword in big-endian order
+ * Returns: Nothing
+ */
+void print_codeword(dct_elem element, Codewords_T out)
+{
+    unsigned pb = Chroma40_index(element->average_pb);
+    unsigned pr = Chroma40_index(element->average_pr);
+
+    Codewords_put(out, pack_codeword(element, pb, pr));
+}
+
+/* pack_codeword
+ * Input: A pointer to a dct_elem and its already quantized chroma indices
+ * Does:  Quantizes a, b, c and d and packs all six fields into a word
+ * Returns: The 32-bit codeword
+ */
+uint32_t pack_codeword(dct_elem element, unsigned pb, unsigned pr)
+{
+    return pack_fields(quantize_Y(element->a), quantize_coef(element->b),
+                       quantize_coef(element->c), quantize_coef(element->d),
+                       pb, pr);
+}
+
+/* pack_fields
+ * Input: The six quantized fields of a block
+ * Does:  Packs them into a word
+ * Returns: The 32-bit codeword
+ */
+uint32_t pack_fields(unsigned a, int b, int c, int d, unsigned pb,
+                     unsigned pr)
+{
+    /* The quantizers already keep every field in range: a is at most
+     * 511, b, c and d are clamped to [-15, 15] and the indices are 4 bits
+     */
+    uint32_t word = 0;
+    word = Bitpack_newu_unchecked(word, 4, 0, pr);
+    word = Bitpack_newu_unchecked(word, 4, 4, pb);
+    word = Bitpack_news_unchecked(word, 5, 8, d);
+    word = Bitpack_news_unchecked(word, 5, 13, c);
+    word = Bitpack_news_unchecked(word, 5, 18, b);
+    word = Bitpack_newu_unchecked(word, 9, 23, a);
+    return word;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void CV_to_RGB(int i, int j, int n, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, void *cl)
+{
+    (void) cv_array;
+    Pnm_ppm image = cl;
+    const struct A2Methods_T *methods = image->methods;
+
+    Pnm_rgb rgb = span(methods, image->pixels, i, j, n);
+    if (rgb != NULL) {
+        Dct40_CV_to_pixels(first, rgb, n, image->denominator);
+        return;
+    }
+
+    Component_vid cv = first;
+    for (int k = 0; k < n; k++) {
+        CV_to_pixel_max(&cv[k], methods->at(image->pixels, i + k, j),
+                        image->denominator);
+    }
+}
+
+/*
+ * Function: decompress40
+ * Purpose: Takes in a FILE pointer and decompresses the data by reversing
+ *          and counteracting the operations used to compress the file. 
+ * Parameters: Takes a FILE pointer for input
+ * Returns: Void
+ * Expectations: Asserts that the map and methods pointers are not NULL.
+ *               Also, after a new cv_array, dct_array, and rgb_array are made,
+ *               and dct and pixmap is malloced, asserts that the pointers to 
+ *               those objects are not NULL.
+ */
+void decompress40(FILE *input) {
+    decompress_arrays(input, 0);
+}
+
+/*
+ * Function: decompress40_blocked
+ * Purpose: Decompresses like decompress40, but with the component video
+ *          image in CV_BLOCKSIZE blocks, as compress40_blocked does.
+ *          Output is byte-for-byte the same as decompress40.
+ * Parameters: Takes a FILE pointer for input
+ * Returns: Void
+ * Expectations: Same as decompress40
+ */
+void decompress40_blocked(FILE *input) {
+    decompress_arrays(input, 1);
+}
+
+/*
+ * Function: decompress_arrays
+ * Purpose: Does the work of decompress40 and decompress40_blocked
+ * Parameters: Takes a FILE pointer for input and whether the component
+ *             video array is blocked
+ * Returns: Void
+ * Expectations: Asserts that the header is valid, that the arrays and
+ *               closure are allocated and that their methods can map by
+ *               rows and by blocks
+ */
+void decompress_arrays(FILE *input, int blocked) {
+    /* The codewords are read and the pixels written in row-major order,
+     * so only the component video array in between may be blocked
+     */
+    A2Methods_T methods = uarray2_methods_flat;
+    assert(methods != NULL && methods->map_rows != NULL);
+
+    Header header;
+    read_header(input, &header);
+    unsigned width = header.width, height = header.height;
+    if (header.format == 4) {
+        decompress_transform(input, stdout, width, height, header.block,
+                             0, 0, width, height);
+        return;
+    }
+    if (header.format == 6) {
+        decompress_tiled(input, stdout, &header, 0, 0, 0, width,
+                         height);
+        return;
+    }
+
+    A2Methods_UArray2 rgb_array = methods->new(width, height, sizeof(struct Pnm_rgb));
+    assert(rgb_array != NULL);
+    Pnm_ppm pixmap = malloc(sizeof(*pixmap));
+    assert(pixmap != NULL);
+    pixmap->width = width;
+    pixmap->height = height;
+    pixmap->denominator = output_maxval();
+    pixmap->methods = methods;
+    pixmap->pixels = rgb_array;
+
+    A2Methods_UArray2 dct_array = methods->new(width / 2, height / 2, sizeof(struct dct_elem));
+    assert(dct_array != NULL);
+    A2Methods_T cv_methods = cv_array_methods(blocked, width, height);
+    assert(cv_methods->map_rows != NULL && cv_methods->map_blocks != NULL);
+    A2Methods_UArray2 cv_array = cv_methods->new_with_blocksize(width,
+                                   height, sizeof(struct Component_vid),
+                                   CV_BLOCKSIZE);
+    assert(cv_array != NULL);
+
+    struct Disk_reader reader = {
+        open_codewords(input, &header), &header.quant
+    };
+    methods->map_rows(dct_array, Read_from_disk, &reader);
+    Codewords_free(&reader.in);
+    //map(dct_array, print_float, NULL);
+
+    A2_with_methods dct = malloc(sizeof(*dct));
+    assert(dct != NULL);
+    dct->a2 = dct_array;
+    dct->methods = methods;
+
+    cv_methods->map_blocks(cv_array, DCT_to_CV, dct);
+
+    cv_methods->map_rows(cv_array, CV_to_RGB, pixmap);
+
+    /* Each row of the flat array is whole, so it goes straight into the
+     * writer's buffer, and map_rows hands the rows over in order
+     */
+    Ppmrows_T ppm = Ppmrows_new_writer(stdout, width, height,
+                                       pixmap->denominator);
+    methods->map_rows(rgb_array, write_row, ppm);
+    Ppmrows_free(&ppm);
+
+    Pnm_ppmfree(&pixmap);
+
+    cv_methods->free(&cv_array);
+    methods->free(&dct_array);
+    free(dct);
+}
+
+/*
+ * Function: decompress40_stream
+ * Purpose: Decompresses one row of codewords at a time. Each row is
+ *          unpacked, turned back into a 2-pixel-tall strip of RGB by the
+ *          vector kernel in dct40.c and written as two PPM rows before
+ *          the next row of codewords is read, and the same buffers are
+ *          reused for every row.
+ *          Output is byte-for-byte the same as decompress40.
+ * Parameters: Takes a FILE pointer for input
+ * Returns: Void
+ * Expectations: Asserts that the header is valid and that each strip
+ *               buffer is allocated
+ */
+void decompress40_stream(FILE *input) {
+    Stream_buffers buffers = stream_buffers_new();
+    decompress_stream(input, stdout, buffers);
+    stream_buffers_free(&buffers);
+}
+
+/*
+ * Function: decompress_stream
+ * Purpose: Does the work of decompress40_stream in buffers that may be
+ *          left over from another image, growing them if they are too
+ *          small, and writes the PPM to any stream. Formats 4 and 6 have
+ *          buffers of their own and do not use them.
+ * Parameters: Takes a FILE pointer for input, one for output and the
+ *             buffers
+ * Returns: Void
+ * Expectations: Same as decompress40_stream
+ */
+void decompress_stream(FILE *input, FILE *output, Stream_buffers buffers) {
+    Header header;
+    read_header(input, &header);
+    unsigned width = header.width, height = header.height;
+    if (header.format == 4) {
+        decompress_transform(input, output, width, height, header.block,
+                             0, 0, width, height);
+        return;
+    }
+    if (header.format == 6) {
+        decompress_tiled(input, output, &header, 0, 0, 0, width, height);
+        return;
+    }
+
+    unsigned maxval = output_maxval();
+    Codewords_T in = open_codewords(input, &header);
+    Ppmrows_T rows = Ppmrows_new_writer(output, width, height, maxval);
+
+    /* The two rows of a strip are adjacent so they go out together; at
+     * 255 the kernel writes the packed rows itself
+     */
+    size_t row_bytes = Ppmrows_row_bytes(rows);
+    stream_buffers_fit(buffers, 2 * (size_t)width, width, 2 * row_bytes);
+    Dct40_planes planes = buffers->strip->planes;
+    struct Pnm_rgb *rgb_top = buffers->rgb;
+    struct Pnm_rgb *rgb_bottom = rgb_top + width;
+    uint32_t *words = buffers->words;
+    unsigned char *raw = buffers->raw;
+
+    for (unsigned j = 0; j < height; j += 2) {
+        Codewords_get_row(in, words, width / 2);
+        if (maxval == 255) {
+            decompress_strip_bytes(words, width, &header.quant, planes,
+                                   raw, raw + row_bytes);
+            Ppmrows_write_raw(rows, raw, 2);
+        } else {
+            decompress_strip(words, width, &header.quant, planes, rgb_top,
+                             rgb_bottom, maxval);
+            Ppmrows_write_rows(rows, rgb_top, 2);
+        }
+    }
+
+    Codewords_free(&in);
+    Ppmrows_free(&rows);
+}
+
+/*
+ * Function: decompress_strip
+ * Purpose: Turns one row of codewords back into a 2-pixel-tall strip.
+ *          Every decompressor that works a strip at a time goes through
+ *          here, which is what keeps their output identical.
+ * Parameters: width / 2 codewords, the width, planes with room for
+ *             width / 2 blocks, the top and bottom output rows and the
+ *             output denominator
+ * Returns: Void
+ */
+void decompress_strip(const uint32_t *words, unsigned width,
+                      const Quant *quant, Dct40_planes planes,
+                      struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                      unsigned maxval)
+{
+    unpack_row(words, width / 2, quant, planes);
+    Dct40_inverse(planes, width / 2, top, bottom, maxval);
+}
+
+/*
+ * Function: decompress_strip_bytes
+ * Purpose: decompress_strip for a denominator of 255, decoding straight
+ *          into two packed rows of a raw PPM
+ * Parameters: The codewords of one block row, the image width, planes
+ *             with room for width / 2 blocks and the two rows, 3 * width
+ *             bytes each
+ * Returns: Nothing
+ */
+void decompress_strip_bytes(const uint32_t *words, unsigned width,
+                            const Quant *quant, Dct40_planes planes,
+                            unsigned char *top, unsigned char *bottom)
+{
+    unpack_row(words, width / 2, quant, planes);
+    Dct40_inverse_bytes(planes, width / 2, top, bottom);
+}
+
+/*
+ * Function: decompress40_maxval
+ * Purpose: Sets the denominator of every image decompressed from now on
+ * Parameters: The denominator, or 0 for the default, DENOM
+ * Returns: Nothing
+ * Expectations: maxval is at most 65535
+ */
+void decompress40_maxval(unsigned maxval)
+{
+    assert(maxval <= 65535);
+    out_maxval = maxval;
+}
+
+/*
+ * Function: compress40_fixed
+ * Purpose: Switches the strip compressors between float and fixed-point
+ *          arithmetic for every image compressed from now on
+ * Parameters: Nonzero for fixed point, 0 for float
+ * Returns: Nothing
+ */
+void compress40_fixed(int on)
+{
+    fixed_point = on != 0;
+}
+
+/*
+ * Function: compress40_entropy
+ * Purpose: Switches the strip compressors between format 2 and the
+ *          entropy-coded format 3 for every image compressed from now on
+ * Parameters: Nonzero for format 3, 0 for format 2
+ * Returns: Nothing
+ */
+void compress40_entropy(int on)
+{
+    entropy_coded = on != 0;
+}
+
+/*
+ * Function: compress40_block
+ * Purpose: Sets the side of the blocks the strip compressors use for
+ *          every image compressed from now on
+ * Parameters: 2 for format 2 or 3, or 4 or 8 for format 4
+ * Returns: Nothing
+ * Expectations: n is 2 or a size Transform40 supports
+ */
+void compress40_block(unsigned n)
+{
+    assert(n == 2 || Transform40_supported(n));
+    block_size = n;
+}
+
+/*
+ * Function: compress40_budget
+ * Purpose: Makes the strip compressors write every image from now on in
+ *          format 5, quantized as finely as fits in a number of bytes
+ * Parameters: The size of the compressed file in bytes, or 0 to go back
+ *             to the fixed quantization
+ * Returns: Nothing
+ */
+void compress40_budget(size_t bytes)
+{
+    rate_bytes = bytes;
+    rate_rms = 0;
+}
+
+/*
+ * Function: compress40_rms
+ * Purpose: Makes the strip compressors write every image from now on in
+ *          format 5, quantized as coarsely as keeps the RMS error at or
+ *          below a target
+ * Parameters: The target RMS error of samples scaled to [0, 1], or 0 to
+ *             go back to the fixed quantization
+ * Returns: Nothing
+ * Expectations: rms is not negative
+ */
+void compress40_rms(double rms)
+{
+    assert(rms >= 0);
+    rate_rms = rms;
+    rate_bytes = 0;
+}
+
+/*
+ * Function: compress40_tile
+ * Purpose: Makes the strip compressors write every image from now on in
+ *          the tiled format 6
+ * Parameters: The side of a tile, or 0 for an untiled image
+ * Returns: Nothing
+ * Expectations: tile is even
+ */
+void compress40_tile(unsigned tile)
+{
+    assert(tile % 2 == 0);
+    tile_size = tile;
+}
+
+/*
+ * Function: compress40_target_met
+ * Purpose: Tells whether the last image compress40_stream,
+ *          compress40_stream_fd or compress40_parallel wrote met the
+ *          target of compress40_budget or compress40_rms
+ * Parameters: None
+ * Returns: 0 if it was written in format 5 and missed its target,
+ *          otherwise 1
+ */
+int compress40_target_met(void)
+{
+    return target_met;
+}
+
+/* output_maxval
+ * Returns: The denominator that decompressed images get
+ */
+unsigned output_maxval(void)
+{
+    return out_maxval != 0 ? out_maxval : (unsigned)DENOM;
+}
+
+/*
+ * Function: decompress40_parallel
+ * Purpose: Decompresses an image on 'threads' worker threads. Every
+ *          block takes exactly 4 bytes, so a stripe of block rows starts
+ *          at a codeword number computed from its sequence number. When
+ *          the input is a regular file the workers load their own
+ *          codewords from the mapping or with pread; otherwise the main
+ *          thread reads each stripe's codewords in order. Workers decode
+ *          and pack their stripe into raw PPM rows, and the main thread
+ *          writes the stripes in order. Output is byte-for-byte the same
+ *          as decompress40.
+ * Parameters: Takes a FILE pointer for input and the number of threads
+ * Returns: Void
+ * Expectations: threads is at least 1; the input holds every codeword
+ */
+void decompress40_parallel(FILE *input, unsigned threads) {
+    assert(threads >= 1);
+
+    Header header;
+    read_header(input, &header);
+    unsigned width = header.width, height = header.height;
+
+    /* Format 4 has no parallel decompressor yet */
+    if (header.format == 4) {
+        decompress_transform(input, stdout, width, height, header.block,
+                             0, 0, width, height);
+        return;
+    }
+    if (header.format == 6) {
+        decompress_tiled(input, stdout, &header, threads, 0, 0, width,
+                         height);
+        return;
+    }
+
+    Codewords_T in = open_codewords(input, &header);
+    Ppmrows_T rows = Ppmrows_new_writer(stdout, width, height,
+                                        output_maxval());
+    size_t row_bytes = Ppmrows_row_bytes(rows);
+    unsigned blocks = width / 2;
+
+    struct Stripe_job job;
+    job.src_width = width;
+    job.width = width;
+    job.denom = output_maxval();
+    job.in = Codewords_random_access(in) ? in : NULL;
+    job.ppm = rows;
+    job.quant = header.quant;
+
+    /* Stripes hold about STRIPE_BYTES of packed output each */
+    job.stripe_rows = row_bytes > 0 ? STRIPE_BYTES / (2 * row_bytes) : 1;
+    if (job.stripe_rows == 0) {
+        job.stripe_rows = 1;
+    }
+    unsigned block_rows = height / 2;
+    unsigned count = (block_rows + job.stripe_rows - 1) / job.stripe_rows;
+
+    unsigned nslots = 2 * threads;
+    void **slots = stripe_slots_new(nslots, 2 * (size_t)width,
+                                    (size_t)job.stripe_rows * blocks,
+                                    2 * job.stripe_rows * row_bytes, width);
+    Stripes_T stripes = Stripes_new(threads, nslots, slots,
+                                    decompress_stripe, &job);
+
+    struct Stripe *stripe;
+    for (unsigned seq = 0; seq < count; seq++) {
+        /* Make room by writing out the oldest stripes */
+        while ((stripe = Stripes_claim(stripes)) == NULL) {
+            stripe = Stripes_oldest(stripes);
+            Ppmrows_write_raw(rows, stripe->raw, 2 * stripe->block_rows);
+            Stripes_release(stripes);
+        }
+
+        stripe->block_rows = block_rows - seq * job.stripe_rows;
+        if (stripe->block_rows > job.stripe_rows) {
+            stripe->block_rows = job.stripe_rows;
+        }
+        if (job.in == NULL) {
+            Codewords_get_row(in, stripe->words,
+                              (size_t)stripe->block_rows * blocks);
+        }
+        Stripes_post(stripes);
+    }
+    Stripes_close(stripes);
+
+    while ((stripe = Stripes_oldest(stripes)) != NULL) {
+        Ppmrows_write_raw(rows, stripe->raw, 2 * stripe->block_rows);
+        Stripes_release(stripes);
+    }
+
+    Stripes_free(&stripes);
+    stripe_slots_free(slots, nslots);
+    Codewords_free(&in);
+    Ppmrows_free(&rows);
+}
+
+/* decompress_stripe
+ * Input: A struct Stripe, its sequence number, and the Stripe_job of
+ *        decompress40_parallel as closure
+ * Does:  Loads the stripe's codewords if the input allows it, decodes
+ *        each block row and packs the pixels into the stripe's raw rows;
+ *        runs on a worker thread
+ * Returns: Nothing
+ */
+void decompress_stripe(void *slot, unsigned seq, void *cl)
+{
+    struct Stripe *stripe = slot;
+    Stripe_job job = cl;
+    unsigned blocks = job->width / 2;
+    size_t row_bytes = Ppmrows_row_bytes(job->ppm);
+
+    if (job->in != NULL) {
+        size_t first = (size_t)seq * job->stripe_rows * blocks;
+        Codewords_get_at(job->in, first, stripe->words,
+                         (size_t)stripe->block_rows * blocks);
+    }
+
+    struct Pnm_rgb *top = stripe->rgb;
+    struct Pnm_rgb *bottom = stripe->rgb + job->width;
+    for (unsigned r = 0; r < stripe->block_rows; r++) {
+        const uint32_t *words = stripe->words + (size_t)r * blocks;
+        unsigned char *raw = stripe->raw + 2 * r * row_bytes;
+        if (job->denom == 255) {
+            decompress_strip_bytes(words, job->width, &job->quant,
+                                   stripe->buffers->planes, raw,
+                                   raw + row_bytes);
+            continue;
+        }
+        decompress_strip(words, job->width, &job->quant,
+                         stripe->buffers->planes, top, bottom, job->denom);
+        Ppmrows_pack(job->ppm, top, raw);
+        Ppmrows_pack(job->ppm, bottom, raw + row_bytes);
+    }
+}
+
+/*
+ * Function: decompress40_region
+ * Purpose: Decompresses only the w by h rectangle whose top left pixel is
+ *          (x, y), clipped to the image. Only the block rows and columns
+ *          that overlap the rectangle are loaded and decoded: the reader
+ *          skips everything else, which costs no I/O when the input is a
+ *          mapped or seekable file. The pixels match the same rectangle
+ *          of decompress40's output.
+ * Parameters: Takes a FILE pointer for input and the rectangle
+ * Returns: Void
+ * Expectations: The input holds every codeword up to the rectangle
+ */
+void decompress40_region(FILE *input, unsigned x, unsigned y,
+                         unsigned w, unsigned h) {
+    Header header;
+    read_header(input, &header);
+    unsigned width = header.width, height = header.height;
+    if (header.format == 4) {
+        decompress_transform(input, stdout, width, height, header.block,
+                             x, y, w, h);
+        return;
+    }
+    if (header.format == 6) {
+        decompress_tiled(input, stdout, &header, 0, x, y, w, h);
+        return;
+    }
+
+    /* Clip the rectangle to the image */
+    x = x < width ? x : width;
+    y = y < height ? y : height;
+    w = w < width - x ? w : width - x;
+    h = h < height - y ? h : height - y;
+
+    /* Block columns [col0, col0 + cols) and block rows [row0, row_end)
+     * cover the rectangle
+     */
+    unsigned blocks = width / 2;
+    unsigned col0 = x / 2;
+    unsigned cols = w == 0 ? 0 : (x + w + 1) / 2 - col0;
+    unsigned row0 = y / 2;
+    unsigned row_end = h == 0 ? row0 : (y + h + 1) / 2;
+
+    uint32_t *words = malloc(cols * sizeof(*words) + 1);
+    assert(words != NULL);
+    Dct40_planes planes = Dct40_planes_new(cols);
+    struct Pnm_rgb *strip = malloc(2 * 2 * (size_t)cols * sizeof(*strip) + 1);
+    assert(strip != NULL);
+    struct Pnm_rgb *top = strip;
+    struct Pnm_rgb *bottom = strip + 2 * cols;
+
+    Codewords_T in = open_codewords(input, &header);
+    Ppmrows_T rows = Ppmrows_new_writer(stdout, w, h, output_maxval());
+
+    Codewords_skip(in, (size_t)row0 * blocks);
+    for (unsigned r = row0; r < row_end; r++) {
+        Codewords_skip(in, col0);
+        Codewords_get_row(in, words, cols);
+        if (r + 1 < row_end) {
+            Codewords_skip(in, blocks - col0 - cols);
+        }
+        decompress_strip(words, 2 * cols, &header.quant, planes, top,
+                         bottom, output_maxval());
+
+        /* The rectangle may start or end halfway through a block */
+        unsigned offset = x - 2 * col0;
+        if (2 * r >= y) {
+            Ppmrows_write(rows, top + offset);
+        }
+        if (2 * r + 1 < y + h) {
+            Ppmrows_write(rows, bottom + offset);
+        }
+    }
+
+    free(words);
+    Dct40_planes_free(&planes);
+    free(strip);
+    Codewords_free(&in);
+    Ppmrows_free(&rows);
+}
+
+/*
+ * Function: decompress40_thumbnail
+ * Purpose: Writes an image at half the width and height of a compressed
+ *          one, a pixel for every 2x2 block. The pixel is the block's
+ *          own averages: Y is a and Pb and Pr are the chroma indices, so
+ *          neither b, c and d nor the inverse DCT are ever looked at,
+ *          and only one row of the thumbnail is held at a time. Format 4
+ *          has no such averages; its pixels are decoded and each 2x2
+ *          square of them averaged. An odd last row or column is left
+ *          out.
+ * Parameters: Takes a FILE pointer for input
+ * Returns: Void
+ * Expectations: Asserts that the header is valid; the input holds the
+ *               whole image
+ */
+void decompress40_thumbnail(FILE *input) {
+    Header header;
+    read_header(input, &header);
+    unsigned width = header.width, height = header.height;
+    if (header.format == 4) {
+        thumbnail_transform(input, width, height, header.block);
+        return;
+    }
+    if (header.format == 6) {
+        thumbnail_tiled(input, &header);
+        return;
+    }
+
+    unsigned blocks = width / 2;
+    uint32_t *words = malloc(blocks * sizeof(*words) + 1);
+    assert(words != NULL);
+    struct Component_vid *cv = malloc(blocks * sizeof(*cv) + 1);
+    assert(cv != NULL);
+    struct Pnm_rgb *rgb = malloc(blocks * sizeof(*rgb) + 1);
+    assert(rgb != NULL);
+
+    unsigned maxval = output_maxval();
+    Codewords_T in = open_codewords(input, &header);
+    Ppmrows_T rows = Ppmrows_new_writer(stdout, blocks, height / 2, maxval);
+
+    for (unsigned j = 0; j < height / 2; j++) {
+        Codewords_get_row(in, words, blocks);
+        unpack_averages(words, blocks, &header.quant, cv);
+        Dct40_CV_to_pixels(cv, rgb, blocks, maxval);
+        Ppmrows_write(rows, rgb);
+    }
+
+    free(words);
+    free(cv);
+    free(rgb);
+    Codewords_free(&in);
+    Ppmrows_free(&rows);
+}
+
+/* unpack_averages
+ * Input: n codewords, the quantization of their image and room for n
+ *        Component_vids
+ * Does:  Turns each codeword's a and chroma indices into the average Y,
+ *        Pb and Pr of its block
+ * Returns: Nothing
+ */
+void unpack_averages(const uint32_t *words, unsigned n, const Quant *quant,
+                     struct Component_vid *cv)
+{
+    float pb[CHROMA_CHUNK], pr[CHROMA_CHUNK];
+    for (unsigned first = 0; first < n; first += CHROMA_CHUNK) {
+        unsigned m = n - first < CHROMA_CHUNK ? n - first : CHROMA_CHUNK;
+        unpack_chroma(words + first, m, pb, pr);
+        for (unsigned i = 0; i < m; i++) {
+            cv[first + i].y = get_Y(Bitpack_getu_inline(words[first + i],
+                                                        9, 23),
+                                    quant->y_scale);
+            cv[first + i].pb = pb[i];
+            cv[first + i].pr = pr[i];
+        }
+    }
+}
+
+/*
+ * Function: thumbnail_tiled
+ * Purpose: decompress40_thumbnail for format 6. The tiles of a tile row
+ *          are all opened and read a block row at a time, side by side.
+ * Parameters: FILE pointer for input, just past the header, and the
+ *             header
+ * Returns: Void
+ * Expectations: The input holds the index and every tile
+ */
+void thumbnail_tiled(FILE *input, const Header *header)
+{
+    unsigned width = header->width, height = header->height;
+    unsigned tile = header->tile;
+    Tiles40_T tiles = Tiles40_new(width, height, tile);
+    Tiles40_read(tiles, input);
+    unsigned cols = Tiles40_cols(tiles);
+
+    unsigned blocks = width / 2;
+    uint32_t *words = malloc(tile / 2 * sizeof(*words));
+    assert(words != NULL);
+    struct Component_vid *cv = malloc(blocks * sizeof(*cv) + 1);
+    assert(cv != NULL);
+    struct Pnm_rgb *rgb = malloc(blocks * sizeof(*rgb) + 1);
+    assert(rgb != NULL);
+    Codewords_T *in = malloc(cols * sizeof(*in) + 1);
+    assert(in != NULL);
+    Header *headers = malloc(cols * sizeof(*headers) + 1);
+    assert(headers != NULL);
+
+    unsigned maxval = output_maxval();
+    Ppmrows_T rows = Ppmrows_new_writer(stdout, blocks, height / 2, maxval);
+
+    unsigned x, y, w, h;
+    for (unsigned r = 0; r < Tiles40_rows(tiles); r++) {
+        for (unsigned c = 0; c < cols; c++) {
+            size_t size;
+            unsigned char *bytes = Tiles40_load(tiles, input, c, r, &size);
+            in[c] = open_tile(bytes, size, &headers[c]);
+            Tiles40_rect(tiles, c, r, &x, &y, &w, &h);
+            assert(headers[c].width == w && headers[c].height == h);
+        }
+        for (unsigned j = 0; j < h / 2; j++) {
+            for (unsigned c = 0; c < cols; c++) {
+                Tiles40_rect(tiles, c, r, &x, &y, &w, &h);
+                Codewords_get_row(in[c], words, w / 2);
+                unpack_averages(words, w / 2, &headers[c].quant,
+                                cv + x / 2);
+            }
+            Dct40_CV_to_pixels(cv, rgb, blocks, maxval);
+            Ppmrows_write(rows, rgb);
+        }
+        for (unsigned c = 0; c < cols; c++) {
+            Codewords_free(&in[c]);
+        }
+    }
+
+    free(words);
+    free(cv);
+    free(rgb);
+    free(in);
+    free(headers);
+    Tiles40_free(&tiles);
+    Ppmrows_free(&rows);
+}
+
+/*
+ * Function: thumbnail_transform
+ * Purpose: decompress40_thumbnail for format 4: every block row is
+ *          decoded in full and each 2x2 square of its pixels averaged
+ * Parameters: FILE pointer for input, just past the header, and the
+ *             width, height and block side it gave
+ * Returns: Void
+ * Expectations: The input holds the whole image
+ */
+void thumbnail_transform(FILE *input, unsigned width, unsigned height,
+                         unsigned block)
+{
+    unsigned n = block;
+    unsigned blocks = (width + n - 1) / n;
+    unsigned block_rows = (height + n - 1) / n;
+    size_t nwords = (size_t)blocks * Transform40_words(n);
+    size_t stride = (size_t)blocks * n;
+
+    uint32_t *words = malloc(nwords * sizeof(*words) + 1);
+    assert(words != NULL);
+    struct Pnm_rgb *rgb = malloc(n * stride * sizeof(*rgb) + 1);
+    assert(rgb != NULL);
+    struct Pnm_rgb *thumb = malloc(width / 2 * sizeof(*thumb) + 1);
+    assert(thumb != NULL);
+    Transform40_T transform = Transform40_new(n, blocks);
+
+    unsigned maxval = output_maxval();
+    Codewords_T in = Codewords_new_reader(input);
+    Ppmrows_T rows = Ppmrows_new_writer(stdout, width / 2, height / 2,
+                                        maxval);
+
+    for (unsigned r = 0; r < block_rows; r++) {
+        Codewords_get_row(in, words, nwords);
+        Transform40_inverse(transform, words, blocks, maxval, rgb, stride);
+
+        /* n is even, so the squares never straddle two block rows */
+        for (unsigned i = 0; i < n && r * n + i + 1 < height; i += 2) {
+            const struct Pnm_rgb *top = rgb + i * stride;
+            const struct Pnm_rgb *bottom = top + stride;
+            for (unsigned k = 0; k < width / 2; k++) {
+                const struct Pnm_rgb *p = top + 2 * k, *q = bottom + 2 * k;
+                thumb[k].red = (p[0].red + p[1].red + q[0].red +
+                                q[1].red + 2) / 4;
+                thumb[k].green = (p[0].green + p[1].green + q[0].green +
+                                  q[1].green + 2) / 4;
+                thumb[k].blue = (p[0].blue + p[1].blue + q[0].blue +
+                                 q[1].blue + 2) / 4;
+            }
+            Ppmrows_write(rows, thumb);
+        }
+    }
+
+    free(words);
+    free(rgb);
+    free(thumb);
+    Transform40_free(&transform);
+    Codewords_free(&in);
+    Ppmrows_free(&rows);
+}
+
+/*
+ * Function: decompress_transform
+ * Purpose: Decompresses the w by h rectangle of a format 4 image whose
+ *          top left pixel is (x, y), clipped to the image, one block row
+ *          at a time. Every block is the same number of codewords, so
+ *          the blocks outside the rectangle are skipped as in
+ *          decompress40_region; the whole image is the rectangle at
+ *          (0, 0) that is width by height.
+ * Parameters: FILE pointer for input, just past the header, the stream
+ *             to write the PPM to, the width, height and block side the
+ *             header gave, and the rectangle
+ * Returns: Void
+ * Expectations: The input holds every codeword up to the rectangle
+ */
+void decompress_transform(FILE *input, FILE *output, unsigned width,
+                          unsigned height, unsigned block, unsigned x,
+                          unsigned y, unsigned w, unsigned h)
+{
+    unsigned n = block;
+    x = x < width ? x : width;
+    y = y < height ? y : height;
+    w = w < width - x ? w : width - x;
+    h = h < height - y ? h : height - y;
+
+    /* Block columns [col0, col0 + cols) and block rows [row0, row_end)
+     * cover the rectangle
+     */
+    unsigned blocks = (width + n - 1) / n;
+    unsigned col0 = x / n;
+    unsigned cols = w == 0 ? 0 : (x + w + n - 1) / n - col0;
+    unsigned row0 = y / n;
+    unsigned row_end = h == 0 ? row0 : (y + h + n - 1) / n;
+    unsigned nwords = Transform40_words(n);
+    size_t stride = (size_t)cols * n;
+
+    uint32_t *words = malloc(cols * nwords * sizeof(*words) + 1);
+    assert(words != NULL);
+    struct Pnm_rgb *rgb = malloc(n * stride * sizeof(*rgb) + 1);
+    assert(rgb != NULL);
+    Transform40_T transform = Transform40_new(n, cols);
+
+    unsigned maxval = output_maxval();
+    Codewords_T in = Codewords_new_reader(input);
+    Ppmrows_T rows = Ppmrows_new_writer(output, w, h, maxval);
+
+    Codewords_skip(in, (size_t)row0 * blocks * nwords);
+    for (unsigned r = row0; r < row_end; r++) {
+        Codewords_skip(in, (size_t)col0 * nwords);
+        Codewords_get_row(in, words, (size_t)cols * nwords);
+        if (r + 1 < row_end) {
+            Codewords_skip(in, (size_t)(blocks - col0 - cols) * nwords);
+        }
+        Transform40_inverse(transform, words, cols, maxval, rgb, stride);
+
+        /* The rectangle may start or end partway through a block */
+        for (unsigned i = 0; i < n; i++) {
+            unsigned row = r * n + i;
+            if (row >= y && row < y + h) {
+                Ppmrows_write(rows, rgb + i * stride + (x - col0 * n));
+            }
+        }
+    }
+
+    free(words);
+    free(rgb);
+    Transform40_free(&transform);
+    Codewords_free(&in);
+    Ppmrows_free(&rows);
+}
+
+/*
+ * Function: decompress_tiled
+ * Purpose: Decompresses the w by h rectangle of a format 6 image whose
+ *          top left pixel is (x, y), clipped to the image, which may be
+ *          all of it. Only the tiles under the rectangle are read, a
+ *          tile row at a time. Worker threads decode whole tiles into a
+ *          buffer of the tile row before its rows are written; without
+ *          them the tiles of a row are decoded side by side a strip at a
+ *          time, so the rows written stay in cache.
+ * Parameters: FILE pointer for input, just past the header, the stream
+ *             to write the PPM to, the header, the number of worker
+ *             threads, or 0 to decode every tile on the calling thread,
+ *             and the rectangle
+ * Returns: Void
+ * Expectations: The input holds the index and every tile up to the last
+ *               one under the rectangle
+ */
+void decompress_tiled(FILE *input, FILE *output, const Header *header,
+                      unsigned threads, unsigned x, unsigned y, unsigned w,
+                      unsigned h)
+{
+    unsigned width = header->width, height = header->height;
+    unsigned tile = header->tile;
+
+    /* Clip the rectangle to the image */
+    x = x < width ? x : width;
+    y = y < height ? y : height;
+    w = w < width - x ? w : width - x;
+    h = h < height - y ? h : height - y;
+
+    struct Tile_job job;
+    job.tiles = Tiles40_new(width, height, tile);
+    Tiles40_read(job.tiles, input);
+    job.denom = 0;
+    job.fixed = NULL;
+    job.maxval = output_maxval();
+    job.input = input;
+    job.kept = NULL;
+    job.nkept = 0;
+
+    /* Tile columns [col0, col_end) and tile rows [row0, row_end) cover
+     * the rectangle; rows with no pixels have nothing to write, and an
+     * image with none has no tiles to read
+     */
+    unsigned col0 = x / tile;
+    unsigned col_end = w == 0 ? col0 : (x + w - 1) / tile + 1;
+    unsigned row0 = y / tile;
+    unsigned row_end = h == 0 || w == 0 ? row0 : (y + h - 1) / tile + 1;
+    job.x0 = col0 * tile;
+    job.stride = (size_t)(col_end - col0) * tile;
+    unsigned buffer_rows = threads > 0 ? tile : 2;
+    job.rgb = malloc((size_t)buffer_rows * job.stride * sizeof(*job.rgb) +
+                     1);
+    assert(job.rgb != NULL);
+
+    unsigned nslots = threads > 0 ? 2 * threads : 1;
+    void **slots = tile_slots_new(nslots, job.tiles, tile);
+    Stripes_T stripes = threads > 0 ? Stripes_new(threads, nslots, slots,
+                                                  decompress_tile, &job)
+                                    : NULL;
+    Ppmrows_T rows = Ppmrows_new_writer(output, w, h, job.maxval);
+
+    for (job.row = row0; job.row < row_end; job.row++) {
+        /* The rectangle may start or end partway through a tile */
+        unsigned tx, ty, tw, th;
+        Tiles40_rect(job.tiles, col0, job.row, &tx, &ty, &tw, &th);
+        unsigned first = y > ty ? y - ty : 0;
+        unsigned last = y + h < ty + th ? y + h - ty : th;
+        if (stripes == NULL) {
+            stream_tile_row(&job, slots[0], col0, col_end, rows, first,
+                            last, x, w);
+            continue;
+        }
+
+        /* When the rectangle spans the tiles, its rows are one after
+         * another
+         */
+        work_tile_row(stripes, slots, col0, col_end, decompress_tile, &job,
+                      NULL);
+        if (w == job.stride) {
+            Ppmrows_write_rows(rows, job.rgb + first * job.stride,
+                               last - first);
+            continue;
+        }
+        for (unsigned i = first; i < last; i++) {
+            Ppmrows_write(rows, job.rgb + i * job.stride + (x - job.x0));
+        }
+    }
+
+    if (stripes != NULL) {
+        Stripes_free(&stripes);
+    }
+    tile_slots_free(slots, nslots);
+    Tiles40_free(&job.tiles);
+    free(job.rgb);
+    Ppmrows_free(&rows);
+}
+
+/* decompress_tile
+ * Input: A Tile_slot holding the bytes of a tile of the current tile
+ *        row, its sequence number, and the Tile_job of decompress_tiled
+ *        as closure
+ * Does:  Decodes the tile into its columns of job->rgb; may run on a
+ *        worker thread
+ * Returns: Nothing
+ */
+void decompress_tile(void *slot, unsigned seq, void *cl)
+{
+    (void) seq;
+    Tile_slot tile = slot;
+    Tile_job job = cl;
+
+    unsigned x, y, w, h;
+    Tiles40_rect(job->tiles, tile->col, job->row, &x, &y, &w, &h);
+    Header header;
+    Codewords_T in = open_tile(tile->bytes, tile->size, &header);
+    tile->bytes = NULL;
+    assert(header.width == w && header.height == h);
+    Strip_buffers buffers = w == tile->width ? tile->full : tile->edge;
+
+    for (unsigned j = 0; j < h; j += 2) {
+        struct Pnm_rgb *top = job->rgb + j * job->stride + (x - job->x0);
+        Codewords_get_row(in, tile->words, w / 2);
+        decompress_strip(tile->words, w, &header.quant, buffers->planes,
+                         top, top + job->stride, job->maxval);
+    }
+    Codewords_free(&in);
+}
+
+/*
+ * Function: stream_tile_row
+ * Purpose: Decodes columns [col0, col_end) of the current tile row of a
+ *          Tile_job on the calling thread, one block row of every tile
+ *          at a time into the two rows of job->rgb, and writes the rows
+ *          [first, last) of the tile row, w pixels from column x on
+ * Parameters: The Tile_job, a Tile_slot for scratch space, the columns,
+ *             the output, the rows and the columns to write
+ * Returns: Nothing
+ * Expectations: job->rgb holds two rows of job->stride pixels
+ */
+void stream_tile_row(Tile_job job, Tile_slot slot, unsigned col0,
+                     unsigned col_end, Ppmrows_T rows, unsigned first,
+                     unsigned last, unsigned x, unsigned w)
+{
+    unsigned n = col_end - col0;
+    Codewords_T *in = malloc(n * sizeof(*in) + 1);
+    assert(in != NULL);
+    Header *headers = malloc(n * sizeof(*headers) + 1);
+    assert(headers != NULL);
+
+    unsigned tx, ty, tw, th;
+    for (unsigned k = 0; k < n; k++) {
+        size_t size;
+        unsigned char *bytes = Tiles40_load(job->tiles, job->input, col0 + k,
+                                            job->row, &size);
+        in[k] = open_tile(bytes, size, &headers[k]);
+        Tiles40_rect(job->tiles, col0 + k, job->row, &tx, &ty, &tw, &th);
+        assert(headers[k].width == tw && headers[k].height == th);
+    }
+
+    struct Pnm_rgb *top = job->rgb;
+    struct Pnm_rgb *bottom = job->rgb + job->stride;
+    for (unsigned j = 0; j < last; j += 2) {
+        for (unsigned k = 0; k < n; k++) {
+            Tiles40_rect(job->tiles, col0 + k, job->row, &tx, &ty, &tw,
+                         &th);
+            if (j + 2 <= first) {
+                Codewords_skip(in[k], tw / 2);
+                continue;
+            }
+            Strip_buffers buffers = tw == slot->width ? slot->full
+                                                      : slot->edge;
+            Codewords_get_row(in[k], slot->words, tw / 2);
+            decompress_strip(slot->words, tw, &headers[k].quant,
+                             buffers->planes, top + (tx - job->x0),
+                             bottom + (tx - job->x0), job->maxval);
+        }
+
+        if (j >= first && j + 2 <= last && w == job->stride) {
+            Ppmrows_write_rows(rows, top, 2);
+            continue;
+        }
+        for (unsigned i = j; i < j + 2; i++) {
+            if (i >= first && i < last) {
+                Ppmrows_write(rows, (i == j ? top : bottom) +
+                                    (x - job->x0));
+            }
+        }
+    }
+
+    for (unsigned k = 0; k < n; k++) {
+        Codewords_free(&in[k]);
+    }
+    free(in);
+    free(headers);
+}
+
+/*
+ * Function: open_tile
+ * Purpose: Creates a reader for the codewords of a tile of format 6
+ * Parameters: The bytes of the tile, a malloc'd buffer that the reader
+ *             takes over, their number and the Header to fill in with
+ *             the tile's own header
+ * Returns: A Codewords_T reader
+ * Expectations: The tile is a whole image of format 2, 3 or 5
+ */
+Codewords_T open_tile(unsigned char *bytes, size_t size, Header *header)
+{
+    FILE *fp = fmemopen(bytes, size, "r");
+    assert(fp != NULL);
+    read_header(fp, header);
+    assert(header->format == 2 || header->format == 3 ||
+           header->format == 5);
+
+    /* The codewords of format 2 are already in memory, after the header */
+    if (header->format == 2) {
+        size_t start = ftell(fp);
+        fclose(fp);
+        memmove(bytes, bytes + start, size - start);
+        return Codewords_new_memory(bytes, size - start);
+    }
+    Codewords_T in = open_codewords(fp, header);
+    fclose(fp);
+    free(bytes);
+    return in;
+}
+
+/* Read_from_disk
+ * Input: Two ints to represent col and row, and a run of n DCT elements
+ *        A pointer to the A2Methods_UArray2 of DCT elements
+ *        A pointer to the first element of the run
+ *        A pointer to a Disk_reader as closure
+ * Does:  It is a map_rows apply function that reads the next n codewords
+ *        from the reader and unpacks them, with the reader's
+ *        quantization, into the n elements of the run, in order
+ * Returns: Nothing
+ */
+void Read_from_disk(int i, int j, int n, A2Methods_UArray2 dct_array,
+                    A2Methods_Object *first, void *cl)
+{
+    (void) i;
+    (void) j;
+    (void) dct_array;
+
+    Disk_reader reader = cl;
+    dct_elem dct = first;
+    uint32_t words[CHROMA_CHUNK];
+    float pb[CHROMA_CHUNK], pr[CHROMA_CHUNK];
+    for (int k = 0; k < n; k += CHROMA_CHUNK) {
+        int m = n - k < CHROMA_CHUNK ? n - k : CHROMA_CHUNK;
+        for (int l = 0; l < m; l++) {
+            words[l] = Codewords_get(reader->in);
+        }
+        unpack_chroma(words, m, pb, pr);
+        for (int l = 0; l < m; l++) {
+            unpack_codeword(words[l], reader->quant, &dct[k + l]);
+            dct[k + l].average_pb = pb[l];
+            dct[k + l].average_pr = pr[l];
+        }
+    }
+}
+
+/*
+ * Function: read_header
+ * Purpose: Reads the "COMP40 Compressed image format 2" header, or that
+ *          of format 3 to 6, and leaves input positioned just past it
+ * Parameters: FILE pointer for input and the Header to fill in
+ * Returns: Void
+ * Expectations: Asserts that the format and both dimensions were read,
+ *               and the block size of format 4, scales of format 5 or
+ *               tile size of format 6
+ */
+void read_header(FILE *input, Header *header)
+{
+    int read = fscanf(input, "COMP40 Compressed image format %u\n%u %u",
+                      &header->format, &header->width, &header->height);
+    assert(read == 3 && header->format >= 2 && header->format <= 6);
+    header->block = 2;
+    header->quant = Format2_quant;
+    header->tile = 0;
+    if (header->format == 4) {
+        int c = getc(input);
+        assert(c == ' ');
+        read = fscanf(input, "%u", &header->block);
+        assert(read == 1 && Transform40_supported(header->block));
+    } else if (header->format == 5) {
+        int c = getc(input);
+        assert(c == ' ');
+        read = fscanf(input, "%u %u", &header->quant.y_scale,
+                      &header->quant.coef_scale);
+        assert(read == 2);
+        assert(header->quant.y_scale >= 1 && header->quant.y_scale <= 511);
+        assert(header->quant.coef_scale >= 1);
+    } else if (header->format == 6) {
+        int c = getc(input);
+        assert(c == ' ');
+        read = fscanf(input, "%u", &header->tile);
+        assert(read == 1 && header->tile > 0 && header->tile % 2 == 0);
+        assert(header->width % 2 == 0 && header->height % 2 == 0);
+    }
+    int c = getc(input);
+    assert(c == '\n');
+}
+
+/*
+ * Function: open_codewords
+ * Purpose: Creates a reader for the codewords that follow a header. For
+ *          formats 3 and 5 the whole image is entropy-decoded up front,
+ *          so the reader works from memory and every decompressor can
+ *          treat it like format 2.
+ * Parameters: FILE pointer for input, just past the header, and the
+ *             header
+ * Returns: A Codewords_T reader
+ * Expectations: The input holds the whole image, of format 2, 3 or 5
+ */
+Codewords_T open_codewords(FILE *input, const Header *header)
+{
+    unsigned width = header->width, height = header->height;
+    assert(header->format != 4 && header->format != 6);
+    if (header->format == 2) {
+        return Codewords_new_reader(input);
+    }
+    size_t blocks = (size_t)(width / 2) * (height / 2);
+    unsigned char *bytes = Entropy40_decode(input, width / 2, height / 2);
+    return Codewords_new_memory(bytes, 4 * blocks);
+}
+
+/*
+ * Function: unpack_codeword
+ * Purpose: Unpacks the luma of a codeword into a dct_elem; its chroma is
+ *          left to unpack_chroma, which does a run of codewords at once
+ * Parameters: The 32-bit codeword, the quantization of its image and the
+ *             dct_elem to fill in
+ * Returns: Void
+ */
+void unpack_codeword(uint32_t word, const Quant *quant, dct_elem element)
+{
+    float a = get_Y(Bitpack_getu_inline(word, 9, 23), quant->y_scale);
+    float b = get_coef(Bitpack_gets_inline(word, 5, 18), quant->coef_scale);
+    float c = get_coef(Bitpack_gets_inline(word, 5, 13), quant->coef_scale);
+    float d = get_coef(Bitpack_gets_inline(word, 5, 8), quant->coef_scale);
+
+    element->a = a;
+    element->b = b;
+    element->c = c;
+    element->d = d;
+}
+
+/*
+ * Function: unpack_chroma
+ * Purpose: Dequantizes the Pb and Pr of n codewords, gathering their
+ *          indices CHROMA_CHUNK at a time for Chroma40_value_batch
+ * Parameters: The codewords, their number and room for n of each of
+ *             Pb and Pr
+ * Returns: Void
+ */
+void unpack_chroma(const uint32_t *words, unsigned n, float *pb, float *pr)
+{
+    unsigned pb_index[CHROMA_CHUNK], pr_index[CHROMA_CHUNK];
+    for (unsigned first = 0; first < n; first += CHROMA_CHUNK) {
+        unsigned m = n - first < CHROMA_CHUNK ? n - first : CHROMA_CHUNK;
+        for (unsigned i = 0; i < m; i++) {
+            pb_index[i] = Bitpack_getu_inline(words[first + i], 4, 4);
+            pr_index[i] = Bitpack_getu_inline(words[first + i], 4, 0);
+        }
+        Chroma40_value_batch(pb_index, pb + first, m);
+        Chroma40_value_batch(pr_index, pr + first, m);
+    }
+}
+
+/*
+ * Function: unpack_row
+ * Purpose: Unpacks a row of codewords into the planes of its blocks
+ * Parameters: The codewords, their number, the quantization of their
+ *             image and planes with room for them
+ * Returns: Void
+ */
+void unpack_row(const uint32_t *words, unsigned blocks, const Quant *quant,
+                Dct40_planes planes)
+{
+    for (unsigned i = 0; i < blocks; i++) {
+        struct dct_elem element;
+        unpack_codeword(words[i], quant, &element);
+        planes.a[i] = element.a;
+        planes.b[i] = element.b;
+        planes.c[i] = element.c;
+        planes.d[i] = element.d;
+    }
+    unpack_chroma(words, blocks, planes.pb, planes.pr);
+}
+
+/* write_row
+ * Input: A whole row of decompressed pixels and a Ppmrows_T writer as
+ *        closure
+ * Does:  Hands the row to the writer
+ * Returns: Nothing
+ */
+void write_row(int i, int j, int n, A2Methods_UArray2 rgb_array,
+               A2Methods_Object *first, void *cl)
+{
+    (void) j;
+    assert(i == 0 && (unsigned)n == Ppmrows_width(cl));
+    (void) rgb_array;
+    Ppmrows_write(cl, first);
+}
+
+/* DCT_to_CV
+ * Input: A w by h rectangle of component video pixels at (i, j) whose
+ *        rows are 'stride' pixels apart, and the DCT array with its
+ *        methods as closure
+ * Does:  Fills every 2x2 block of the rectangle from its DCT element
+ * Returns: Nothing
+ */
+void DCT_to_CV(int i, int j, int w, int h, A2Methods_UArray2 cv_array,
+               A2Methods_Object *first, int stride, void *cl)
+{
+    (void) cv_array;
+    A2_with_methods DCT = cl;
+    A2Methods_UArray2 dct_array = DCT->a2;
+    A2Methods_T methods = DCT->methods;
+
+    assert(i % 2 == 0 && j % 2 == 0 && w % 2 == 0 && h % 2 == 0);
+
+    for (int r = 0; r < h; r += 2) {
+        Component_vid top = (Component_vid)first + (size_t)r * stride;
+        Component_vid bottom = top + stride;
+        dct_elem dct = span(methods, dct_array, i / 2, (j + r) / 2, w / 2);
+        if (dct != NULL) {
+            Dct40_DCT_to_CV(dct, w / 2, top, bottom);
+            continue;
+        }
+        for (int k = 0; k < w / 2; k++) {
+            DCT_to_block(methods->at(dct_array, i / 2 + k, (j + r) / 2),
+                         &top[2 * k], &top[2 * k + 1],
+                         &bottom[2 * k], &bottom[2 * k + 1]);
+        }
+    }
+}
+
+/* span
+ * Input: The methods and an array, and a run of n elements starting at
+ *        (i, j) in one row
+ * Does:  Checks whether the run is adjacent in memory, as it is in an
+ *        unblocked array or inside one block of a blocked one
+ * Returns: The address of element (i, j), or NULL if the run is not
+ *          adjacent in memory
+ */
+void *span(const struct A2Methods_T *methods, A2Methods_UArray2 array2,
+           int i, int j, int n)
+{
+    char *first = methods->at(array2, i, j);
+    char *last = methods->at(array2, i + n - 1, j);
+    size_t size = methods->size(array2);
+    return last == first + (size_t)(n - 1) * size ? first : NULL;
+}
 
 void print_float(int i, int j, A2Methods_UArray2 image, 
                   A2Methods_Object *elem, void *cl) {
@@ -516,12 +2939,12 @@ int quantize_coef(float x)
     return round(x * 50);
 }
 
-float get_Y(unsigned y)
+float get_Y(unsigned y, unsigned scale)
 {
-    return (float)y /(float) 511;
+    return (float)y /(float) scale;
 }
 
-float get_coef(int x)
+float get_coef(int x, unsigned scale)
 {
-    return (float)x / (float)50;
+    return (float)x / (float)scale;
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+/* compress40.h
+ *
+ * Interface for the COMP40 image compressor used by 40image.c
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ */
+
+#include <stdio.h>
+
+/* The two functions below are functions you should implement.
+   They should take their input from the parameter and should
+   write their output to stdout */
+
+extern void compress40  (FILE *input);  /* reads PPM, writes compressed image */
+extern void decompress40(FILE *input);  /* reads compressed image, writes PPM */
+
+/* Same output as compress40/decompress40, but keep the image in square
+   blocks between the two passes so wide images stay in cache */
+extern void compress40_blocked(FILE *input);
+extern void decompress40_blocked(FILE *input);
+
+/* Same output as compress40/decompress40, but work on one 2-row strip
+   at a time so memory does not grow with image height */
+extern void compress40_stream(FILE *input);
+extern void decompress40_stream(FILE *input);
+
+/* compress40_stream, but the compressed image goes to the file
+   descriptor 'fd' instead of stdout */
+extern void compress40_stream_fd(FILE *input, int fd);
+
+/* compress40_stream_fd on 'threads' worker threads; the output is the
+   same for any number of threads */
+extern void compress40_parallel(FILE *input, int fd, unsigned threads);
+
+/* decompress40 on 'threads' worker threads, which load their own
+   codewords when the input is a regular file */
+extern void decompress40_parallel(FILE *input, unsigned threads);
+
+/* Writes only the w by h rectangle of the decompressed image whose top
+   left pixel is (x, y), clipped to the image; only the codewords under
+   the rectangle are read */
+extern void decompress40_region(FILE *input, unsigned x, unsigned y,
+                                unsigned w, unsigned h);
+
+/* Writes a thumbnail of half the width and height of the decompressed
+   image, one pixel per 2x2 block, from only the average luma and chroma
+   each codeword holds; no inverse DCT is done, except for format 4,
+   which holds no such averages. Up to rounding, a pixel is the average
+   of its 2x2 block of the decompressed image when none of the four had
+   red, green or blue clamped; a clamped one can put it off by a few
+   hundredths of full scale. Format 4, which averages decoded pixels,
+   always matches. */
+extern void decompress40_thumbnail(FILE *input);
+
+/* Sets the denominator (maxval) of the images every decompressor above
+   writes from now on, from 1 to 65535, or 0 for the default of 30000;
+   a denominator of 255 writes 1-byte samples through a faster path */
+extern void decompress40_maxval(unsigned maxval);
+
+/* Makes compress40_stream, compress40_stream_fd and compress40_parallel
+   compress every image from now on in fixed-point arithmetic if 'on' is
+   nonzero, or in float if it is 0, the default. Fixed point is faster
+   and gives the same codewords on every machine; a field of one of its
+   codewords is at most one away from the float compressor's. */
+extern void compress40_fixed(int on);
+
+/* Makes compress40_stream, compress40_stream_fd and compress40_parallel
+   write every image from now on in the entropy-coded format 3 if 'on' is
+   nonzero, or in format 2 if it is 0, the default. Format 3 holds the
+   same codewords in fewer bytes, but the compressor keeps them all until
+   the end of the image. Every decompressor reads either format. */
+extern void compress40_entropy(int on);
+
+/* Makes compress40_stream, compress40_stream_fd and compress40_parallel
+   compress every image from now on in n by n blocks: 2, the default,
+   gives format 2 (or 3), and 4 or 8 the integer DCT of format 4, which
+   takes 4 or 2 bits a pixel instead of 8. Format 4 keeps odd rows and
+   columns, is never entropy-coded and is compressed on one thread. Every
+   decompressor reads it, though on one thread as well. */
+extern void compress40_block(unsigned n);
+
+/* Makes compress40_stream, compress40_stream_fd and compress40_parallel
+   write every image from now on in format 5, format 3 with the
+   quantization picked for the image: compress40_budget picks the least
+   error whose file takes at most 'bytes', and compress40_rms the
+   smallest file whose RMS error, on samples scaled to [0, 1], is at most
+   'rms'. If nothing meets the target, the smallest file or the least
+   error is written instead, and compress40_target_met then returns 0
+   until the next image. Each call replaces the other's target, and a
+   target of 0 goes back to format 2 or 3. Format 5 is compressed on one
+   thread; every decompressor reads it. */
+extern void compress40_budget(size_t bytes);
+extern void compress40_rms(double rms);
+extern int  compress40_target_met(void);
+
+/* Makes compress40_stream, compress40_stream_fd and compress40_parallel
+   write every image from now on in the tiled format 6 if 'tile' is not
+   0: the image is cut into 'tile' by 'tile' tiles, each compressed on
+   its own into format 2, or format 3 with compress40_entropy, and an
+   index of where every tile starts follows the header (see tiles40.h).
+   compress40_parallel compresses the tiles on its threads and
+   decompress40_parallel decodes them on its own; decompress40_region
+   reads only the tiles under its rectangle. 'tile' must be even, and 0,
+   the default, goes back to untiled images. */
+extern void compress40_tile(unsigned tile);
+
+/* One file of compress40_batch: the path of its input and the path its
+   output goes to, and, once the batch is done, 0 or the errno of
+   whichever of the two could not be opened or written, and whether it
+   was written in format 5 without meeting its target */
+typedef struct Compress40_file {
+    const char *input, *output;
+    int failed;
+    int missed;
+} Compress40_file;
+
+/* Compresses, or decompresses if 'decompress' is nonzero, each of the
+   'count' files on one of 'threads' worker threads, with the settings
+   above; the output of each file is the same as compress40_stream_fd or
+   decompress40_stream would write. Every worker keeps its buffers from
+   one image to the next, so many small images go through much faster
+   than one process each. A file that cannot be opened or written is
+   marked failed and the batch goes on, but an input that is not an
+   image stops it as it would stop 40image. */
+extern void compress40_batch(Compress40_file *files, size_t count,
+                             unsigned threads, int decompress);
@@ -0,0 +1,1163 @@
+/* dct40.c
+ *
+ * Implementation file for the codec arithmetic in dct40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * The vector kernels reproduce the scalar code operation for operation:
+ * the divide by the denominator is done in float, the color transform is
+ * done in double (the constants are double literals, so C promotes) and
+ * rounded back to float, and the block sums are added in the same order.
+ * No fused multiply-add is used, so every kernel gives the same bits.
+ */
+
+#include "assert.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pnm.h"
+#include "dct40.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DCT40_X86 1
+#endif
+
+const int DENOM = 30000;
+
+/* Blocks the strip functions push through all their stages before
+ * moving on; the component video planes of that many blocks take 3KB,
+ * so they are still in L1 when the next stage reads them
+ */
+#define CHUNK 64
+
+/* Where a pixel kernel puts a row: Pnm_rgb pixels, or packed 8-bit
+ * samples when p is NULL
+ */
+typedef struct Row_out {
+    struct Pnm_rgb *p;
+    unsigned char *p8;
+} Row_out;
+
+/* One kernel per stage: RGB to component video planes, those planes to
+ * block planes, block planes to luma planes and luma plus block chroma
+ * back to a row of pixels
+ */
+typedef void pixels_fun(const struct Pnm_rgb *rgb, unsigned n, float denom,
+                        Dct40_cv_planes cv);
+typedef void blocks_fun(Dct40_cv_planes top, Dct40_cv_planes bottom,
+                        unsigned blocks, Dct40_planes out);
+typedef void luma_fun(Dct40_planes in, unsigned blocks, float *top,
+                      float *bottom);
+typedef void rgb_fun(const float *y, const float *pb, const float *pr,
+                     unsigned blocks, unsigned maxval, Row_out out);
+
+typedef struct Kernels {
+    pixels_fun *pixels;
+    blocks_fun *blocks;
+    luma_fun *luma;
+    rgb_fun *rgb;
+} Kernels;
+
+static pixels_fun pixels_scalar;
+static blocks_fun blocks_scalar;
+static luma_fun luma_scalar;
+static rgb_fun rgb_scalar;
+static const Kernels *kernels(void);
+
+/* pixel_to_CV
+ * Input: A pointer to one RGB pixel, the Component_vid to fill in and
+ *        the denominator of the image the pixel came from
+ * Does:  Converts a single pixel to component video; shared by the
+ *        UArray2 pipeline and the streaming one so both give the same
+ *        floats
+ * Returns: Nothing
+ */
+void pixel_to_CV(Pnm_rgb rgb, Component_vid pixels, float denom)
+{
+    struct Pixel_float float_pix;
+    RGB_to_float(rgb, &float_pix, denom);
+
+    pixels->y = 0.299 * float_pix.red + 0.587 * float_pix.green + 0.114 * float_pix.blue;
+    pixels->pb = -0.168736 * float_pix.red - 0.331264 * float_pix.green + 0.5 * float_pix.blue;
+    pixels->pr = 0.5 * float_pix.red - 0.418688 * float_pix.green - 0.081312 * float_pix.blue;
+}
+
+void RGB_to_float(Pnm_rgb rgb, Pixel_float pix, float denom)
+{
+    float r, g, b;
+
+    r = rgb->red;
+    g = rgb->green;
+    b = rgb->blue;
+
+    r = r / denom;
+    g = g / denom;
+    b = b / denom;
+
+    pix->red = r;
+    pix->green = g;
+    pix->blue = b;
+}
+
+/* block_to_DCT
+ * Input: The four Component_vid pixels of a 2x2 block, in the order
+ *        top left, top right, bottom left, bottom right, and the
+ *        dct_elem to store the result in
+ * Does:  Averages the chroma and computes a, b, c and d for the block
+ * Returns: Nothing
+ */
+void block_to_DCT(Component_vid cv1, Component_vid cv2, Component_vid cv3,
+                  Component_vid cv4, dct_elem element)
+{
+    float pb_sum = 0, pr_sum = 0;
+    float y1, y2, y3, y4;
+
+    pb_sum += cv1->pb;
+    pr_sum += cv1->pr;
+    y1 = cv1->y;
+
+    pb_sum += cv2->pb;
+    pr_sum += cv2->pr;
+    y2 = cv2->y;
+
+    pb_sum += cv3->pb;
+    pr_sum += cv3->pr;
+    y3 = cv3->y;
+
+    pb_sum += cv4->pb;
+    pr_sum += cv4->pr;
+    y4 = cv4->y;
+
+    element->average_pb = pb_sum / 4.0;
+    element->average_pr = pr_sum / 4.0;
+    element->a = (y4 + y3 + y2 + y1) / 4.0;
+    element->b = (y4 + y3 - y2 - y1)/ 4.0;
+    element->c = (y4 - y3 + y2 - y1) / 4.0;
+    element->d = (y4 - y3 - y2 + y1) / 4.0;
+}
+
+/* DCT_to_block
+ * Input: A dct_elem and the four Component_vid pixels of its 2x2 block,
+ *        in the order top left, top right, bottom left, bottom right
+ * Does:  Reconstructs the four luma values and copies the block's chroma
+ *        into each pixel
+ * Returns: Nothing
+ */
+void DCT_to_block(dct_elem dct_element, Component_vid cv1, Component_vid cv2,
+                  Component_vid cv3, Component_vid cv4)
+{
+    float a = dct_element->a;
+    float b = dct_element->b;
+    float c = dct_element->c;
+    float d = dct_element->d;
+
+    cv1->pb = dct_element->average_pb;
+    cv1->pr = dct_element->average_pr;
+    cv1->y = a - b - c + d;
+
+    cv2->pb = dct_element->average_pb;
+    cv2->pr = dct_element->average_pr;
+    cv2->y = a - b + c - d;
+
+    cv3->pb = dct_element->average_pb;
+    cv3->pr = dct_element->average_pr;
+    cv3->y = a + b - c - d;
+
+    cv4->pb = dct_element->average_pb;
+    cv4->pr = dct_element->average_pr;
+    cv4->y = a + b + c + d;
+}
+
+/* round_sample
+ * Input: A channel in [0, 1] and the denominator to scale it to
+ * Does:  Scales it in float and rounds half up
+ * Returns: The sample
+ */
+static inline unsigned round_sample(float x, unsigned maxval)
+{
+    unsigned sample = x * maxval;
+    if (x * maxval - (float)sample >= 0.5) {
+        sample++;
+    }
+    return sample;
+}
+
+/* CV_to_pixel
+ * Input: A Component_vid pixel and the Pnm_rgb to store it in
+ * Does:  Converts one pixel back to RGB, clamps each channel to [0, 1]
+ *        and scales it to DENOM
+ * Returns: Nothing
+ */
+void CV_to_pixel(Component_vid component_pixels, Pnm_rgb rgb_pixels)
+{
+    CV_to_pixel_max(component_pixels, rgb_pixels, DENOM);
+}
+
+/* CV_to_pixel_max
+ * Input: A Component_vid pixel, the Pnm_rgb to store it in and the
+ *        denominator of the output image
+ * Does:  CV_to_pixel, scaling to 'maxval' instead of DENOM
+ * Returns: Nothing
+ */
+void CV_to_pixel_max(Component_vid component_pixels, Pnm_rgb rgb_pixels,
+                     unsigned maxval)
+{
+    struct Pixel_float float_pixels;
+
+    float_pixels.red = (float)1.0 * component_pixels->y + (float)0.0 * component_pixels->pb + (float)1.402 * component_pixels->pr;
+    float_pixels.green = (float)1.0 * component_pixels->y - (float)0.344136 * component_pixels->pb - (float)0.714136 * component_pixels->pr;
+    float_pixels.blue = (float)1.0 * component_pixels->y + (float)1.772 * component_pixels->pb + (float)0.0 * component_pixels->pr;
+
+    if (float_pixels.red > 1.0) {
+        float_pixels.red = 1.0;
+    }
+    if (float_pixels.red < 0){
+        float_pixels.red = 0.0;
+    }
+    if (float_pixels.blue > 1.0) {
+        float_pixels.blue = 1.0;
+    }
+    if (float_pixels.blue < 0){
+        float_pixels.blue = 0.0;
+    }
+    if (float_pixels.green > 1.0) {
+        float_pixels.green = 1.0;
+    }
+    if (float_pixels.green < 0){
+        float_pixels.green = 0.0;
+    }
+
+    rgb_pixels->red = round_sample(float_pixels.red, maxval);
+    rgb_pixels->green = round_sample(float_pixels.green, maxval);
+    rgb_pixels->blue = round_sample(float_pixels.blue, maxval);
+}
+
+void float_to_RGB(Pnm_rgb rgb, Pixel_float pix)
+{
+    rgb->red = round_sample(pix->red, DENOM);
+    rgb->green = round_sample(pix->green, DENOM);
+    rgb->blue = round_sample(pix->blue, DENOM);
+}
+
+/*
+ * Function: Dct40_pixels_to_CV
+ * Purpose: pixel_to_CV on n adjacent pixels; keeping the loop in this
+ *          file lets the compiler inline the per-pixel work
+ * Parameters: n pixels, room for n Component_vids, n and the denominator
+ * Returns: Nothing
+ */
+void Dct40_pixels_to_CV(const struct Pnm_rgb *rgb, struct Component_vid *cv,
+                        unsigned n, float denom)
+{
+    for (unsigned k = 0; k < n; k++) {
+        pixel_to_CV((Pnm_rgb)&rgb[k], &cv[k], denom);
+    }
+}
+
+/*
+ * Function: Dct40_raw_to_CV
+ * Purpose: pixel_to_CV on n adjacent pixels of raw P6 samples, so that
+ *          the compressor can work straight from a mapped file
+ * Parameters: n pixels of raw samples and the size of one sample, room
+ *             for n Component_vids, n and the denominator
+ * Returns: Nothing
+ */
+void Dct40_raw_to_CV(const unsigned char *raw, unsigned sample_bytes,
+                     struct Component_vid *cv, unsigned n, float denom)
+{
+    struct Pnm_rgb rgb;
+
+    if (sample_bytes == 1) {
+        for (unsigned k = 0; k < n; k++, raw += 3) {
+            rgb.red = raw[0];
+            rgb.green = raw[1];
+            rgb.blue = raw[2];
+            pixel_to_CV(&rgb, &cv[k], denom);
+        }
+        return;
+    }
+    for (unsigned k = 0; k < n; k++, raw += 6) {
+        rgb.red = (raw[0] << 8) | raw[1];
+        rgb.green = (raw[2] << 8) | raw[3];
+        rgb.blue = (raw[4] << 8) | raw[5];
+        pixel_to_CV(&rgb, &cv[k], denom);
+    }
+}
+
+/*
+ * Function: Dct40_CV_to_pixels
+ * Purpose: CV_to_pixel_max on n adjacent pixels
+ * Parameters: n Component_vids, room for n pixels, n and the output
+ *             denominator
+ * Returns: Nothing
+ */
+void Dct40_CV_to_pixels(const struct Component_vid *cv, struct Pnm_rgb *rgb,
+                        unsigned n, unsigned maxval)
+{
+    for (unsigned k = 0; k < n; k++) {
+        CV_to_pixel_max((Component_vid)&cv[k], &rgb[k], maxval);
+    }
+}
+
+/*
+ * Function: Dct40_CV_to_DCT
+ * Purpose: block_to_DCT on a run of adjacent blocks, whose pixels are
+ *          the first 2 * blocks entries of 'top' and 'bottom'
+ * Parameters: The two rows of Component_vids, the number of blocks and
+ *             room for that many dct_elems
+ * Returns: Nothing
+ */
+void Dct40_CV_to_DCT(const struct Component_vid *top,
+                     const struct Component_vid *bottom,
+                     unsigned blocks, struct dct_elem *out)
+{
+    for (unsigned k = 0; k < blocks; k++) {
+        block_to_DCT((Component_vid)&top[2 * k],
+                     (Component_vid)&top[2 * k + 1],
+                     (Component_vid)&bottom[2 * k],
+                     (Component_vid)&bottom[2 * k + 1], &out[k]);
+    }
+}
+
+/*
+ * Function: Dct40_DCT_to_CV
+ * Purpose: DCT_to_block on a run of adjacent blocks, the inverse of
+ *          Dct40_CV_to_DCT
+ * Parameters: The dct_elems, their number and the two rows of
+ *             Component_vids to fill in
+ * Returns: Nothing
+ */
+void Dct40_DCT_to_CV(const struct dct_elem *in, unsigned blocks,
+                     struct Component_vid *top, struct Component_vid *bottom)
+{
+    for (unsigned k = 0; k < blocks; k++) {
+        DCT_to_block((dct_elem)&in[k], &top[2 * k], &top[2 * k + 1],
+                     &bottom[2 * k], &bottom[2 * k + 1]);
+    }
+}
+
+/*
+ * Function: Dct40_planes_new
+ * Purpose: Allocates the six planes of a run of blocks in one piece, in
+ *          the order pb, pr, a, b, c, d
+ * Parameters: The number of blocks
+ * Returns: The planes, to be released with Dct40_planes_free
+ */
+Dct40_planes Dct40_planes_new(unsigned blocks)
+{
+    float *floats = malloc(6 * (size_t)blocks * sizeof(*floats) + 1);
+    assert(floats != NULL);
+
+    Dct40_planes planes = {
+        floats, floats + blocks, floats + 2 * (size_t)blocks,
+        floats + 3 * (size_t)blocks, floats + 4 * (size_t)blocks,
+        floats + 5 * (size_t)blocks
+    };
+    return planes;
+}
+
+/* Dct40_planes_free
+ * Input: Planes made by Dct40_planes_new
+ * Does:  Frees them and clears every plane pointer
+ * Returns: Nothing
+ */
+void Dct40_planes_free(Dct40_planes *planes)
+{
+    assert(planes != NULL);
+    free(planes->pb);
+
+    Dct40_planes empty = { NULL, NULL, NULL, NULL, NULL, NULL };
+    *planes = empty;
+}
+
+/* 'cv' moved right by k pixels */
+static inline Dct40_cv_planes cv_advance(Dct40_cv_planes cv, unsigned k)
+{
+    Dct40_cv_planes moved = { cv.y + k, cv.pb + k, cv.pr + k };
+    return moved;
+}
+
+/* 'planes' moved right by k blocks */
+static inline Dct40_planes planes_advance(Dct40_planes planes, unsigned k)
+{
+    Dct40_planes moved = {
+        planes.pb + k, planes.pr + k, planes.a + k,
+        planes.b + k, planes.c + k, planes.d + k
+    };
+    return moved;
+}
+
+/* 'out' moved right by k pixels */
+static inline Row_out row_advance(Row_out out, unsigned k)
+{
+    if (out.p != NULL) {
+        out.p += k;
+    } else {
+        out.p8 += 3 * k;
+    }
+    return out;
+}
+
+/*
+ * Function: Dct40_pixels_to_planes
+ * Purpose: pixel_to_CV on n adjacent pixels, with the results stored as
+ *          Y, Pb and Pr planes
+ * Parameters: n pixels, n, the image denominator and planes with room
+ *             for n floats each
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL
+ */
+void Dct40_pixels_to_planes(const struct Pnm_rgb *rgb, unsigned n,
+                            float denom, Dct40_cv_planes cv)
+{
+    assert(rgb != NULL && cv.y != NULL && cv.pb != NULL && cv.pr != NULL);
+    kernels()->pixels(rgb, n, denom, cv);
+}
+
+/*
+ * Function: Dct40_planes_to_blocks
+ * Purpose: block_to_DCT on the blocks of two rows of component video
+ *          planes; block k covers pixels 2k and 2k+1 of both rows
+ * Parameters: The top and bottom rows (2 * blocks pixels each), the
+ *             number of blocks and planes with room for that many blocks
+ * Returns: Nothing
+ */
+void Dct40_planes_to_blocks(Dct40_cv_planes top, Dct40_cv_planes bottom,
+                            unsigned blocks, Dct40_planes out)
+{
+    kernels()->blocks(top, bottom, blocks, out);
+}
+
+/*
+ * Function: Dct40_blocks_to_luma
+ * Purpose: The luma half of DCT_to_block on a run of blocks; the chroma
+ *          of every pixel is just the chroma of its block, so it stays
+ *          in the block planes
+ * Parameters: The block planes, their number and the top and bottom
+ *             luma rows (2 * blocks floats each) to fill in
+ * Returns: Nothing
+ */
+void Dct40_blocks_to_luma(Dct40_planes in, unsigned blocks, float *top,
+                          float *bottom)
+{
+    assert(top != NULL && bottom != NULL);
+    kernels()->luma(in, blocks, top, bottom);
+}
+
+/*
+ * Function: Dct40_luma_to_pixels
+ * Purpose: CV_to_pixel_max on one row of 'blocks' blocks, where pixels
+ *          2k and 2k+1 take their chroma from pb[k] and pr[k]
+ * Parameters: 2 * blocks luma values, the Pb and Pr planes of the
+ *             blocks, the number of blocks, the output denominator and
+ *             room for 2 * blocks pixels
+ * Returns: Nothing
+ * Expectations: maxval is from 1 to 65535
+ */
+void Dct40_luma_to_pixels(const float *y, const float *pb, const float *pr,
+                          unsigned blocks, unsigned maxval,
+                          struct Pnm_rgb *rgb)
+{
+    assert(y != NULL && pb != NULL && pr != NULL && rgb != NULL);
+    assert(maxval > 0 && maxval <= 65535);
+
+    Row_out out = { rgb, NULL };
+    kernels()->rgb(y, pb, pr, blocks, maxval, out);
+}
+
+/*
+ * Function: Dct40_luma_to_bytes
+ * Purpose: Dct40_luma_to_pixels with a denominator of 255, storing each
+ *          pixel as three bytes, the way a raw PPM does
+ * Parameters: As Dct40_luma_to_pixels, with 6 * blocks bytes for the row
+ * Returns: Nothing
+ */
+void Dct40_luma_to_bytes(const float *y, const float *pb, const float *pr,
+                         unsigned blocks, unsigned char *raw)
+{
+    assert(y != NULL && pb != NULL && pr != NULL && raw != NULL);
+
+    Row_out out = { NULL, raw };
+    kernels()->rgb(y, pb, pr, blocks, 255, out);
+}
+
+/*
+ * Function: Dct40_forward
+ * Purpose: Converts a strip of 2x2 blocks from RGB to DCT coefficients,
+ *          CHUNK blocks at a time through Dct40_pixels_to_planes and
+ *          Dct40_planes_to_blocks
+ * Parameters: The top and bottom rows of the strip (2 * blocks pixels
+ *             each), the number of blocks, the image denominator and
+ *             planes with room for 'blocks' blocks
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL
+ */
+void Dct40_forward(const struct Pnm_rgb *top, const struct Pnm_rgb *bottom,
+                   unsigned blocks, float denom, Dct40_planes out)
+{
+    const Kernels *kern = kernels();
+    float cv[2][3][2 * CHUNK];
+    Dct40_cv_planes cv_top = { cv[0][0], cv[0][1], cv[0][2] };
+    Dct40_cv_planes cv_bottom = { cv[1][0], cv[1][1], cv[1][2] };
+
+    assert(top != NULL && bottom != NULL);
+    for (unsigned k = 0; k < blocks; k += CHUNK) {
+        unsigned n = blocks - k < CHUNK ? blocks - k : CHUNK;
+        kern->pixels(top + 2 * k, 2 * n, denom, cv_top);
+        kern->pixels(bottom + 2 * k, 2 * n, denom, cv_bottom);
+        kern->blocks(cv_top, cv_bottom, n, planes_advance(out, k));
+    }
+}
+
+/* Shared body of Dct40_inverse and Dct40_inverse_bytes */
+static void inverse_strip(Dct40_planes in, unsigned blocks, unsigned maxval,
+                          Row_out top, Row_out bottom)
+{
+    const Kernels *kern = kernels();
+    float y_top[2 * CHUNK], y_bottom[2 * CHUNK];
+
+    for (unsigned k = 0; k < blocks; k += CHUNK) {
+        unsigned n = blocks - k < CHUNK ? blocks - k : CHUNK;
+        Dct40_planes chunk = planes_advance(in, k);
+        kern->luma(chunk, n, y_top, y_bottom);
+        kern->rgb(y_top, chunk.pb, chunk.pr, n, maxval,
+                  row_advance(top, 2 * k));
+        kern->rgb(y_bottom, chunk.pb, chunk.pr, n, maxval,
+                  row_advance(bottom, 2 * k));
+    }
+}
+
+/*
+ * Function: Dct40_inverse
+ * Purpose: Converts a row of DCT blocks back to a 2-row strip of RGB
+ *          pixels scaled to 'maxval', CHUNK blocks at a time through
+ *          Dct40_blocks_to_luma and Dct40_luma_to_pixels
+ * Parameters: The planes of 'blocks' blocks, the number of blocks, the
+ *             top and bottom rows of the strip (2 * blocks pixels each)
+ *             to fill in and the output denominator
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL; maxval is from 1 to 65535
+ */
+void Dct40_inverse(Dct40_planes in, unsigned blocks, struct Pnm_rgb *top,
+                   struct Pnm_rgb *bottom, unsigned maxval)
+{
+    assert(top != NULL && bottom != NULL);
+    assert(maxval > 0 && maxval <= 65535);
+
+    Row_out out_top = { top, NULL };
+    Row_out out_bottom = { bottom, NULL };
+    inverse_strip(in, blocks, maxval, out_top, out_bottom);
+}
+
+/*
+ * Function: Dct40_inverse_bytes
+ * Purpose: Dct40_inverse with a denominator of 255, storing each pixel
+ *          as three bytes, the way a raw PPM does, so that the rows can
+ *          be written out with no packing step
+ * Parameters: The planes of 'blocks' blocks, the number of blocks and
+ *             the top and bottom rows of the strip (6 * blocks bytes
+ *             each) to fill in
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL
+ */
+void Dct40_inverse_bytes(Dct40_planes in, unsigned blocks,
+                         unsigned char *top, unsigned char *bottom)
+{
+    assert(top != NULL && bottom != NULL);
+
+    Row_out out_top = { NULL, top };
+    Row_out out_bottom = { NULL, bottom };
+    inverse_strip(in, blocks, 255, out_top, out_bottom);
+}
+
+/* Stores pixel k of 'out' */
+static inline void put_pixel(Row_out out, unsigned k,
+                             const struct Pnm_rgb *pixel)
+{
+    if (out.p != NULL) {
+        out.p[k] = *pixel;
+    } else {
+        out.p8[3 * k] = pixel->red;
+        out.p8[3 * k + 1] = pixel->green;
+        out.p8[3 * k + 2] = pixel->blue;
+    }
+}
+
+/* Reference kernels: one pixel or block at a time through the functions
+ * above
+ */
+static void pixels_scalar(const struct Pnm_rgb *rgb, unsigned n, float denom,
+                          Dct40_cv_planes cv)
+{
+    for (unsigned k = 0; k < n; k++) {
+        struct Component_vid pixel;
+        pixel_to_CV((Pnm_rgb)&rgb[k], &pixel, denom);
+        cv.y[k] = pixel.y;
+        cv.pb[k] = pixel.pb;
+        cv.pr[k] = pixel.pr;
+    }
+}
+
+static void blocks_scalar(Dct40_cv_planes top, Dct40_cv_planes bottom,
+                          unsigned blocks, Dct40_planes out)
+{
+    for (unsigned k = 0; k < blocks; k++) {
+        unsigned l = 2 * k, r = 2 * k + 1;
+        struct Component_vid cv1 = { top.y[l], top.pb[l], top.pr[l] };
+        struct Component_vid cv2 = { top.y[r], top.pb[r], top.pr[r] };
+        struct Component_vid cv3 = { bottom.y[l], bottom.pb[l],
+                                     bottom.pr[l] };
+        struct Component_vid cv4 = { bottom.y[r], bottom.pb[r],
+                                     bottom.pr[r] };
+        struct dct_elem element;
+        block_to_DCT(&cv1, &cv2, &cv3, &cv4, &element);
+
+        out.pb[k] = element.average_pb;
+        out.pr[k] = element.average_pr;
+        out.a[k] = element.a;
+        out.b[k] = element.b;
+        out.c[k] = element.c;
+        out.d[k] = element.d;
+    }
+}
+
+static void luma_scalar(Dct40_planes in, unsigned blocks, float *top,
+                        float *bottom)
+{
+    for (unsigned k = 0; k < blocks; k++) {
+        struct dct_elem element = {
+            in.pb[k], in.pr[k], in.a[k], in.b[k], in.c[k], in.d[k]
+        };
+        struct Component_vid cv1, cv2, cv3, cv4;
+        DCT_to_block(&element, &cv1, &cv2, &cv3, &cv4);
+
+        top[2 * k] = cv1.y;
+        top[2 * k + 1] = cv2.y;
+        bottom[2 * k] = cv3.y;
+        bottom[2 * k + 1] = cv4.y;
+    }
+}
+
+static void rgb_scalar(const float *y, const float *pb, const float *pr,
+                       unsigned blocks, unsigned maxval, Row_out out)
+{
+    for (unsigned k = 0; k < 2 * blocks; k++) {
+        struct Component_vid cv = { y[k], pb[k / 2], pr[k / 2] };
+        struct Pnm_rgb pixel;
+        CV_to_pixel_max(&cv, &pixel, maxval);
+        put_pixel(out, k, &pixel);
+    }
+}
+
+#ifdef DCT40_X86
+
+/* Weights of the RGB to component video transform, one row per output */
+static const double CV_weights[3][3] = {
+    {  0.299,     0.587,     0.114    },
+    { -0.168736, -0.331264,  0.5      },
+    {  0.5,      -0.418688, -0.081312 },
+};
+
+/*
+ * Every stage reads and writes whole vectors of a plane with unit
+ * stride. A block stage splits a row plane into its even and odd pixels
+ * (the left and right halves of each block) or merges them back, which
+ * is a shuffle in registers. The only strided access left is reading
+ * and writing the interleaved RGB pixels themselves.
+ *
+ * The inverse kernels compute each channel as the scalar CV_to_pixel does,
+ * in float. Its (float)0.0 terms can only change the sign of a zero,
+ * which the clamp to [0, 1] throws away, so they are left out. Clamping
+ * is a min and a max, and rounding half up is a truncating convert plus
+ * a compare on the fraction, exactly as float_to_RGB does it.
+ */
+
+/* Writes n channel vectors to pixels 0 to n - 1 of 'out' */
+static void store_pixels(Row_out out, unsigned n, const int *r, const int *g,
+                         const int *b)
+{
+    if (out.p == NULL) {
+        for (unsigned l = 0; l < n; l++) {
+            out.p8[3 * l] = r[l];
+            out.p8[3 * l + 1] = g[l];
+            out.p8[3 * l + 2] = b[l];
+        }
+        return;
+    }
+    for (unsigned l = 0; l < n; l++) {
+        out.p[l].red = r[l];
+        out.p[l].green = g[l];
+        out.p[l].blue = b[l];
+    }
+}
+
+/****************************** SSE2, 4 lanes ****************************/
+
+__attribute__((target("sse2")))
+static inline __m128 sse2_weigh(__m128 r, __m128 g, __m128 b,
+                                const double *w)
+{
+    __m128d kr = _mm_set1_pd(w[0]);
+    __m128d kg = _mm_set1_pd(w[1]);
+    __m128d kb = _mm_set1_pd(w[2]);
+    __m128d half[2];
+
+    for (int h = 0; h < 2; h++) {
+        __m128d rd = _mm_cvtps_pd(h ? _mm_movehl_ps(r, r) : r);
+        __m128d gd = _mm_cvtps_pd(h ? _mm_movehl_ps(g, g) : g);
+        __m128d bd = _mm_cvtps_pd(h ? _mm_movehl_ps(b, b) : b);
+        half[h] = _mm_add_pd(_mm_add_pd(_mm_mul_pd(kr, rd),
+                                        _mm_mul_pd(kg, gd)),
+                             _mm_mul_pd(kb, bd));
+    }
+    return _mm_movelh_ps(_mm_cvtpd_ps(half[0]), _mm_cvtpd_ps(half[1]));
+}
+
+__attribute__((target("sse2")))
+static void pixels_sse2(const struct Pnm_rgb *rgb, unsigned n, float denom,
+                        Dct40_cv_planes cv)
+{
+    __m128 vdenom = _mm_set1_ps(denom);
+    unsigned k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+        const struct Pnm_rgb *p = rgb + k;
+        __m128 r = _mm_cvtepi32_ps(_mm_setr_epi32(p[0].red, p[1].red,
+                                                  p[2].red, p[3].red));
+        __m128 g = _mm_cvtepi32_ps(_mm_setr_epi32(p[0].green, p[1].green,
+                                                  p[2].green, p[3].green));
+        __m128 b = _mm_cvtepi32_ps(_mm_setr_epi32(p[0].blue, p[1].blue,
+                                                  p[2].blue, p[3].blue));
+        r = _mm_div_ps(r, vdenom);
+        g = _mm_div_ps(g, vdenom);
+        b = _mm_div_ps(b, vdenom);
+        _mm_storeu_ps(cv.y + k, sse2_weigh(r, g, b, CV_weights[0]));
+        _mm_storeu_ps(cv.pb + k, sse2_weigh(r, g, b, CV_weights[1]));
+        _mm_storeu_ps(cv.pr + k, sse2_weigh(r, g, b, CV_weights[2]));
+    }
+    pixels_scalar(rgb + k, n - k, denom, cv_advance(cv, k));
+}
+
+/* Loads 8 floats of a row plane as its 4 even and 4 odd pixels */
+__attribute__((target("sse2")))
+static inline void sse2_split(const float *p, __m128 *even, __m128 *odd)
+{
+    __m128 lo = _mm_loadu_ps(p);
+    __m128 hi = _mm_loadu_ps(p + 4);
+    *even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+/* Stores 4 even and 4 odd pixels as 8 floats of a row plane */
+__attribute__((target("sse2")))
+static inline void sse2_merge(float *p, __m128 even, __m128 odd)
+{
+    _mm_storeu_ps(p, _mm_unpacklo_ps(even, odd));
+    _mm_storeu_ps(p + 4, _mm_unpackhi_ps(even, odd));
+}
+
+/* The chroma average of 4 blocks, summed in block_to_DCT's order */
+__attribute__((target("sse2")))
+static inline __m128 sse2_average(const float *top, const float *bottom)
+{
+    __m128 c1, c2, c3, c4;
+    sse2_split(top, &c1, &c2);
+    sse2_split(bottom, &c3, &c4);
+
+    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                    _mm_add_ps(_mm_setzero_ps(), c1), c2), c3), c4);
+    return _mm_mul_ps(sum, _mm_set1_ps(0.25f));
+}
+
+__attribute__((target("sse2")))
+static void blocks_sse2(Dct40_cv_planes top, Dct40_cv_planes bottom,
+                        unsigned blocks, Dct40_planes out)
+{
+    __m128 quarter = _mm_set1_ps(0.25f);
+    unsigned k = 0;
+
+    for (; k + 4 <= blocks; k += 4) {
+        __m128 y1, y2, y3, y4;
+        sse2_split(top.y + 2 * k, &y1, &y2);
+        sse2_split(bottom.y + 2 * k, &y3, &y4);
+        _mm_storeu_ps(out.pb + k, sse2_average(top.pb + 2 * k,
+                                               bottom.pb + 2 * k));
+        _mm_storeu_ps(out.pr + k, sse2_average(top.pr + 2 * k,
+                                               bottom.pr + 2 * k));
+
+        __m128 y43 = _mm_add_ps(y4, y3);
+        __m128 y4m3 = _mm_sub_ps(y4, y3);
+        _mm_storeu_ps(out.a + k, _mm_mul_ps(_mm_add_ps(_mm_add_ps(y43, y2),
+                                                       y1), quarter));
+        _mm_storeu_ps(out.b + k, _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(y43, y2),
+                                                       y1), quarter));
+        _mm_storeu_ps(out.c + k, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(y4m3, y2),
+                                                       y1), quarter));
+        _mm_storeu_ps(out.d + k, _mm_mul_ps(_mm_add_ps(_mm_sub_ps(y4m3, y2),
+                                                       y1), quarter));
+    }
+    blocks_scalar(cv_advance(top, 2 * k), cv_advance(bottom, 2 * k),
+                  blocks - k, planes_advance(out, k));
+}
+
+__attribute__((target("sse2")))
+static void luma_sse2(Dct40_planes in, unsigned blocks, float *top,
+                      float *bottom)
+{
+    unsigned k = 0;
+
+    for (; k + 4 <= blocks; k += 4) {
+        __m128 a = _mm_loadu_ps(in.a + k);
+        __m128 b = _mm_loadu_ps(in.b + k);
+        __m128 c = _mm_loadu_ps(in.c + k);
+        __m128 d = _mm_loadu_ps(in.d + k);
+
+        __m128 amb = _mm_sub_ps(a, b);
+        __m128 apb = _mm_add_ps(a, b);
+        sse2_merge(top + 2 * k, _mm_add_ps(_mm_sub_ps(amb, c), d),
+                   _mm_sub_ps(_mm_add_ps(amb, c), d));
+        sse2_merge(bottom + 2 * k, _mm_sub_ps(_mm_sub_ps(apb, c), d),
+                   _mm_add_ps(_mm_add_ps(apb, c), d));
+    }
+    luma_scalar(planes_advance(in, k), blocks - k, top + 2 * k,
+                bottom + 2 * k);
+}
+
+/* Clamps to [0, 1], scales to the denominator and rounds half up */
+__attribute__((target("sse2")))
+static inline __m128i sse2_sample(__m128 x, __m128 maxval)
+{
+    x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(1.0f)), _mm_setzero_ps());
+    __m128 scaled = _mm_mul_ps(x, maxval);
+    __m128i whole = _mm_cvttps_epi32(scaled);
+    __m128 frac = _mm_sub_ps(scaled, _mm_cvtepi32_ps(whole));
+
+    /* The compare gives -1 in every lane that rounds up */
+    __m128 up = _mm_cmpge_ps(frac, _mm_set1_ps(0.5f));
+    return _mm_sub_epi32(whole, _mm_castps_si128(up));
+}
+
+/* Chroma of 2 blocks, each repeated for the 2 pixels of a block row */
+__attribute__((target("sse2")))
+static inline __m128 sse2_pairs(const float *chroma)
+{
+    __m128 two = _mm_castpd_ps(_mm_load_sd((const double *)chroma));
+    return _mm_unpacklo_ps(two, two);
+}
+
+__attribute__((target("sse2")))
+static void rgb_sse2(const float *y, const float *pb, const float *pr,
+                     unsigned blocks, unsigned maxval, Row_out out)
+{
+    __m128 scale = _mm_set1_ps(maxval);
+    unsigned k = 0;
+
+    for (; k + 2 <= blocks; k += 2) {
+        __m128 luma = _mm_loadu_ps(y + 2 * k);
+        __m128 cb = sse2_pairs(pb + k);
+        __m128 cr = sse2_pairs(pr + k);
+
+        int r[4], g[4], b[4];
+        __m128 red = _mm_add_ps(luma, _mm_mul_ps(
+                _mm_set1_ps((float)1.402), cr));
+        __m128 green = _mm_sub_ps(_mm_sub_ps(luma, _mm_mul_ps(
+                _mm_set1_ps((float)0.344136), cb)), _mm_mul_ps(
+                _mm_set1_ps((float)0.714136), cr));
+        __m128 blue = _mm_add_ps(luma, _mm_mul_ps(
+                _mm_set1_ps((float)1.772), cb));
+
+        _mm_storeu_si128((__m128i *)r, sse2_sample(red, scale));
+        _mm_storeu_si128((__m128i *)g, sse2_sample(green, scale));
+        _mm_storeu_si128((__m128i *)b, sse2_sample(blue, scale));
+        store_pixels(row_advance(out, 2 * k), 4, r, g, b);
+    }
+    rgb_scalar(y + 2 * k, pb + k, pr + k, blocks - k, maxval,
+               row_advance(out, 2 * k));
+}
+
+/****************************** AVX2, 8 lanes ****************************/
+
+/*
+ * Each AVX2 kernel ends with _mm256_zeroupper: dirty upper halves make
+ * every later SSE instruction (libm's round, for one) pay a
+ * state-transition penalty.
+ */
+
+__attribute__((target("avx2")))
+static inline __m256 avx2_weigh(__m256 r, __m256 g, __m256 b,
+                                const double *w)
+{
+    __m256d kr = _mm256_set1_pd(w[0]);
+    __m256d kg = _mm256_set1_pd(w[1]);
+    __m256d kb = _mm256_set1_pd(w[2]);
+    __m128 half[2];
+
+    for (int h = 0; h < 2; h++) {
+        __m256d rd = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(r, 1)
+                                       : _mm256_castps256_ps128(r));
+        __m256d gd = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(g, 1)
+                                       : _mm256_castps256_ps128(g));
+        __m256d bd = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(b, 1)
+                                       : _mm256_castps256_ps128(b));
+        half[h] = _mm256_cvtpd_ps(
+                _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(kr, rd),
+                                            _mm256_mul_pd(kg, gd)),
+                              _mm256_mul_pd(kb, bd)));
+    }
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(half[0]), half[1], 1);
+}
+
+__attribute__((target("avx2")))
+static void pixels_avx2(const struct Pnm_rgb *rgb, unsigned n, float denom,
+                        Dct40_cv_planes cv)
+{
+    __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    __m256 vdenom = _mm256_set1_ps(denom);
+    unsigned k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+        const int *base = (const int *)(rgb + k);
+        __m256 r = _mm256_cvtepi32_ps(_mm256_i32gather_epi32(base, stride,
+                                                             4));
+        __m256 g = _mm256_cvtepi32_ps(_mm256_i32gather_epi32(base + 1,
+                                                             stride, 4));
+        __m256 b = _mm256_cvtepi32_ps(_mm256_i32gather_epi32(base + 2,
+                                                             stride, 4));
+        r = _mm256_div_ps(r, vdenom);
+        g = _mm256_div_ps(g, vdenom);
+        b = _mm256_div_ps(b, vdenom);
+        _mm256_storeu_ps(cv.y + k, avx2_weigh(r, g, b, CV_weights[0]));
+        _mm256_storeu_ps(cv.pb + k, avx2_weigh(r, g, b, CV_weights[1]));
+        _mm256_storeu_ps(cv.pr + k, avx2_weigh(r, g, b, CV_weights[2]));
+    }
+
+    _mm256_zeroupper();
+    pixels_sse2(rgb + k, n - k, denom, cv_advance(cv, k));
+}
+
+/* Loads 16 floats of a row plane as its 8 even and 8 odd pixels */
+__attribute__((target("avx2")))
+static inline void avx2_split(const float *p, __m256 *even, __m256 *odd)
+{
+    __m256 lo = _mm256_loadu_ps(p);
+    __m256 hi = _mm256_loadu_ps(p + 8);
+
+    /* Shuffles stay within 128-bit lanes, which leaves the pixels in
+     * the order 0 1 4 5 2 3 6 7 until the pairs are permuted back
+     */
+    __m256 e = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 o = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+    *even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(e),
+                                                   _MM_SHUFFLE(3, 1, 2, 0)));
+    *odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(o),
+                                                  _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+/* Stores 8 even and 8 odd pixels as 16 floats of a row plane */
+__attribute__((target("avx2")))
+static inline void avx2_merge(float *p, __m256 even, __m256 odd)
+{
+    __m256 lo = _mm256_unpacklo_ps(even, odd);
+    __m256 hi = _mm256_unpackhi_ps(even, odd);
+    _mm256_storeu_ps(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(p + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 avx2_average(const float *top, const float *bottom)
+{
+    __m256 c1, c2, c3, c4;
+    avx2_split(top, &c1, &c2);
+    avx2_split(bottom, &c3, &c4);
+
+    __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_add_ps(_mm256_setzero_ps(), c1), c2), c3), c4);
+    return _mm256_mul_ps(sum, _mm256_set1_ps(0.25f));
+}
+
+__attribute__((target("avx2")))
+static void blocks_avx2(Dct40_cv_planes top, Dct40_cv_planes bottom,
+                        unsigned blocks, Dct40_planes out)
+{
+    __m256 quarter = _mm256_set1_ps(0.25f);
+    unsigned k = 0;
+
+    for (; k + 8 <= blocks; k += 8) {
+        __m256 y1, y2, y3, y4;
+        avx2_split(top.y + 2 * k, &y1, &y2);
+        avx2_split(bottom.y + 2 * k, &y3, &y4);
+        _mm256_storeu_ps(out.pb + k, avx2_average(top.pb + 2 * k,
+                                                  bottom.pb + 2 * k));
+        _mm256_storeu_ps(out.pr + k, avx2_average(top.pr + 2 * k,
+                                                  bottom.pr + 2 * k));
+
+        __m256 y43 = _mm256_add_ps(y4, y3);
+        __m256 y4m3 = _mm256_sub_ps(y4, y3);
+        _mm256_storeu_ps(out.a + k, _mm256_mul_ps(_mm256_add_ps(
+                _mm256_add_ps(y43, y2), y1), quarter));
+        _mm256_storeu_ps(out.b + k, _mm256_mul_ps(_mm256_sub_ps(
+                _mm256_sub_ps(y43, y2), y1), quarter));
+        _mm256_storeu_ps(out.c + k, _mm256_mul_ps(_mm256_sub_ps(
+                _mm256_add_ps(y4m3, y2), y1), quarter));
+        _mm256_storeu_ps(out.d + k, _mm256_mul_ps(_mm256_add_ps(
+                _mm256_sub_ps(y4m3, y2), y1), quarter));
+    }
+
+    _mm256_zeroupper();
+    blocks_sse2(cv_advance(top, 2 * k), cv_advance(bottom, 2 * k),
+                blocks - k, planes_advance(out, k));
+}
+
+__attribute__((target("avx2")))
+static void luma_avx2(Dct40_planes in, unsigned blocks, float *top,
+                      float *bottom)
+{
+    unsigned k = 0;
+
+    for (; k + 8 <= blocks; k += 8) {
+        __m256 a = _mm256_loadu_ps(in.a + k);
+        __m256 b = _mm256_loadu_ps(in.b + k);
+        __m256 c = _mm256_loadu_ps(in.c + k);
+        __m256 d = _mm256_loadu_ps(in.d + k);
+
+        __m256 amb = _mm256_sub_ps(a, b);
+        __m256 apb = _mm256_add_ps(a, b);
+        avx2_merge(top + 2 * k, _mm256_add_ps(_mm256_sub_ps(amb, c), d),
+                   _mm256_sub_ps(_mm256_add_ps(amb, c), d));
+        avx2_merge(bottom + 2 * k, _mm256_sub_ps(_mm256_sub_ps(apb, c), d),
+                   _mm256_add_ps(_mm256_add_ps(apb, c), d));
+    }
+
+    _mm256_zeroupper();
+    luma_sse2(planes_advance(in, k), blocks - k, top + 2 * k,
+              bottom + 2 * k);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_sample(__m256 x, __m256 maxval)
+{
+    x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(1.0f)),
+                      _mm256_setzero_ps());
+    __m256 scaled = _mm256_mul_ps(x, maxval);
+    __m256i whole = _mm256_cvttps_epi32(scaled);
+    __m256 frac = _mm256_sub_ps(scaled, _mm256_cvtepi32_ps(whole));
+    __m256 up = _mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+    return _mm256_sub_epi32(whole, _mm256_castps_si256(up));
+}
+
+/* Chroma of 4 blocks, each repeated for the 2 pixels of a block row */
+__attribute__((target("avx2")))
+static inline __m256 avx2_pairs(const float *chroma)
+{
+    __m256i repeat = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    __m256 four = _mm256_castps128_ps256(_mm_loadu_ps(chroma));
+    return _mm256_permutevar8x32_ps(four, repeat);
+}
+
+/* Stores 8 pixels of 8-bit samples as 24 bytes of a raw PPM row */
+__attribute__((target("avx2")))
+static inline void avx2_store_bytes(unsigned char *p8, __m256i r, __m256i g,
+                                    __m256i b)
+{
+    /* Each 32-bit lane becomes the bytes r g b 0, and a byte shuffle
+     * then drops the zeros from the 4 pixels of each 128-bit lane
+     */
+    __m256i rgb0 = _mm256_or_si256(_mm256_or_si256(r,
+            _mm256_slli_epi32(g, 8)), _mm256_slli_epi32(b, 16));
+    __m256i packed = _mm256_shuffle_epi8(rgb0, _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    __m128i lo = _mm256_castsi256_si128(packed);
+    __m128i hi = _mm256_extracti128_si256(packed, 1);
+    uint32_t word;
+
+    _mm_storel_epi64((__m128i *)p8, lo);
+    word = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+    memcpy(p8 + 8, &word, 4);
+    _mm_storel_epi64((__m128i *)(p8 + 12), hi);
+    word = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+    memcpy(p8 + 20, &word, 4);
+}
+
+__attribute__((target("avx2")))
+static void rgb_avx2(const float *y, const float *pb, const float *pr,
+                     unsigned blocks, unsigned maxval, Row_out out)
+{
+    __m256 scale = _mm256_set1_ps(maxval);
+    unsigned k = 0;
+
+    for (; k + 4 <= blocks; k += 4) {
+        __m256 luma = _mm256_loadu_ps(y + 2 * k);
+        __m256 cb = avx2_pairs(pb + k);
+        __m256 cr = avx2_pairs(pr + k);
+
+        int r[8], g[8], b[8];
+        __m256 red = _mm256_add_ps(luma, _mm256_mul_ps(
+                _mm256_set1_ps((float)1.402), cr));
+        __m256 green = _mm256_sub_ps(_mm256_sub_ps(luma, _mm256_mul_ps(
+                _mm256_set1_ps((float)0.344136), cb)), _mm256_mul_ps(
+                _mm256_set1_ps((float)0.714136), cr));
+        __m256 blue = _mm256_add_ps(luma, _mm256_mul_ps(
+                _mm256_set1_ps((float)1.772), cb));
+
+        __m256i rs = avx2_sample(red, scale);
+        __m256i gs = avx2_sample(green, scale);
+        __m256i bs = avx2_sample(blue, scale);
+        if (out.p == NULL) {
+            avx2_store_bytes(out.p8 + 6 * k, rs, gs, bs);
+            continue;
+        }
+        _mm256_storeu_si256((__m256i *)r, rs);
+        _mm256_storeu_si256((__m256i *)g, gs);
+        _mm256_storeu_si256((__m256i *)b, bs);
+        store_pixels(row_advance(out, 2 * k), 8, r, g, b);
+    }
+
+    _mm256_zeroupper();
+    rgb_sse2(y + 2 * k, pb + k, pr + k, blocks - k, maxval,
+             row_advance(out, 2 * k));
+}
+
+#endif /* DCT40_X86 */
+
+/* The kernels for this CPU, which pick_kernels sets exactly once even
+ * when the first calls come from several worker threads at a time
+ */
+static const Kernels *picked = NULL;
+static pthread_once_t picked_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernels(void)
+{
+    static const Kernels scalar = {
+        pixels_scalar, blocks_scalar, luma_scalar, rgb_scalar
+    };
+#ifdef DCT40_X86
+    static const Kernels sse2 = {
+        pixels_sse2, blocks_sse2, luma_sse2, rgb_sse2
+    };
+    static const Kernels avx2 = {
+        pixels_avx2, blocks_avx2, luma_avx2, rgb_avx2
+    };
+#endif
+    const Kernels *best = &scalar;
+
+#ifdef DCT40_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        best = &avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        best = &sse2;
+    }
+#endif
+    picked = best;
+}
+
+/* The kernels for this CPU, picked on the first call */
+static const Kernels *kernels(void)
+{
+    int err = pthread_once(&picked_once, pick_kernels);
+    assert(err == 0);
+    return picked;
+}
@@ -0,0 +1,127 @@
+/* dct40.h
+ *
+ * Interface for the arithmetic of the COMP40 image codec: conversion
+ * between RGB and component video, and the 2x2 discrete cosine
+ * transform on blocks of component video pixels
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * The single-pixel and single-block functions are what the UArray2
+ * pipeline in compress40.c maps over an image. The strip functions keep
+ * component video and blocks as planes, one array per field, and work
+ * stage by stage a plane at a time; each stage picks an SSE2 or AVX2
+ * version at runtime when the CPU has one, and every version gives
+ * exactly the same results as the single-block functions.
+ */
+
+#ifndef DCT40_INCLUDED
+#define DCT40_INCLUDED
+
+#include "pnm.h"
+
+/* Denominator of decompressed images unless another is asked for */
+extern const int DENOM;
+
+typedef struct Pixel_float {
+    float red, green, blue;
+} *Pixel_float;
+
+typedef struct Component_vid {
+    float y, pb, pr;
+} *Component_vid;
+
+typedef struct dct_elem {
+    float average_pb, average_pr, a, b, c, d;
+} *dct_elem;
+
+/* One pixel or one block at a time */
+extern void RGB_to_float(Pnm_rgb rgb, Pixel_float pix, float denom);
+extern void pixel_to_CV (Pnm_rgb rgb, Component_vid cv, float denom);
+extern void block_to_DCT(Component_vid cv1, Component_vid cv2,
+                         Component_vid cv3, Component_vid cv4,
+                         dct_elem element);
+
+extern void DCT_to_block(dct_elem element, Component_vid cv1,
+                         Component_vid cv2, Component_vid cv3,
+                         Component_vid cv4);
+extern void CV_to_pixel (Component_vid cv, Pnm_rgb rgb);
+extern void CV_to_pixel_max(Component_vid cv, Pnm_rgb rgb, unsigned maxval);
+extern void float_to_RGB(Pnm_rgb rgb, Pixel_float pix);
+
+/* The functions above on runs of adjacent pixels or blocks; a block run
+ * covers the first 2 * blocks pixels of its two rows
+ */
+extern void Dct40_pixels_to_CV(const struct Pnm_rgb *rgb,
+                               struct Component_vid *cv,
+                               unsigned n, float denom);
+/* Dct40_pixels_to_CV on n pixels of raw P6 samples, which are 1 byte
+ * or 2 big-endian bytes each
+ */
+extern void Dct40_raw_to_CV(const unsigned char *raw, unsigned sample_bytes,
+                            struct Component_vid *cv, unsigned n,
+                            float denom);
+extern void Dct40_CV_to_pixels(const struct Component_vid *cv,
+                               struct Pnm_rgb *rgb, unsigned n,
+                               unsigned maxval);
+extern void Dct40_CV_to_DCT(const struct Component_vid *top,
+                            const struct Component_vid *bottom,
+                            unsigned blocks, struct dct_elem *out);
+extern void Dct40_DCT_to_CV(const struct dct_elem *in, unsigned blocks,
+                            struct Component_vid *top,
+                            struct Component_vid *bottom);
+
+/* A run of component video pixels as three planes, one per field of
+ * Component_vid
+ */
+typedef struct Dct40_cv_planes {
+    float *y, *pb, *pr;
+} Dct40_cv_planes;
+
+/* A run of blocks as six planes, one per field of dct_elem. Planes from
+ * Dct40_planes_new are one allocation in the order pb, pr, a, b, c, d,
+ * so the Pb averages of n blocks are followed by their Pr averages
+ */
+typedef struct Dct40_planes {
+    float *pb, *pr, *a, *b, *c, *d;
+} Dct40_planes;
+
+extern Dct40_planes Dct40_planes_new(unsigned blocks);
+extern void Dct40_planes_free(Dct40_planes *planes);
+
+/* The stages of the strip functions below. Pixels 2k and 2k+1 of a row
+ * belong to block k; on the way back the block chroma is not spread
+ * over its pixels but read straight from the Pb and Pr block planes.
+ */
+extern void Dct40_pixels_to_planes(const struct Pnm_rgb *rgb, unsigned n,
+                                   float denom, Dct40_cv_planes cv);
+extern void Dct40_planes_to_blocks(Dct40_cv_planes top,
+                                   Dct40_cv_planes bottom,
+                                   unsigned blocks, Dct40_planes out);
+extern void Dct40_blocks_to_luma(Dct40_planes in, unsigned blocks,
+                                 float *top, float *bottom);
+extern void Dct40_luma_to_pixels(const float *y, const float *pb,
+                                 const float *pr, unsigned blocks,
+                                 unsigned maxval, struct Pnm_rgb *rgb);
+extern void Dct40_luma_to_bytes(const float *y, const float *pb,
+                                const float *pr, unsigned blocks,
+                                unsigned char *raw);
+
+/* Converts 'blocks' 2x2 blocks from two rows of pixels into 'out'.
+ * Block k covers pixels 2k and 2k+1 of both 'top' and 'bottom'.
+ */
+extern void Dct40_forward(const struct Pnm_rgb *top,
+                          const struct Pnm_rgb *bottom,
+                          unsigned blocks, float denom, Dct40_planes out);
+
+/* The inverse of Dct40_forward, with samples scaled to 'maxval' */
+extern void Dct40_inverse(Dct40_planes in, unsigned blocks,
+                          struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                          unsigned maxval);
+
+/* Dct40_inverse to 8-bit samples (a maxval of 255), stored as the rows
+ * of a raw PPM: 6 * blocks bytes in each of 'top' and 'bottom'
+ */
+extern void Dct40_inverse_bytes(Dct40_planes in, unsigned blocks,
+                                unsigned char *top, unsigned char *bottom);
+
+#endif
@@ -0,0 +1,648 @@
+/* entropy40.c
+ *
+ * Implementation file for the format 3 entropy coder in entropy40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Every block is first turned into a residual word, which has the
+ * layout of a codeword but holds a minus its prediction and pb and pr
+ * minus those of the neighboring block, each wrapped to the width of
+ * its field. The six fields of the residual words are then coded with
+ * static rANS: frequencies scaled to sum to 2^PROB_BITS, and a 32-bit
+ * state kept in [RANS_L, 2^16 * RANS_L) by moving 16 bits at a time out
+ * of it while encoding and into it while decoding. Decoding a symbol is
+ * one lookup on the low PROB_BITS of the state, a multiply and at most
+ * one 16-bit load. Each block row is coded on its own, backwards, so
+ * that the decoder can run forwards, and by two states that each write
+ * their own stream of bytes: state 0 codes a, c and pb, and state 1
+ * codes b, d and pr, so the decoder has two independent chains of work.
+ */
+
+#include "assert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bitpack_inline.h"
+#include "entropy40.h"
+
+#define T Entropy40_T
+
+#define PROB_BITS 11
+#define PROB_SCALE (1u << PROB_BITS)
+#define RANS_L (1u << 15)
+
+/* The fields of a codeword in the order they are coded in each block */
+enum { A, B, C, D, PB, PR, FIELDS };
+
+static const struct {
+    unsigned width, lsb;
+} Fields[FIELDS] = {
+    { 9, 23 }, { 5, 18 }, { 5, 13 }, { 5, 8 }, { 4, 4 }, { 4, 0 }
+};
+
+/* Symbols of the largest field */
+#define MAX_SYMBOLS 512
+
+/* What encoding a symbol needs: the state at which bits must first be
+ * shifted out, and a fixed-point reciprocal of its frequency, so that
+ * encoding it is a multiply instead of a divide
+ */
+typedef struct Encoding {
+    uint32_t limit;
+    uint32_t rcp;
+    uint32_t bias;
+    uint16_t cmpl;
+    uint16_t shift;
+} Encoding;
+
+/* The model of one field: how often each symbol occurs, where its
+ * range starts, and, for encoding, each symbol's Encoding or, for
+ * decoding, the symbol, frequency and offset into its range of each
+ * slot, packed as 9, 11 and 11 bits
+ */
+typedef struct Model {
+    uint32_t freq[MAX_SYMBOLS];
+    uint32_t start[MAX_SYMBOLS];
+    Encoding encoding[MAX_SYMBOLS];
+    uint32_t slots[PROB_SCALE];
+} Model;
+
+/*
+ * Struct to hold an encoder
+ * Contains - the size of the image in blocks
+ *            the residual word of every block put so far
+ *            the codewords of the current block row and the one above
+ *            it, which the residuals are predicted from
+ *            the number of codewords put so far, and the row and column
+ *            of the next one
+ *            how often each symbol of each field occurs in the residuals
+ */
+struct T {
+    unsigned width, height;
+    uint32_t *residuals;
+    uint32_t *rows;
+    size_t count;
+    unsigned row, col;
+    uint64_t counts[FIELDS][MAX_SYMBOLS];
+};
+
+/*
+ * Function: Entropy40_new
+ * Purpose: Creates an encoder for an image of width by height blocks
+ * Parameters: The size of the image in blocks
+ * Returns: The encoder, to be released with Entropy40_free
+ */
+T Entropy40_new(unsigned width, unsigned height)
+{
+    T coder = calloc(1, sizeof(*coder));
+    assert(coder != NULL);
+    coder->width = width;
+    coder->height = height;
+    coder->residuals = malloc((size_t)width * height *
+                              sizeof(*coder->residuals) + 1);
+    assert(coder->residuals != NULL);
+    coder->rows = malloc(2 * (size_t)width * sizeof(*coder->rows) + 1);
+    assert(coder->rows != NULL);
+    return coder;
+}
+
+/* Entropy40_free
+ * Input: A pointer to an encoder made by Entropy40_new
+ * Does:  Frees it and sets the pointer to NULL
+ * Returns: Nothing
+ */
+void Entropy40_free(T *coder)
+{
+    assert(coder != NULL && *coder != NULL);
+    free((*coder)->residuals);
+    free((*coder)->rows);
+    free(*coder);
+    *coder = NULL;
+}
+
+/* predict
+ * Input: The codewords to the left, above and above left of a block,
+ *        any of which may be NULL off the edge of the image
+ * Does:  Predicts the block's a with the median edge detector of
+ *        LOCO-I: the left or above value at an edge, and otherwise the
+ *        plane through the three neighbors, clamped to their range.
+ *        The chroma indices are predicted by the block to the left, or
+ *        above in the first column.
+ * Returns: A word with the predicted a and chroma indices in their
+ *          fields and zeros elsewhere
+ */
+static inline uint32_t predict(const uint32_t *left, const uint32_t *up,
+                               const uint32_t *corner)
+{
+    if (left == NULL) {
+        return up == NULL ? 0 : *up & 0xff8000ff;
+    }
+    if (up == NULL) {
+        return *left & 0xff8000ff;
+    }
+
+    unsigned a = Entropy40_med(Bitpack_getu_inline(*left, 9, 23),
+                               Bitpack_getu_inline(*up, 9, 23),
+                               Bitpack_getu_inline(*corner, 9, 23));
+
+    return (uint32_t)a << 23 | (*left & 0xff);
+}
+
+/* Subtracts (sign -1) or adds (sign 1) the predicted fields of 'pred'
+ * to those of 'word', wrapping each to its width; b, c and d are kept
+ */
+static inline uint32_t apply(uint32_t word, uint32_t pred, int sign)
+{
+    unsigned a = (word >> 23) + sign * (pred >> 23);
+    unsigned pb = (word >> 4) + sign * (pred >> 4);
+    unsigned pr = word + sign * pred;
+
+    return (uint32_t)(a & 511) << 23 | (word & 0x7fff00) |
+           (pb & 15) << 4 | (pr & 15);
+}
+
+/* Field f of a residual word */
+static inline unsigned field(uint32_t word, int f)
+{
+    return Bitpack_getu_inline(word, Fields[f].width, Fields[f].lsb);
+}
+
+/*
+ * Function: Entropy40_put
+ * Purpose: Appends codewords to the image an encoder is collecting,
+ *          turning each into its residual word and counting its symbols
+ * Parameters: The encoder, the codewords and their number
+ * Returns: Nothing
+ * Expectations: The image has room for n more codewords
+ */
+void Entropy40_put(T coder, const uint32_t *words, size_t n)
+{
+    assert(coder != NULL && (n == 0 || words != NULL));
+    assert(n <= (size_t)coder->width * coder->height - coder->count);
+
+    unsigned width = coder->width;
+    while (n > 0) {
+        /* The rest of the current block row, or as much of it as is
+         * here
+         */
+        unsigned j = coder->row, col = coder->col;
+        size_t count = width - col < n ? width - col : n;
+        uint32_t *row = coder->rows + (size_t)(j % 2) * width;
+        const uint32_t *above = j > 0 ? coder->rows +
+                                        (size_t)((j + 1) % 2) * width
+                                      : NULL;
+        uint32_t *residuals = coder->residuals + coder->count;
+        uint64_t (*counts)[MAX_SYMBOLS] = coder->counts;
+
+        for (size_t i = 0; i < count; i++) {
+            unsigned k = col + i;
+            row[k] = words[i];
+
+            uint32_t pred = predict(k > 0 ? &row[k - 1] : NULL,
+                                    above != NULL ? &above[k] : NULL,
+                                    k > 0 && above != NULL ? &above[k - 1]
+                                                           : NULL);
+            uint32_t r = apply(words[i], pred, -1);
+            residuals[i] = r;
+            counts[A][field(r, A)]++;
+            counts[B][field(r, B)]++;
+            counts[C][field(r, C)]++;
+            counts[D][field(r, D)]++;
+            counts[PB][field(r, PB)]++;
+            counts[PR][field(r, PR)]++;
+        }
+
+        coder->count += count;
+        coder->col += count;
+        if (coder->col == width) {
+            coder->col = 0;
+            coder->row++;
+        }
+        words += count;
+        n -= count;
+    }
+}
+
+/* Scales symbol counts to frequencies that sum to PROB_SCALE, keeping
+ * every symbol that occurs at a frequency of at least 1
+ */
+static void normalize(const uint64_t *counts, unsigned symbols,
+                      uint32_t *freq)
+{
+    uint64_t total = 0;
+    for (unsigned s = 0; s < symbols; s++) {
+        total += counts[s];
+    }
+    if (total == 0) {
+        memset(freq, 0, symbols * sizeof(*freq));
+        return;
+    }
+
+    uint32_t sum = 0;
+    unsigned big = 0;
+    for (unsigned s = 0; s < symbols; s++) {
+        freq[s] = counts[s] * PROB_SCALE / total;
+        if (counts[s] > 0 && freq[s] == 0) {
+            freq[s] = 1;
+        }
+        sum += freq[s];
+        big = freq[s] > freq[big] ? s : big;
+    }
+
+    /* Give the rounding slack to, or take the excess from, the most
+     * frequent symbols, which it costs the least
+     */
+    if (sum < PROB_SCALE) {
+        freq[big] += PROB_SCALE - sum;
+    }
+    while (sum > PROB_SCALE) {
+        big = 0;
+        for (unsigned s = 1; s < symbols; s++) {
+            big = freq[s] > freq[big] ? s : big;
+        }
+        uint32_t take = sum - PROB_SCALE < freq[big] - 1
+                        ? sum - PROB_SCALE : freq[big] - 1;
+        freq[big] -= take;
+        sum -= take;
+    }
+}
+
+/*
+ * Function: Entropy40_bits
+ * Purpose: Works out what Entropy40_write spends on one field without
+ *          coding anything: the frequencies it would scale the counts
+ *          to, the bytes of the table that holds them, and the bits of
+ *          every symbol at those frequencies
+ * Parameters: How often each of the field's symbols occurs, and the
+ *             number of symbols, 2 to the width of the field
+ * Returns: The bits of the field's table and symbols
+ * Expectations: symbols is at most 512
+ */
+double Entropy40_bits(const uint64_t *counts, unsigned symbols)
+{
+    assert(counts != NULL && symbols <= MAX_SYMBOLS);
+
+    uint32_t freq[MAX_SYMBOLS];
+    normalize(counts, symbols, freq);
+
+    double bits = 0;
+    for (unsigned s = 0; s < symbols; s++) {
+        bits += freq[s] < 0x80 ? 8 : 16;
+        if (counts[s] > 0) {
+            bits += counts[s] * (PROB_BITS - log2(freq[s]));
+        }
+    }
+    return bits;
+}
+
+/*
+ * Function: Entropy40_framing
+ * Purpose: Gives the bytes Entropy40_write spends on every block row
+ *          whatever its symbols: the two stream lengths and final states,
+ *          and on average a byte of each stream's last 16-bit unit
+ * Parameters: The size of the image in blocks
+ * Returns: The bytes
+ */
+size_t Entropy40_framing(unsigned width, unsigned height)
+{
+    (void)width;
+    return (size_t)height * (8 + 2 * 4 + 2);
+}
+
+/* Sets the start of every symbol's range from the frequencies */
+static void cumulate(Model *model, unsigned symbols)
+{
+    uint32_t start = 0;
+    for (unsigned s = 0; s < symbols; s++) {
+        model->start[s] = start;
+        start += model->freq[s];
+    }
+}
+
+/* Sets up the Encoding of every symbol. With q the top bits of the
+ * product of the state and rcp, shifted right by 'shift', q is the
+ * state divided by the frequency, and the state minus q times the
+ * frequency is the remainder (see Fabian Giesen's rans_byte.h).
+ */
+static void prepare_encoding(Model *model, unsigned symbols)
+{
+    for (unsigned s = 0; s < symbols; s++) {
+        uint32_t freq = model->freq[s];
+        Encoding *e = &model->encoding[s];
+
+        e->limit = ((RANS_L >> PROB_BITS) << 16) * freq;
+        e->cmpl = PROB_SCALE - freq;
+        if (freq < 2) {
+            /* q is the state itself; a frequency of 0 is never used */
+            e->rcp = ~0u;
+            e->shift = 0;
+            e->bias = model->start[s] + PROB_SCALE - 1;
+        } else {
+            unsigned shift = 0;
+            while (freq > (1u << shift)) {
+                shift++;
+            }
+            e->rcp = ((1ull << (shift + 31)) + freq - 1) / freq;
+            e->shift = shift - 1;
+            e->bias = model->start[s];
+        }
+    }
+}
+
+/* Encodes one symbol into state *x, writing bits backwards from *p.
+ * The state is below 2^31, and a limit is at least 2^20, so one shift
+ * of 16 bits always brings it under the limit.
+ */
+static inline void rans_put(uint32_t *x, unsigned char **p,
+                            const Encoding *e)
+{
+    uint32_t state = *x;
+
+    if (state >= e->limit) {
+        *p -= 2;
+        (*p)[0] = state >> 8;
+        (*p)[1] = state;
+        state >>= 16;
+    }
+    uint32_t q = (uint32_t)(((uint64_t)state * e->rcp) >> 32) >> e->shift;
+    *x = state + e->bias + q * e->cmpl;
+}
+
+/* Writes state x backwards from *p so that it reads forwards
+ * big-endian
+ */
+static inline void rans_flush(uint32_t x, unsigned char **p)
+{
+    *p -= 4;
+    (*p)[0] = x >> 24;
+    (*p)[1] = x >> 16;
+    (*p)[2] = x >> 8;
+    (*p)[3] = x;
+}
+
+/* Stores a big-endian 32-bit value */
+static inline void store_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* Appends v to 'out' as a little-endian base-128 varint */
+static unsigned char *put_varint(unsigned char *out, uint32_t v)
+{
+    while (v >= 0x80) {
+        *out++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *out++ = v;
+    return out;
+}
+
+/*
+ * Function: Entropy40_write
+ * Purpose: Writes the scaled frequencies of every field, then codes and
+ *          writes each block row: the lengths of the streams of its two
+ *          states as 4-byte big-endian numbers, then the two streams
+ * Parameters: The encoder, holding the whole image, and the output
+ * Returns: Nothing
+ */
+void Entropy40_write(T coder, Codewords_T out)
+{
+    assert(coder != NULL && out != NULL);
+    assert(coder->count == (size_t)coder->width * coder->height);
+
+    unsigned width = coder->width;
+    Model *models = malloc(FIELDS * sizeof(*models));
+    assert(models != NULL);
+
+    /* Each frequency takes at most 2 bytes as a varint */
+    unsigned char table[2 * (MAX_SYMBOLS + 3 * 32 + 2 * 16)];
+    unsigned char *end = table;
+    for (int f = 0; f < FIELDS; f++) {
+        unsigned symbols = 1u << Fields[f].width;
+        normalize(coder->counts[f], symbols, models[f].freq);
+        cumulate(&models[f], symbols);
+        prepare_encoding(&models[f], symbols);
+        for (unsigned s = 0; s < symbols; s++) {
+            end = put_varint(end, models[f].freq[s]);
+        }
+    }
+    Codewords_write(out, table, end - table);
+
+    /* Each state codes 3 symbols of at most 2 bytes per block, plus
+     * itself at the end
+     */
+    size_t room = 6 * (size_t)width + 4;
+    unsigned char *buf = malloc(2 * room);
+    assert(buf != NULL);
+    for (unsigned j = 0; j < coder->height; j++) {
+        const uint32_t *row = coder->residuals + (size_t)j * width;
+        uint32_t x0 = RANS_L, x1 = RANS_L;
+        unsigned char *p0 = buf + room, *p1 = buf + 2 * room;
+
+        for (unsigned k = width; k-- > 0; ) {
+            uint32_t r = row[k];
+            rans_put(&x1, &p1, &models[PR].encoding[field(r, PR)]);
+            rans_put(&x0, &p0, &models[PB].encoding[field(r, PB)]);
+            rans_put(&x1, &p1, &models[D].encoding[field(r, D)]);
+            rans_put(&x0, &p0, &models[C].encoding[field(r, C)]);
+            rans_put(&x1, &p1, &models[B].encoding[field(r, B)]);
+            rans_put(&x0, &p0, &models[A].encoding[field(r, A)]);
+        }
+        rans_flush(x0, &p0);
+        rans_flush(x1, &p1);
+
+        size_t len0 = buf + room - p0, len1 = buf + 2 * room - p1;
+        unsigned char prefix[8];
+        store_be32(prefix, len0);
+        store_be32(prefix + 4, len1);
+        Codewords_write(out, prefix, 8);
+        Codewords_write(out, p0, len0);
+        Codewords_write(out, p1, len1);
+    }
+    free(buf);
+    free(models);
+}
+
+/* Input of the decoder: the rest of the file, plus slack so that the
+ * loads of one block never leave the buffer before they are checked
+ */
+#define SLACK 16
+
+/* Reads everything left in 'input' into a buffer */
+static unsigned char *slurp(FILE *input, size_t *len)
+{
+    size_t size = 1 << 20, used = 0;
+    unsigned char *buf = malloc(size + SLACK);
+    assert(buf != NULL);
+
+    size_t got;
+    while ((got = fread(buf + used, 1, size - used, input)) > 0) {
+        used += got;
+        if (used == size) {
+            size *= 2;
+            buf = realloc(buf, size + SLACK);
+            assert(buf != NULL);
+        }
+    }
+    memset(buf + used, 0, SLACK);
+    *len = used;
+    return buf;
+}
+
+/* Reads a varint from [*p, end) */
+static uint32_t get_varint(const unsigned char **p, const unsigned char *end)
+{
+    uint32_t v = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        assert(*p < end);
+        unsigned char byte = *(*p)++;
+        v |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return v;
+        }
+    }
+    assert(0);
+    return 0;
+}
+
+/* Reads a model's frequencies and builds its decoding table; the
+ * frequencies must sum to PROB_SCALE, or to 0 when 'empty'
+ */
+static void read_model(Model *model, unsigned symbols, int empty,
+                       const unsigned char **p, const unsigned char *end)
+{
+    uint32_t sum = 0;
+    for (unsigned s = 0; s < symbols; s++) {
+        model->freq[s] = get_varint(p, end);
+        assert(model->freq[s] <= PROB_SCALE);
+        sum += model->freq[s];
+    }
+    assert(sum == (empty ? 0 : PROB_SCALE));
+    cumulate(model, symbols);
+
+    for (unsigned s = 0; s < symbols; s++) {
+        for (uint32_t slot = 0; slot < model->freq[s]; slot++) {
+            model->slots[model->start[s] + slot] =
+                    s | (model->freq[s] - 1) << 9 | slot << 20;
+        }
+    }
+}
+
+/* Decodes one symbol from state *x, reading bits forwards from *p */
+static inline unsigned rans_get(uint32_t *x, const unsigned char **p,
+                                const Model *model)
+{
+    uint32_t state = *x;
+    uint32_t slot = model->slots[state & (PROB_SCALE - 1)];
+
+    state = ((slot >> 9 & (PROB_SCALE - 1)) + 1) * (state >> PROB_BITS) +
+            (slot >> 20);
+    if (state < RANS_L) {
+        state = state << 16 | (uint32_t)(*p)[0] << 8 | (*p)[1];
+        *p += 2;
+    }
+    *x = state;
+    return slot & (MAX_SYMBOLS - 1);
+}
+
+/* Loads a big-endian 32-bit value */
+static inline uint32_t load_be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+           (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+/* Decodes one block row of 'width' blocks into 'row', whose row above
+ * is 'above' (NULL for the first row), from the streams of its two rANS
+ * states, [p0, end0) and [p1, end1)
+ */
+static void decode_row(const Model *models, const unsigned char *p0,
+                       const unsigned char *end0, const unsigned char *p1,
+                       const unsigned char *end1, unsigned width,
+                       uint32_t *row, const uint32_t *above)
+{
+    assert(end0 - p0 >= 4 && end1 - p1 >= 4);
+    uint32_t x0 = load_be32(p0), x1 = load_be32(p1);
+    p0 += 4;
+    p1 += 4;
+
+    for (unsigned k = 0; k < width; k++) {
+        uint32_t residual = rans_get(&x0, &p0, &models[A]) << 23;
+        residual |= rans_get(&x1, &p1, &models[B]) << 18;
+        residual |= rans_get(&x0, &p0, &models[C]) << 13;
+        residual |= rans_get(&x1, &p1, &models[D]) << 8;
+        residual |= rans_get(&x0, &p0, &models[PB]) << 4;
+        residual |= rans_get(&x1, &p1, &models[PR]);
+        assert(p0 <= end0 && p1 <= end1);
+
+        uint32_t pred = predict(k > 0 ? &row[k - 1] : NULL,
+                                above != NULL ? &above[k] : NULL,
+                                k > 0 && above != NULL ? &above[k - 1]
+                                                       : NULL);
+        row[k] = apply(residual, pred, 1);
+    }
+    assert(p0 == end0 && p1 == end1 && x0 == RANS_L && x1 == RANS_L);
+}
+
+/*
+ * Function: Entropy40_decode
+ * Purpose: Decodes the tables and coded rows that follow a format 3
+ *          header back to format 2 codewords
+ * Parameters: The input, just past the header, and the size of the
+ *             image in blocks
+ * Returns: 4 * width * height bytes of big-endian codewords, which the
+ *          caller frees
+ * Expectations: The input is a complete format 3 image of that size
+ */
+unsigned char *Entropy40_decode(FILE *input, unsigned width,
+                                unsigned height)
+{
+    assert(input != NULL);
+    size_t len;
+    unsigned char *in = slurp(input, &len);
+    const unsigned char *p = in, *end = in + len;
+
+    Model *models = malloc(FIELDS * sizeof(*models));
+    assert(models != NULL);
+    int empty = (size_t)width * height == 0;
+    for (int f = 0; f < FIELDS; f++) {
+        read_model(&models[f], 1u << Fields[f].width, empty, &p, end);
+    }
+
+    size_t blocks = (size_t)width * height;
+    unsigned char *bytes = malloc(4 * blocks + 1);
+    assert(bytes != NULL);
+    uint32_t *rows = malloc(2 * (size_t)width * sizeof(*rows) + 1);
+    assert(rows != NULL);
+
+    for (unsigned j = 0; j < height; j++) {
+        uint32_t *row = rows + (size_t)(j % 2) * width;
+        const uint32_t *above = j > 0 ? rows + (size_t)((j + 1) % 2) * width
+                                      : NULL;
+
+        /* The lengths of the row's two streams, then the streams */
+        assert(end - p >= 8);
+        size_t len0 = load_be32(p), len1 = load_be32(p + 4);
+        p += 8;
+        assert(len0 <= (size_t)(end - p) && len1 <= (size_t)(end - p) - len0);
+        decode_row(models, p, p + len0, p + len0, p + len0 + len1, width,
+                   row, above);
+        p += len0 + len1;
+
+        unsigned char *out = bytes + 4 * (size_t)j * width;
+        for (unsigned k = 0; k < width; k++) {
+            store_be32(out + 4 * k, row[k]);
+        }
+    }
+    assert(p == end);
+
+    free(rows);
+    free(models);
+    free(in);
+    return bytes;
+}
+
+#undef T
@@ -0,0 +1,72 @@
+/* entropy40.h
+ *
+ * Interface for the entropy coder of COMP40 compressed image format 3
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Format 3 holds the same codewords as format 2, but instead of 32 bits
+ * each it stores their fields with a static rANS coder. The luma field
+ * a is predicted from the blocks to its left, above and above left, and
+ * the chroma indices from the block to the left, so what gets coded is
+ * mostly small residuals; b, c and d are coded as they are. After the
+ * text header come six frequency tables, one per field, as varints, and
+ * then every block row: the lengths of its two rANS streams as 4-byte
+ * big-endian numbers, then the streams. Each row is coded on its own,
+ * with two rANS states so that the decoder has two independent chains
+ * to work on.
+ */
+
+#ifndef ENTROPY40_INCLUDED
+#define ENTROPY40_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "codewords.h"
+
+#define T Entropy40_T
+typedef struct T *T;
+
+/* An encoder for an image 'width' by 'height' blocks */
+extern T    Entropy40_new (unsigned width, unsigned height);
+extern void Entropy40_free(T *coder);
+
+/* Appends the next n codewords of the image, in row-major order */
+extern void Entropy40_put (T coder, const uint32_t *words, size_t n);
+
+/* Writes the tables and coded rows of every codeword put so far, which
+ * must be the whole image
+ */
+extern void Entropy40_write(T coder, Codewords_T out);
+
+/* Bits Entropy40_write would spend on a field whose symbols 0 to
+ * symbols - 1 occur counts[s] times, table included, and the bytes it
+ * spends on a 'width' by 'height' block image whatever the symbols; the
+ * two give the size of an image in format 3 up to a few bytes a row
+ * without coding it
+ */
+extern double Entropy40_bits(const uint64_t *counts, unsigned symbols);
+extern size_t Entropy40_framing(unsigned width, unsigned height);
+
+/* The median edge detector of LOCO-I, which predicts the a of a block
+ * from those to its left (w), above (n) and above left (nw): the plane
+ * through the three, clamped to the range of w and n
+ */
+static inline unsigned Entropy40_med(unsigned w, unsigned n, unsigned nw)
+{
+    unsigned low = w < n ? w : n;
+    unsigned high = w < n ? n : w;
+    return nw >= high ? low : nw <= low ? high : w + n - nw;
+}
+
+/* Reads the tables and coded rows of a 'width' by 'height' block image
+ * that follow the header in 'input', and decodes them to the bytes the
+ * image would have as format 2: 4 * width * height of big-endian
+ * codewords, in a buffer the caller frees. It is a checked runtime error
+ * for the input to be cut short or corrupt.
+ */
+extern unsigned char *Entropy40_decode(FILE *input, unsigned width,
+                                       unsigned height);
+
+#undef T
+#endif
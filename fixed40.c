@@ -0,0 +1,396 @@
+/* fixed40.c
+ *
+ * Implementation file for the fixed-point compressor in fixed40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Component video is kept in Q24: a Y, Pb or Pr value v is stored as
+ * v * 2^24 rounded, so the sum of a block's four pixels is its average
+ * in Q26 and no divide by 4 is needed. The table entries are rounded
+ * once each, so a block average is off from the exact value by at most
+ * 3 * 2^-25 of a unit. The float pipeline is off by a few float ulps,
+ * around 2^-22. Both are far below half a quantization step (1/1022 for
+ * a, 1/100 for b, c and d, and over 1/400 between chroma levels), so
+ * the two pipelines can only disagree about a value that sits within
+ * about 2^-21 of a rounding boundary, and then by exactly one.
+ */
+
+#include "assert.h"
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "chroma40.h"
+#include "fixed40.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIXED40_X86 1
+#endif
+
+#define T Fixed40_T
+
+/* A component video value of 1, which has 24 fraction bits */
+#define ONE 16777216.0
+
+/* Blocks that go through both stages before the next CHUNK; their
+ * component video takes 3KB, so it is still in L1 for the second stage
+ */
+#define CHUNK 64
+
+struct T {
+    /* For each of R, G and B and every possible sample s, the shares of
+     * s in Y, Pb and Pr, three entries per sample
+     */
+    int32_t *shares[3];
+
+    /* 2^26 times the sum of adjacent chroma levels: a Q26 average x
+     * is nearer level i + 1 than level i exactly when 2x > mid[i]
+     */
+    int32_t mid[CHROMA40_LEVELS - 1];
+};
+
+/* A run of pixels of Q24 component video, one plane per component */
+typedef struct Cv_planes {
+    int32_t *y, *pb, *pr;
+} Cv_planes;
+
+typedef void blocks_fun(Cv_planes top, Cv_planes bottom, unsigned blocks,
+                        const int32_t *mid, Fixed40_fields out);
+
+static blocks_fun blocks_scalar;
+static blocks_fun *blocks_kernel(void);
+
+/* Weights of the RGB to component video transform, one row per output */
+static const double CV_weights[3][3] = {
+    {  0.299,     0.587,     0.114    },
+    { -0.168736, -0.331264,  0.5      },
+    {  0.5,      -0.418688, -0.081312 },
+};
+
+/*
+ * Function: Fixed40_new
+ * Purpose: Builds the lookup tables for images with denominator 'denom'.
+ *          They cover every value a 1 or 2-byte sample can hold, so a
+ *          bad sample above the denominator counts as the denominator
+ *          instead of being read out of bounds or overflowing a sum.
+ * Parameters: The source denominator
+ * Returns: The tables, to be released with Fixed40_free
+ * Expectations: denom is from 1 to 65535
+ */
+T Fixed40_new(unsigned denom)
+{
+    assert(denom > 0 && denom <= 65535);
+    unsigned samples = denom < 256 ? 256 : 65536;
+
+    T tables = malloc(sizeof(*tables));
+    assert(tables != NULL);
+    for (int c = 0; c < 3; c++) {
+        int32_t *share = malloc(3 * samples * sizeof(*share));
+        assert(share != NULL);
+        for (unsigned s = 0; s < samples; s++) {
+            double x = (double)(s < denom ? s : denom) / denom;
+            for (int o = 0; o < 3; o++) {
+                share[3 * s + o] = lround(CV_weights[o][c] * x * ONE);
+            }
+        }
+        tables->shares[c] = share;
+    }
+
+    for (int i = 0; i + 1 < CHROMA40_LEVELS; i++) {
+        tables->mid[i] = lround(((double)Chroma40_levels[i] +
+                                 Chroma40_levels[i + 1]) * 4 * ONE);
+    }
+    return tables;
+}
+
+/* Fixed40_free
+ * Input: A pointer to tables made by Fixed40_new
+ * Does:  Frees them and sets the pointer to NULL
+ * Returns: Nothing
+ */
+void Fixed40_free(T *tables)
+{
+    assert(tables != NULL && *tables != NULL);
+    for (int c = 0; c < 3; c++) {
+        free((*tables)->shares[c]);
+    }
+    free(*tables);
+    *tables = NULL;
+}
+
+/*
+ * Function: Fixed40_fields_new
+ * Purpose: Allocates the six field planes of a run of blocks in one piece
+ * Parameters: The number of blocks
+ * Returns: The planes, to be released with Fixed40_fields_free
+ */
+Fixed40_fields Fixed40_fields_new(unsigned blocks)
+{
+    int32_t *ints = malloc(6 * (size_t)blocks * sizeof(*ints) + 1);
+    assert(ints != NULL);
+
+    Fixed40_fields fields = {
+        ints, ints + blocks, ints + 2 * (size_t)blocks,
+        ints + 3 * (size_t)blocks, ints + 4 * (size_t)blocks,
+        ints + 5 * (size_t)blocks
+    };
+    return fields;
+}
+
+/* Fixed40_fields_free
+ * Input: Planes made by Fixed40_fields_new
+ * Does:  Frees them and clears every plane pointer
+ * Returns: Nothing
+ */
+void Fixed40_fields_free(Fixed40_fields *fields)
+{
+    assert(fields != NULL);
+    free(fields->a);
+
+    Fixed40_fields empty = { NULL, NULL, NULL, NULL, NULL, NULL };
+    *fields = empty;
+}
+
+/* 'fields' moved right by k blocks */
+static inline Fixed40_fields fields_advance(Fixed40_fields fields,
+                                            unsigned k)
+{
+    Fixed40_fields moved = {
+        fields.a + k, fields.b + k, fields.c + k,
+        fields.d + k, fields.pb + k, fields.pr + k
+    };
+    return moved;
+}
+
+/* 'cv' moved right by k pixels */
+static inline Cv_planes cv_advance(Cv_planes cv, unsigned k)
+{
+    Cv_planes moved = { cv.y + k, cv.pb + k, cv.pr + k };
+    return moved;
+}
+
+/* Converts n pixels to Q24 component video planes */
+static void pixels_to_cv(T tables, const struct Pnm_rgb *rgb, unsigned n,
+                         Cv_planes cv)
+{
+    const int32_t *red = tables->shares[0];
+    const int32_t *green = tables->shares[1];
+    const int32_t *blue = tables->shares[2];
+
+    for (unsigned k = 0; k < n; k++) {
+        const int32_t *r = red + 3 * rgb[k].red;
+        const int32_t *g = green + 3 * rgb[k].green;
+        const int32_t *b = blue + 3 * rgb[k].blue;
+        cv.y[k] = r[0] + g[0] + b[0];
+        cv.pb[k] = r[1] + g[1] + b[1];
+        cv.pr[k] = r[2] + g[2] + b[2];
+    }
+}
+
+/*
+ * Function: Fixed40_forward
+ * Purpose: Does what Dct40_forward followed by quantize_Y, quantize_coef
+ *          and Chroma40_index does, in integers, CHUNK blocks at a time
+ * Parameters: The tables for the source denominator, the top and bottom
+ *             rows of the strip (2 * blocks pixels each), the number of
+ *             blocks and field planes with room for that many blocks
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL
+ */
+void Fixed40_forward(T tables, const struct Pnm_rgb *top,
+                     const struct Pnm_rgb *bottom, unsigned blocks,
+                     Fixed40_fields out)
+{
+    blocks_fun *blocks_to_fields = blocks_kernel();
+    int32_t cv[2][3][2 * CHUNK];
+    Cv_planes cv_top = { cv[0][0], cv[0][1], cv[0][2] };
+    Cv_planes cv_bottom = { cv[1][0], cv[1][1], cv[1][2] };
+
+    assert(tables != NULL && top != NULL && bottom != NULL);
+    for (unsigned k = 0; k < blocks; k += CHUNK) {
+        unsigned n = blocks - k < CHUNK ? blocks - k : CHUNK;
+        pixels_to_cv(tables, top + 2 * k, 2 * n, cv_top);
+        pixels_to_cv(tables, bottom + 2 * k, 2 * n, cv_bottom);
+        blocks_to_fields(cv_top, cv_bottom, n, tables->mid,
+                         fields_advance(out, k));
+    }
+}
+
+/* round(x * 511) for the Q26 luma average x, which is from 0 to 2^26 */
+static inline int32_t quantize_luma(int32_t x)
+{
+    return ((int64_t)x * 511 + (1 << 25)) >> 26;
+}
+
+/* round(x * 50) for the Q26 average x clamped to [-0.3, 0.3]. Any x
+ * past the clamp would round to 15 or more, so the clamp becomes a cap
+ * on the result.
+ */
+static inline int32_t quantize_coefficient(int32_t x)
+{
+    int32_t q = ((x < 0 ? -x : x) * 50 + (1 << 25)) >> 26;
+    q = q < 15 ? q : 15;
+    return x < 0 ? -q : q;
+}
+
+/* Index of the chroma level nearest the Q26 average x */
+static inline int32_t chroma_index(int32_t x, const int32_t *mid)
+{
+    int32_t index = 0;
+    for (int i = 0; i + 1 < CHROMA40_LEVELS; i++) {
+        index += 2 * x > mid[i];
+    }
+    return index;
+}
+
+static void blocks_scalar(Cv_planes top, Cv_planes bottom, unsigned blocks,
+                          const int32_t *mid, Fixed40_fields out)
+{
+    for (unsigned k = 0; k < blocks; k++) {
+        unsigned l = 2 * k, r = 2 * k + 1;
+        int32_t y1 = top.y[l], y2 = top.y[r];
+        int32_t y3 = bottom.y[l], y4 = bottom.y[r];
+
+        out.a[k] = quantize_luma(y4 + y3 + y2 + y1);
+        out.b[k] = quantize_coefficient(y4 + y3 - y2 - y1);
+        out.c[k] = quantize_coefficient(y4 - y3 + y2 - y1);
+        out.d[k] = quantize_coefficient(y4 - y3 - y2 + y1);
+        out.pb[k] = chroma_index(top.pb[l] + top.pb[r] + bottom.pb[l] +
+                                 bottom.pb[r], mid);
+        out.pr[k] = chroma_index(top.pr[l] + top.pr[r] + bottom.pr[l] +
+                                 bottom.pr[r], mid);
+    }
+}
+
+#ifdef FIXED40_X86
+
+/*
+ * The AVX2 kernel does the block stage 8 blocks at a time in 32-bit
+ * lanes, with the same integer operations as the scalar one. The only
+ * product that does not fit in 32 bits is x * 511 in quantize_luma, so
+ * x is split at bit 13 and the two halves are scaled and rounded one
+ * after the other, which gives the same floor.
+ */
+
+/* Loads 16 ints of a row plane as its 8 even and 8 odd pixels */
+__attribute__((target("avx2")))
+static inline void avx2_split(const int32_t *p, __m256i *even, __m256i *odd)
+{
+    __m256 lo = _mm256_loadu_ps((const float *)p);
+    __m256 hi = _mm256_loadu_ps((const float *)(p + 8));
+    __m256 e = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 o = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+    *even = _mm256_permute4x64_epi64(_mm256_castps_si256(e),
+                                     _MM_SHUFFLE(3, 1, 2, 0));
+    *odd = _mm256_permute4x64_epi64(_mm256_castps_si256(o),
+                                    _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* The sum of the four pixels of 8 blocks of one chroma plane */
+__attribute__((target("avx2")))
+static inline __m256i avx2_sum(const int32_t *top, const int32_t *bottom)
+{
+    __m256i c1, c2, c3, c4;
+    avx2_split(top, &c1, &c2);
+    avx2_split(bottom, &c3, &c4);
+    return _mm256_add_epi32(_mm256_add_epi32(c1, c2),
+                            _mm256_add_epi32(c3, c4));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_luma(__m256i x)
+{
+    __m256i k511 = _mm256_set1_epi32(511);
+    __m256i high = _mm256_srli_epi32(x, 13);
+    __m256i low = _mm256_and_si256(x, _mm256_set1_epi32((1 << 13) - 1));
+    __m256i carry = _mm256_srli_epi32(_mm256_add_epi32(
+            _mm256_mullo_epi32(low, k511), _mm256_set1_epi32(1 << 25)), 13);
+    return _mm256_srli_epi32(_mm256_add_epi32(
+            _mm256_mullo_epi32(high, k511), carry), 13);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_coefficient(__m256i x)
+{
+    __m256i q = _mm256_srli_epi32(_mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_abs_epi32(x), _mm256_set1_epi32(50)),
+            _mm256_set1_epi32(1 << 25)), 26);
+    return _mm256_sign_epi32(_mm256_min_epi32(q, _mm256_set1_epi32(15)), x);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_chroma(__m256i x, const int32_t *mid)
+{
+    __m256i twice = _mm256_add_epi32(x, x);
+    __m256i index = _mm256_setzero_si256();
+
+    /* Each compare gives -1 in every lane past that midpoint */
+    for (int i = 0; i + 1 < CHROMA40_LEVELS; i++) {
+        index = _mm256_sub_epi32(index, _mm256_cmpgt_epi32(twice,
+                                 _mm256_set1_epi32(mid[i])));
+    }
+    return index;
+}
+
+__attribute__((target("avx2")))
+static void blocks_avx2(Cv_planes top, Cv_planes bottom, unsigned blocks,
+                        const int32_t *mid, Fixed40_fields out)
+{
+    unsigned k = 0;
+
+    for (; k + 8 <= blocks; k += 8) {
+        __m256i y1, y2, y3, y4;
+        avx2_split(top.y + 2 * k, &y1, &y2);
+        avx2_split(bottom.y + 2 * k, &y3, &y4);
+
+        __m256i y43 = _mm256_add_epi32(y4, y3);
+        __m256i y4m3 = _mm256_sub_epi32(y4, y3);
+        _mm256_storeu_si256((__m256i *)(out.a + k), avx2_luma(
+                _mm256_add_epi32(_mm256_add_epi32(y43, y2), y1)));
+        _mm256_storeu_si256((__m256i *)(out.b + k), avx2_coefficient(
+                _mm256_sub_epi32(_mm256_sub_epi32(y43, y2), y1)));
+        _mm256_storeu_si256((__m256i *)(out.c + k), avx2_coefficient(
+                _mm256_sub_epi32(_mm256_add_epi32(y4m3, y2), y1)));
+        _mm256_storeu_si256((__m256i *)(out.d + k), avx2_coefficient(
+                _mm256_add_epi32(_mm256_sub_epi32(y4m3, y2), y1)));
+        _mm256_storeu_si256((__m256i *)(out.pb + k), avx2_chroma(
+                avx2_sum(top.pb + 2 * k, bottom.pb + 2 * k), mid));
+        _mm256_storeu_si256((__m256i *)(out.pr + k), avx2_chroma(
+                avx2_sum(top.pr + 2 * k, bottom.pr + 2 * k), mid));
+    }
+
+    _mm256_zeroupper();
+    blocks_scalar(cv_advance(top, 2 * k), cv_advance(bottom, 2 * k),
+                  blocks - k, mid, fields_advance(out, k));
+}
+
+#endif /* FIXED40_X86 */
+
+/* The block kernel for this CPU, which pick_kernel sets exactly once
+ * even when the first calls come from several worker threads at a time
+ */
+static blocks_fun *picked = NULL;
+static pthread_once_t picked_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void)
+{
+    blocks_fun *best = blocks_scalar;
+
+#ifdef FIXED40_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        best = blocks_avx2;
+    }
+#endif
+    picked = best;
+}
+
+/* The block kernel for this CPU, picked on the first call */
+static blocks_fun *blocks_kernel(void)
+{
+    int err = pthread_once(&picked_once, pick_kernel);
+    assert(err == 0);
+    return picked;
+}
+
+#undef T
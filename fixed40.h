@@ -0,0 +1,49 @@
+/* fixed40.h
+ *
+ * Interface for the fixed-point compressor arithmetic: the work of
+ * Dct40_forward and the quantizers in compress40.c, done in integers
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * A Fixed40_T holds the lookup tables for one source denominator. Each
+ * table entry is one sample's share of Y, Pb or Pr, already divided by
+ * the denominator and scaled by 2^24, so converting a pixel is nine
+ * lookups and six adds, and everything after that is exact integer
+ * arithmetic. The fields that come out match the float pipeline except
+ * where its rounding error straddles a rounding boundary, and then
+ * differ by one (see fixed40.c).
+ */
+
+#ifndef FIXED40_INCLUDED
+#define FIXED40_INCLUDED
+
+#include <stdint.h>
+#include "pnm.h"
+
+#define T Fixed40_T
+typedef struct T *T;
+
+/* The quantized fields of a run of blocks, one plane per codeword field:
+ * a is from 0 to 511, b, c and d from -15 to 15, and pb and pr are
+ * chroma indices
+ */
+typedef struct Fixed40_fields {
+    int32_t *a, *b, *c, *d, *pb, *pr;
+} Fixed40_fields;
+
+extern T    Fixed40_new (unsigned denom);
+extern void Fixed40_free(T *tables);
+
+extern Fixed40_fields Fixed40_fields_new(unsigned blocks);
+extern void Fixed40_fields_free(Fixed40_fields *fields);
+
+/* Quantizes 'blocks' 2x2 blocks from two rows of pixels into 'out'.
+ * Block k covers pixels 2k and 2k+1 of both 'top' and 'bottom', whose
+ * samples are at most the denominator 'tables' was made for.
+ */
+extern void Fixed40_forward(T tables, const struct Pnm_rgb *top,
+                            const struct Pnm_rgb *bottom, unsigned blocks,
+                            Fixed40_fields out);
+
+#undef T
+#endif
@@ -13,7 +13,7 @@ Things left to do:
 #include <pnm.h>
 #include <assert.h>
 #include "a2methods.h"
-#include "a2plain.h"
+#include "a2flat.h"
 #include "a2blocked.h"
 #include <math.h>
 
@@ -39,8 +39,8 @@ int main (int argc, char* argv[]){
         image2 = fopen(argv[2],"r");
     }
 
-    /* default to UArray2 methods */
-    A2Methods_T methods = uarray2_methods_plain;
+    /* default to flat UArray2 methods */
+    A2Methods_T methods = uarray2_methods_flat;
     assert(methods);
 
     /* default to best map */
@@ -0,0 +1,518 @@
+/* ppmrows.c
+ *
+ * Implementation file for the row-at-a-time PPM reader and writer in
+ * ppmrows.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "assert.h"
+#include "except.h"
+#include "pnm.h"
+#include "ppmrows.h"
+
+#define T Ppmrows_T
+
+/* A writer packs rows into a buffer of about this many bytes and writes
+ * them out when it fills, rather than making one fwrite per row
+ */
+#define PPMROWS_CHUNK (1 << 20)
+
+/*
+ * Struct to hold a partially read PPM image
+ * Contains - the stream the rows are read from or written to
+ *            dimensions and denominator from the header
+ *            whether the samples are plain (P3) or raw (P6)
+ *            the number of rows handed over so far
+ *            a byte buffer big enough for one raw row, or for a writer,
+ *            room for 'chunk_rows' packed rows, of which 'queued' are
+ *            waiting to be written
+ *            the mapping of a reader's whole input file, or NULL, and
+ *            where its raster starts
+ *            the whole raster, once Ppmrows_raster has read it into
+ *            memory, or NULL
+ */
+struct T {
+        FILE *fp;
+        unsigned width, height, denominator;
+        int plain;
+        unsigned rows_done;
+        unsigned char *raw;
+        unsigned chunk_rows, queued;
+        unsigned char *map;
+        size_t map_len;
+        const unsigned char *mapped_raster;
+        unsigned char *raster;
+};
+
+static void skip_space(FILE *fp);
+static unsigned read_header_num(FILE *fp);
+static void map_raster(T rows);
+static void unpack_row(T rows, const unsigned char *raw,
+                       struct Pnm_rgb *row);
+static void read_plain_row(T rows, unsigned char *raw);
+static void flush_chunk(T rows);
+
+/*
+ * Function: Ppmrows_new
+ * Purpose: Reads the magic number, dimensions and denominator of a PPM
+ *          image and leaves 'fp' positioned at the first sample
+ * Parameters: FILE pointer to an open PPM image
+ * Returns: A new Ppmrows_T
+ * Expectations: Raises Pnm_Badformat if the header is not a valid P6 or
+ *               P3 header or the image is empty
+ */
+T Ppmrows_new(FILE *fp)
+{
+        assert(fp != NULL);
+
+        int c1 = getc(fp);
+        int c2 = getc(fp);
+        if (c1 != 'P' || (c2 != '6' && c2 != '3')) {
+                RAISE(Pnm_Badformat);
+        }
+
+        T rows = malloc(sizeof(*rows));
+        assert(rows != NULL);
+        rows->fp = fp;
+        rows->plain = (c2 == '3');
+        rows->width = read_header_num(fp);
+        rows->height = read_header_num(fp);
+        rows->denominator = read_header_num(fp);
+        rows->rows_done = 0;
+        rows->chunk_rows = 1;
+        rows->queued = 0;
+        rows->map = NULL;
+        rows->map_len = 0;
+        rows->mapped_raster = NULL;
+        rows->raster = NULL;
+
+        if (rows->width == 0 || rows->height == 0 ||
+            rows->denominator == 0 || rows->denominator > 65535) {
+                free(rows);
+                RAISE(Pnm_Badformat);
+        }
+
+        /* Exactly one whitespace character separates header and raster */
+        if (!rows->plain) {
+                getc(fp);
+        }
+
+        unsigned bytes = rows->denominator < 256 ? 1 : 2;
+        rows->raw = malloc((size_t)rows->width * 3 * bytes);
+        assert(rows->raw != NULL);
+
+        if (!rows->plain) {
+                map_raster(rows);
+        }
+        return rows;
+}
+
+/*
+ * Function: Ppmrows_free
+ * Purpose: Frees a reader or writer and its row buffer; does not close
+ *          the stream
+ * Parameters: Pointer to a Ppmrows_T
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL
+ */
+void Ppmrows_free(T *rowsp)
+{
+        assert(rowsp != NULL && *rowsp != NULL);
+        flush_chunk(*rowsp);
+        if ((*rowsp)->map != NULL) {
+                munmap((*rowsp)->map, (*rowsp)->map_len);
+        }
+        free((*rowsp)->raster);
+        free((*rowsp)->raw);
+        free(*rowsp);
+        *rowsp = NULL;
+}
+
+unsigned Ppmrows_width(T rows)
+{
+        assert(rows != NULL);
+        return rows->width;
+}
+
+unsigned Ppmrows_height(T rows)
+{
+        assert(rows != NULL);
+        return rows->height;
+}
+
+unsigned Ppmrows_denominator(T rows)
+{
+        assert(rows != NULL);
+        return rows->denominator;
+}
+
+/*
+ * Function: Ppmrows_read
+ * Purpose: Reads the next row of pixels into a client supplied buffer.
+ *          A raw row is unpacked straight from the mapped file, or read
+ *          with a single fread and then unpacked.
+ * Parameters: A Ppmrows_T and a buffer of at least width pixels
+ * Returns: Nothing
+ * Expectations: There is still a row left to read and Ppmrows_raster
+ *               has not been called; raises Pnm_Badformat if the stream
+ *               ends early
+ */
+void Ppmrows_read(T rows, struct Pnm_rgb *row)
+{
+        assert(rows != NULL && row != NULL);
+        assert(rows->rows_done < rows->height && rows->raster == NULL);
+
+        unsigned width = rows->width;
+        size_t row_bytes = Ppmrows_row_bytes(rows);
+
+        if (rows->plain) {
+                rows->rows_done++;
+                for (unsigned i = 0; i < width; i++) {
+                        row[i].red = read_header_num(rows->fp);
+                        row[i].green = read_header_num(rows->fp);
+                        row[i].blue = read_header_num(rows->fp);
+                }
+                return;
+        }
+
+        if (rows->mapped_raster != NULL) {
+                unpack_row(rows, rows->mapped_raster +
+                           rows->rows_done * row_bytes, row);
+        } else {
+                if (fread(rows->raw, row_bytes, 1, rows->fp) != 1) {
+                        RAISE(Pnm_Badformat);
+                }
+                unpack_row(rows, rows->raw, row);
+        }
+        rows->rows_done++;
+}
+
+/*
+ * Function: Ppmrows_sample_bytes
+ * Purpose: Gives the size of one raw sample
+ * Parameters: A Ppmrows_T
+ * Returns: 1 if the denominator is below 256, otherwise 2
+ */
+unsigned Ppmrows_sample_bytes(T rows)
+{
+        assert(rows != NULL);
+        return rows->denominator < 256 ? 1 : 2;
+}
+
+/*
+ * Function: Ppmrows_raster
+ * Purpose: Gives every row of the image at once as raw P6 samples, row
+ *          after row. A raw image in a regular file is not copied at
+ *          all: the raster is the mapping of the file. Otherwise it is
+ *          read into one buffer, and plain samples are packed as they
+ *          are parsed.
+ * Parameters: A Ppmrows_T from Ppmrows_new
+ * Returns: Ppmrows_row_bytes(rows) * height bytes, which stay valid
+ *          until Ppmrows_free
+ * Expectations: No row has been read with Ppmrows_read; raises
+ *               Pnm_Badformat if the stream ends early
+ */
+const unsigned char *Ppmrows_raster(T rows)
+{
+        assert(rows != NULL && rows->rows_done == 0);
+
+        if (rows->mapped_raster != NULL) {
+                return rows->mapped_raster;
+        }
+        if (rows->raster != NULL) {
+                return rows->raster;
+        }
+
+        size_t row_bytes = Ppmrows_row_bytes(rows);
+        size_t bytes = row_bytes * rows->height;
+        rows->raster = malloc(bytes);
+        assert(rows->raster != NULL);
+
+        if (!rows->plain) {
+                if (fread(rows->raster, 1, bytes, rows->fp) != bytes) {
+                        RAISE(Pnm_Badformat);
+                }
+                return rows->raster;
+        }
+        for (unsigned j = 0; j < rows->height; j++) {
+                read_plain_row(rows, rows->raster + j * row_bytes);
+        }
+        return rows->raster;
+}
+
+/*
+ * Function: Ppmrows_new_writer
+ * Purpose: Writes the header of a raw PPM image and sets up a Ppmrows_T
+ *          to write its rows
+ * Parameters: FILE pointer for output, the dimensions and denominator
+ * Returns: A new Ppmrows_T
+ * Expectations: The denominator is between 1 and 65535
+ */
+T Ppmrows_new_writer(FILE *fp, unsigned width, unsigned height,
+                     unsigned denominator)
+{
+        assert(fp != NULL);
+        assert(denominator > 0 && denominator <= 65535);
+
+        T rows = malloc(sizeof(*rows));
+        assert(rows != NULL);
+        rows->fp = fp;
+        rows->plain = 0;
+        rows->width = width;
+        rows->height = height;
+        rows->denominator = denominator;
+        rows->rows_done = 0;
+        rows->queued = 0;
+        rows->map = NULL;
+        rows->map_len = 0;
+        rows->mapped_raster = NULL;
+        rows->raster = NULL;
+
+        /* At least one row, and no more rows than the image has */
+        size_t row_bytes = Ppmrows_row_bytes(rows);
+        size_t chunk_rows = row_bytes > 0 ? PPMROWS_CHUNK / row_bytes : 1;
+        if (chunk_rows > height) {
+                chunk_rows = height;
+        }
+        rows->chunk_rows = chunk_rows > 0 ? chunk_rows : 1;
+        size_t bytes = rows->chunk_rows * row_bytes;
+        rows->raw = malloc(bytes > 0 ? bytes : 1);
+        assert(rows->raw != NULL);
+
+        fprintf(fp, "P6\n%u %u\n%u\n", width, height, denominator);
+        return rows;
+}
+
+/*
+ * Function: Ppmrows_write
+ * Purpose: Writes one row of pixels
+ * Parameters: A Ppmrows_T from Ppmrows_new_writer and a row of width
+ *             pixels
+ * Returns: Nothing
+ * Expectations: Same as Ppmrows_write_rows
+ */
+void Ppmrows_write(T rows, const struct Pnm_rgb *row)
+{
+        Ppmrows_write_rows(rows, row, 1);
+}
+
+/*
+ * Function: Ppmrows_write_rows
+ * Purpose: Packs 'count' rows of pixels that are one after another in
+ *          memory into the writer's buffer, writing the buffer out with
+ *          a single fwrite each time it fills and once the last row of
+ *          the image is in it
+ * Parameters: A Ppmrows_T from Ppmrows_new_writer, count * width pixels
+ *             and the number of rows
+ * Returns: Nothing
+ * Expectations: No more than height rows are written in all and every
+ *               sample is at most the denominator
+ */
+void Ppmrows_write_rows(T rows, const struct Pnm_rgb *pixels,
+                        unsigned count)
+{
+        assert(rows != NULL && (count == 0 || pixels != NULL));
+        assert(count <= rows->height - rows->rows_done);
+
+        size_t row_bytes = Ppmrows_row_bytes(rows);
+        for (unsigned k = 0; k < count; k++) {
+                Ppmrows_pack(rows, pixels + (size_t)k * rows->width,
+                             rows->raw + rows->queued * row_bytes);
+                rows->queued++;
+                rows->rows_done++;
+                if (rows->queued == rows->chunk_rows ||
+                    rows->rows_done == rows->height) {
+                        flush_chunk(rows);
+                }
+        }
+}
+
+/*
+ * Function: Ppmrows_row_bytes
+ * Purpose: Gives the size of one packed row
+ * Parameters: A Ppmrows_T
+ * Returns: 3 or 6 bytes per pixel, times the width
+ */
+size_t Ppmrows_row_bytes(T rows)
+{
+        assert(rows != NULL);
+        return (size_t)rows->width * 3 * (rows->denominator < 256 ? 1 : 2);
+}
+
+/*
+ * Function: Ppmrows_pack
+ * Purpose: Packs one row of pixels into raw samples without writing it.
+ *          It only reads the dimensions and denominator of 'rows', so
+ *          several threads may pack rows for the same writer at once.
+ * Parameters: A Ppmrows_T from Ppmrows_new_writer, a row of width pixels
+ *             and room for Ppmrows_row_bytes(rows) bytes
+ * Returns: Nothing
+ * Expectations: Every sample is at most the denominator
+ */
+void Ppmrows_pack(T rows, const struct Pnm_rgb *row, unsigned char *raw)
+{
+        assert(rows != NULL && row != NULL && raw != NULL);
+
+        unsigned width = rows->width;
+
+        if (rows->denominator < 256) {
+                for (unsigned i = 0; i < width; i++) {
+                        raw[3 * i] = row[i].red;
+                        raw[3 * i + 1] = row[i].green;
+                        raw[3 * i + 2] = row[i].blue;
+                }
+        } else {
+                for (unsigned i = 0; i < width; i++) {
+                        unsigned char *s = raw + 6 * i;
+                        s[0] = row[i].red >> 8;
+                        s[1] = row[i].red;
+                        s[2] = row[i].green >> 8;
+                        s[3] = row[i].green;
+                        s[4] = row[i].blue >> 8;
+                        s[5] = row[i].blue;
+                }
+        }
+}
+
+/*
+ * Function: Ppmrows_write_raw
+ * Purpose: Writes 'count' rows that were packed with Ppmrows_pack,
+ *          through the writer's buffer if they fit in it and otherwise
+ *          with a single fwrite
+ * Parameters: A Ppmrows_T from Ppmrows_new_writer, the packed rows one
+ *             after another, and their count
+ * Returns: Nothing
+ * Expectations: No more than height rows are written in all
+ */
+void Ppmrows_write_raw(T rows, const unsigned char *raw, unsigned count)
+{
+        assert(rows != NULL && (count == 0 || raw != NULL));
+        assert(count <= rows->height - rows->rows_done);
+        rows->rows_done += count;
+
+        /* A few rows join the buffer; a lot go out on their own, after
+         * any rows queued earlier
+         */
+        size_t row_bytes = Ppmrows_row_bytes(rows);
+        if (rows->queued + count <= rows->chunk_rows) {
+                memcpy(rows->raw + rows->queued * row_bytes, raw,
+                       count * row_bytes);
+                rows->queued += count;
+                if (rows->queued == rows->chunk_rows ||
+                    rows->rows_done == rows->height) {
+                        flush_chunk(rows);
+                }
+                return;
+        }
+        flush_chunk(rows);
+        fwrite(raw, row_bytes, count, rows->fp);
+}
+
+/* Skips whitespace and '#' comments in a PPM header */
+static void skip_space(FILE *fp)
+{
+        int c;
+        while ((c = getc(fp)) != EOF) {
+                if (c == '#') {
+                        while ((c = getc(fp)) != '\n' && c != EOF) {
+                        }
+                } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                        ungetc(c, fp);
+                        return;
+                }
+        }
+}
+
+/* Reads one unsigned decimal number, raising Pnm_Badformat on failure */
+static unsigned read_header_num(FILE *fp)
+{
+        unsigned n;
+        skip_space(fp);
+        if (fscanf(fp, "%u", &n) != 1) {
+                RAISE(Pnm_Badformat);
+        }
+        return n;
+}
+
+/* Maps a raw image that is in a regular file, if the whole raster is
+ * there; otherwise leaves rows to be read through the stream, which
+ * raises Pnm_Badformat where the image is cut short
+ */
+static void map_raster(T rows)
+{
+        struct stat st;
+        int fd = fileno(rows->fp);
+        off_t start = ftello(rows->fp);
+        if (fd < 0 || start < 0 || fstat(fd, &st) != 0 ||
+            !S_ISREG(st.st_mode)) {
+                return;
+        }
+
+        size_t bytes = Ppmrows_row_bytes(rows) * rows->height;
+        if (st.st_size <= start || (size_t)(st.st_size - start) < bytes) {
+                return;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+                return;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        rows->map = map;
+        rows->map_len = st.st_size;
+        rows->mapped_raster = rows->map + start;
+}
+
+/* Unpacks one raw row of 1 or 2 byte samples into pixels */
+static void unpack_row(T rows, const unsigned char *raw,
+                       struct Pnm_rgb *row)
+{
+        unsigned width = rows->width;
+
+        if (rows->denominator < 256) {
+                for (unsigned i = 0; i < width; i++) {
+                        row[i].red = raw[3 * i];
+                        row[i].green = raw[3 * i + 1];
+                        row[i].blue = raw[3 * i + 2];
+                }
+        } else {
+                for (unsigned i = 0; i < width; i++) {
+                        const unsigned char *s = raw + 6 * i;
+                        row[i].red = (s[0] << 8) | s[1];
+                        row[i].green = (s[2] << 8) | s[3];
+                        row[i].blue = (s[4] << 8) | s[5];
+                }
+        }
+}
+
+/* Parses one row of a plain image into raw samples */
+static void read_plain_row(T rows, unsigned char *raw)
+{
+        unsigned samples = rows->width * 3;
+
+        for (unsigned k = 0; k < samples; k++) {
+                unsigned n = read_header_num(rows->fp);
+                if (rows->denominator < 256) {
+                        raw[k] = n;
+                } else {
+                        raw[2 * k] = n >> 8;
+                        raw[2 * k + 1] = n;
+                }
+        }
+}
+
+/* Writes out the rows waiting in a writer's buffer */
+static void flush_chunk(T rows)
+{
+        if (rows->queued > 0) {
+                fwrite(rows->raw, Ppmrows_row_bytes(rows), rows->queued,
+                       rows->fp);
+                rows->queued = 0;
+        }
+}
@@ -0,0 +1,75 @@
+/* ppmrows.h
+ *
+ * Interface for reading and writing a PPM image one row at a time
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Unlike Pnm_ppmread, which builds the whole image in a UArray2 before
+ * returning, a Ppmrows_T only parses the header up front and then hands
+ * rows to the client as they are needed, so memory stays O(width).
+ * A writer is the mirror image: the header goes out when it is created
+ * and rows go out as the client produces them, through the same
+ * reusable row buffer.
+ *
+ * A raw image in a regular file is mapped rather than read, so rows come
+ * straight out of the page cache, and Ppmrows_raster can hand the client
+ * the file's own samples without building any copy of the image.
+ */
+
+#ifndef PPMROWS_INCLUDED
+#define PPMROWS_INCLUDED
+
+#include <stddef.h>
+#include <stdio.h>
+#include "pnm.h"
+
+#define T Ppmrows_T
+typedef struct T *T;
+
+/* Parses the header of a P6 (or P3) image; raises Pnm_Badformat */
+extern T        Ppmrows_new        (FILE *fp);
+extern void     Ppmrows_free       (T *rowsp);
+
+extern unsigned Ppmrows_width      (T rows);
+extern unsigned Ppmrows_height     (T rows);
+extern unsigned Ppmrows_denominator(T rows);
+
+/* Reads the next row of the image into 'row', which must hold
+ * Ppmrows_width(rows) pixels; it is a checked runtime error to
+ * read past the last row
+ */
+extern void     Ppmrows_read       (T rows, struct Pnm_rgb *row);
+
+/* The alternative to Ppmrows_read: every row at once, as raw P6 samples
+ * of Ppmrows_sample_bytes(rows) bytes each (big-endian when 2), with
+ * row j starting j * Ppmrows_row_bytes(rows) bytes in
+ */
+extern unsigned Ppmrows_sample_bytes(T rows);
+extern const unsigned char *Ppmrows_raster(T rows);
+
+/* Writes a raw (P6) header to 'fp' and returns a Ppmrows_T that the
+ * client then hands exactly 'height' rows to with Ppmrows_write or
+ * Ppmrows_write_rows; rows are packed into a buffer of about 1MB that is
+ * written whenever it fills, after the last row and by Ppmrows_free
+ */
+extern T        Ppmrows_new_writer (FILE *fp, unsigned width,
+                                    unsigned height, unsigned denominator);
+extern void     Ppmrows_write      (T rows, const struct Pnm_rgb *row);
+
+/* Writes 'count' rows that are one after another in 'pixels' */
+extern void     Ppmrows_write_rows (T rows, const struct Pnm_rgb *pixels,
+                                    unsigned count);
+
+/* Ppmrows_write in two steps, for clients that pack rows on several
+ * threads: Ppmrows_pack turns a row into Ppmrows_row_bytes(rows) raw
+ * bytes and touches nothing else, and Ppmrows_write_raw writes 'count'
+ * packed rows in order
+ */
+extern size_t   Ppmrows_row_bytes  (T rows);   /* readers too */
+extern void     Ppmrows_pack       (T rows, const struct Pnm_rgb *row,
+                                    unsigned char *raw);
+extern void     Ppmrows_write_raw  (T rows, const unsigned char *raw,
+                                    unsigned count);
+
+#undef T
+#endif
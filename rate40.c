@@ -0,0 +1,353 @@
+/* rate40.c
+ *
+ * Implementation file for the rate control in rate40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * The error of a block's four pixels in Y is the error of a, b, c and d
+ * spread by the 2x2 DCT, whose rows are orthogonal, so the mean squared
+ * error of a pixel's Y is the sum of the squared errors of a, b, c and
+ * d. Y goes into red, green and blue unchanged, and the error of the
+ * block chroma, which the scales do not touch, is added as it comes out
+ * of the inverse color transform. The two errors are taken not to be
+ * correlated, and what the clamp of red, green and blue to [0, 1] takes
+ * off the error is not counted, so the estimate is good to a few
+ * percent either way.
+ *
+ * The sizes are those Entropy40_bits gives for the counts, which are the
+ * same residual symbols Entropy40_put would count: a minus the median
+ * edge prediction, b, c and d as they are, and each chroma index minus
+ * the block to its left.
+ */
+
+#include "assert.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chroma40.h"
+#include "entropy40.h"
+#include "rate40.h"
+
+#define T Rate40_T
+
+/* Candidates, from the finest to the coarsest. A coefficient scale of
+ * 50 is the quantization of format 2; finer ones clamp at less than 0.3
+ * and coarser ones at more.
+ */
+static const unsigned Y_scales[] = {
+    511, 383, 255, 191, 127, 95, 63, 47, 31, 23, 15, 11
+};
+static const unsigned Coef_scales[] = {
+    200, 150, 100, 75, 50, 40, 30, 24, 20, 15, 12, 10
+};
+#define NY (sizeof(Y_scales) / sizeof(Y_scales[0]))
+#define NC (sizeof(Coef_scales) / sizeof(Coef_scales[0]))
+
+/* Symbols of the a, coefficient and chroma fields */
+#define A_SYMBOLS 512
+#define COEF_SYMBOLS 32
+
+struct T {
+    unsigned width, height, row;
+
+    /* Under every Y scale, a of the current block row and the one
+     * above it, which the prediction of a is made from
+     */
+    uint16_t *a_rows;
+
+    /* Chroma indices of the block to the left and of the first block of
+     * the row above
+     */
+    unsigned left[2], first[2];
+
+    /* The Pb and then the Pr of the current block row, and their
+     * indices
+     */
+    float *chroma;
+    unsigned *index;
+
+    uint64_t a_counts[NY][A_SYMBOLS];
+    uint64_t coef_counts[NC][3][COEF_SYMBOLS];
+    uint64_t chroma_counts[2][CHROMA40_LEVELS];
+
+    /* Squared errors: of a and of b, c and d, summed over the blocks,
+     * and of red, green and blue from the chroma, summed over the pixels
+     */
+    double a_error[NY], coef_error[NC], chroma_error;
+};
+
+/*
+ * Function: Rate40_new
+ * Purpose: Creates empty statistics for an image
+ * Parameters: The size of the image in blocks
+ * Returns: The statistics, to be released with Rate40_free
+ */
+T Rate40_new(unsigned width, unsigned height)
+{
+    T rate = calloc(1, sizeof(*rate));
+    assert(rate != NULL);
+    rate->width = width;
+    rate->height = height;
+    rate->a_rows = malloc(2 * NY * (size_t)width *
+                          sizeof(*rate->a_rows) + 1);
+    assert(rate->a_rows != NULL);
+    rate->chroma = malloc(2 * (size_t)width * sizeof(*rate->chroma) + 1);
+    rate->index = malloc(2 * (size_t)width * sizeof(*rate->index) + 1);
+    assert(rate->chroma != NULL && rate->index != NULL);
+    return rate;
+}
+
+/* Rate40_free
+ * Input: A pointer to statistics made by Rate40_new
+ * Does:  Frees them and sets the pointer to NULL
+ * Returns: Nothing
+ */
+void Rate40_free(T *rate)
+{
+    assert(rate != NULL && *rate != NULL);
+    free((*rate)->a_rows);
+    free((*rate)->chroma);
+    free((*rate)->index);
+    free(*rate);
+    *rate = NULL;
+}
+
+/* chroma_error
+ * Input: A pixel and the Pb and Pr its block decompresses to
+ * Does:  Finds what the difference does to its red, green and blue
+ * Returns: The sum of their squared errors
+ */
+static inline double chroma_error(const struct Component_vid *cv, float pb,
+                                  float pr)
+{
+    double db = cv->pb - pb, dr = cv->pr - pr;
+    double red = 1.402 * dr;
+    double green = 0.344136 * db + 0.714136 * dr;
+    double blue = 1.772 * db;
+    return red * red + green * green + blue * blue;
+}
+
+/*
+ * Function: Rate40_put
+ * Purpose: Counts the symbols and sums the errors of the next block row
+ *          under every candidate scale
+ * Parameters: The statistics, the two rows of component video of the
+ *             block row, 2 * width pixels each, and its width blocks
+ * Returns: Nothing
+ * Expectations: No more block rows are put than the image has
+ */
+void Rate40_put(T rate, const struct Component_vid *top,
+                const struct Component_vid *bottom,
+                const struct dct_elem *blocks)
+{
+    assert(rate != NULL && rate->row < rate->height);
+    assert(rate->width == 0 || (top != NULL && bottom != NULL &&
+                                 blocks != NULL));
+
+    unsigned width = rate->width, j = rate->row;
+
+    /* The chroma indices, which no scale changes, and their values */
+    float *chroma = rate->chroma;
+    unsigned *index = rate->index;
+    for (unsigned k = 0; k < width; k++) {
+        chroma[k] = blocks[k].average_pb;
+        chroma[width + k] = blocks[k].average_pr;
+    }
+    Chroma40_index_batch(chroma, index, 2 * width);
+    Chroma40_value_batch(index, chroma, 2 * width);
+
+    for (unsigned k = 0; k < width; k++) {
+        const struct dct_elem *block = &blocks[k];
+
+        for (unsigned y = 0; y < NY; y++) {
+            uint16_t *row = rate->a_rows + (2 * y + j % 2) * (size_t)width;
+            const uint16_t *above = rate->a_rows +
+                                    (2 * y + (j + 1) % 2) * (size_t)width;
+            unsigned scale = Y_scales[y];
+            unsigned a = Rate40_quantize_y(block->a, scale);
+            row[k] = a;
+
+            unsigned pred = k == 0 ? (j == 0 ? 0 : above[k])
+                          : j == 0 ? row[k - 1]
+                          : Entropy40_med(row[k - 1], above[k],
+                                          above[k - 1]);
+            rate->a_counts[y][(a - pred) & (A_SYMBOLS - 1)]++;
+
+            float error = block->a - (float)a / scale;
+            rate->a_error[y] += error * error;
+        }
+
+        const float coefs[3] = { block->b, block->c, block->d };
+        for (unsigned c = 0; c < NC; c++) {
+            unsigned scale = Coef_scales[c];
+            for (unsigned f = 0; f < 3; f++) {
+                int level = Rate40_quantize_coef(coefs[f], scale);
+                rate->coef_counts[c][f][level & (COEF_SYMBOLS - 1)]++;
+
+                float error = coefs[f] - (float)level / scale;
+                rate->coef_error[c] += error * error;
+            }
+        }
+
+        for (unsigned f = 0; f < 2; f++) {
+            unsigned level = index[f * width + k];
+            unsigned pred = k > 0 ? rate->left[f]
+                          : j > 0 ? rate->first[f] : 0;
+            rate->chroma_counts[f][(level - pred) &
+                                   (CHROMA40_LEVELS - 1)]++;
+            rate->left[f] = level;
+            if (k == 0) {
+                rate->first[f] = level;
+            }
+        }
+        float pb = chroma[k], pr = chroma[width + k];
+        rate->chroma_error += chroma_error(&top[2 * k], pb, pr) +
+                              chroma_error(&top[2 * k + 1], pb, pr) +
+                              chroma_error(&bottom[2 * k], pb, pr) +
+                              chroma_error(&bottom[2 * k + 1], pb, pr);
+    }
+    rate->row++;
+}
+
+/* A table of the size and mean squared error of the codewords under
+ * every pair of candidates, by Y scale and then coefficient scale
+ */
+typedef struct Outcomes {
+    size_t bytes[NY][NC];
+    double mse[NY][NC];
+} Outcomes;
+
+/* outcomes
+ * Input: Statistics of a whole image and an Outcomes to fill in
+ * Does:  Works out the size and error under every pair of candidates
+ * Returns: Nothing
+ */
+static void outcomes(T rate, Outcomes *out)
+{
+    assert(rate->row == rate->height);
+
+    double blocks = (double)rate->width * rate->height;
+    double a_bits[NY], coef_bits[NC];
+    for (unsigned y = 0; y < NY; y++) {
+        a_bits[y] = Entropy40_bits(rate->a_counts[y], A_SYMBOLS);
+    }
+    for (unsigned c = 0; c < NC; c++) {
+        coef_bits[c] = 0;
+        for (unsigned f = 0; f < 3; f++) {
+            coef_bits[c] += Entropy40_bits(rate->coef_counts[c][f],
+                                           COEF_SYMBOLS);
+        }
+    }
+    double chroma_bits = 0;
+    for (unsigned f = 0; f < 2; f++) {
+        chroma_bits += Entropy40_bits(rate->chroma_counts[f],
+                                      CHROMA40_LEVELS);
+    }
+    size_t framing = Entropy40_framing(rate->width, rate->height);
+
+    /* Per sample: Y errors once for each of red, green and blue, and the
+     * chroma errors of all three over the four pixels of every block
+     */
+    double chroma_mse = blocks > 0 ? rate->chroma_error / (12 * blocks)
+                                   : 0;
+    for (unsigned y = 0; y < NY; y++) {
+        for (unsigned c = 0; c < NC; c++) {
+            out->bytes[y][c] = framing + (size_t)ceil((a_bits[y] +
+                               coef_bits[c] + chroma_bits) / 8);
+            out->mse[y][c] = chroma_mse + (blocks > 0
+                             ? (rate->a_error[y] + rate->coef_error[c]) /
+                               blocks
+                             : 0);
+        }
+    }
+}
+
+/*
+ * Function: Rate40_for_bytes
+ * Purpose: Picks the scales that fit the codewords of an image into a
+ *          budget with the least error
+ * Parameters: Statistics of the whole image, and the budget in bytes for
+ *             everything after the header
+ * Returns: The scales, and whether they fit
+ * Expectations: Every block row has been put
+ */
+Rate40_scales Rate40_for_bytes(T rate, size_t bytes)
+{
+    assert(rate != NULL);
+    Outcomes *out = malloc(sizeof(*out));
+    assert(out != NULL);
+    outcomes(rate, out);
+
+    /* The least error among the pairs that fit, or else the smallest */
+    int best_y = -1, best_c = -1;
+    for (unsigned y = 0; y < NY; y++) {
+        for (unsigned c = 0; c < NC; c++) {
+            if (out->bytes[y][c] <= bytes &&
+                (best_y < 0 || out->mse[y][c] < out->mse[best_y][best_c])) {
+                best_y = y;
+                best_c = c;
+            }
+        }
+    }
+    int fits = best_y >= 0;
+    for (unsigned y = 0; !fits && y < NY; y++) {
+        for (unsigned c = 0; c < NC; c++) {
+            if (best_y < 0 ||
+                out->bytes[y][c] < out->bytes[best_y][best_c]) {
+                best_y = y;
+                best_c = c;
+            }
+        }
+    }
+
+    Rate40_scales scales = { Y_scales[best_y], Coef_scales[best_c], fits };
+    free(out);
+    return scales;
+}
+
+/*
+ * Function: Rate40_for_rms
+ * Purpose: Picks the scales that give the smallest codewords with an RMS
+ *          error no higher than a target
+ * Parameters: Statistics of the whole image, and the target RMS error of
+ *             samples scaled to [0, 1]
+ * Returns: The scales, and whether they meet the target
+ * Expectations: Every block row has been put
+ */
+Rate40_scales Rate40_for_rms(T rate, double rms)
+{
+    assert(rate != NULL);
+    Outcomes *out = malloc(sizeof(*out));
+    assert(out != NULL);
+    outcomes(rate, out);
+
+    /* The smallest among the pairs that meet the target, or else the
+     * one with the least error
+     */
+    double target = rms * rms;
+    int best_y = -1, best_c = -1;
+    for (unsigned y = 0; y < NY; y++) {
+        for (unsigned c = 0; c < NC; c++) {
+            if (out->mse[y][c] <= target &&
+                (best_y < 0 ||
+                 out->bytes[y][c] < out->bytes[best_y][best_c])) {
+                best_y = y;
+                best_c = c;
+            }
+        }
+    }
+    int meets = best_y >= 0;
+    for (unsigned y = 0; !meets && y < NY; y++) {
+        for (unsigned c = 0; c < NC; c++) {
+            if (best_y < 0 || out->mse[y][c] < out->mse[best_y][best_c]) {
+                best_y = y;
+                best_c = c;
+            }
+        }
+    }
+
+    Rate40_scales scales = { Y_scales[best_y], Coef_scales[best_c],
+                             meets };
+    free(out);
+    return scales;
+}
@@ -0,0 +1,80 @@
+/* rate40.h
+ *
+ * Interface for the rate control of COMP40 compressed image format 5
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Format 5 is format 3 with a quantization picked for each image: a is
+ * Y times a Y scale from 1 to 511 instead of 511, and b, c and d are
+ * coefficients times a coefficient scale, clamped to 15 levels either
+ * side of 0, instead of times 50 and clamped to 0.3. The header records
+ * both scales after the width and height.
+ *
+ * A Rate40_T is shown every block row of an image once. For each of a
+ * set of candidate Y scales and coefficient scales it counts the symbols
+ * the entropy coder would code and sums the squared error, which is all
+ * it needs to know the size and the RMS error of the image under every
+ * pair of candidates without coding it even once. The RMS error is that
+ * of ppmdiff, on samples scaled to [0, 1].
+ */
+
+#ifndef RATE40_INCLUDED
+#define RATE40_INCLUDED
+
+#include <math.h>
+#include <stddef.h>
+#include "dct40.h"
+
+#define T Rate40_T
+typedef struct T *T;
+
+/* The two scales of a format 5 image, and whether the image is expected
+ * to meet the target they were picked for
+ */
+typedef struct Rate40_scales {
+    unsigned y, coef;
+    int met;
+} Rate40_scales;
+
+/* Largest level of b, c and d either side of 0 */
+#define RATE40_LEVELS 15
+
+/* The quantizers of format 5 */
+static inline unsigned Rate40_quantize_y(float y, unsigned scale)
+{
+    long a = lroundf(y * scale);
+    return a < 0 ? 0 : (a > (long)scale ? scale : (unsigned)a);
+}
+
+static inline int Rate40_quantize_coef(float x, unsigned scale)
+{
+    long level = lroundf(x * scale);
+    return level < -RATE40_LEVELS ? -RATE40_LEVELS
+         : level > RATE40_LEVELS ? RATE40_LEVELS : (int)level;
+}
+
+/* Statistics of an image 'width' by 'height' blocks */
+extern T    Rate40_new (unsigned width, unsigned height);
+extern void Rate40_free(T *rate);
+
+/* Adds the next block row: its two rows of component video and the
+ * blocks Dct40_CV_to_DCT made of them
+ */
+extern void Rate40_put(T rate, const struct Component_vid *top,
+                       const struct Component_vid *bottom,
+                       const struct dct_elem *blocks);
+
+/* The candidates with the least error whose codewords take at most
+ * 'bytes', or the smallest there are if none do, in which case 'met' is
+ * 0
+ */
+extern Rate40_scales Rate40_for_bytes(T rate, size_t bytes);
+
+/* The candidates with the smallest codewords whose RMS error is at most
+ * 'rms', or those with the least error if none is that low, in which
+ * case 'met' is 0
+ */
+extern Rate40_scales Rate40_for_rms(T rate, double rms);
+
+#undef T
+#endif
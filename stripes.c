@@ -0,0 +1,244 @@
+/* stripes.c
+ *
+ * Implementation file for the ordered stripe pool in stripes.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "assert.h"
+#include "stripes.h"
+
+#define T Stripes_T
+
+/*
+ * Struct to hold the pool
+ * Contains - the client's slots, work function and closure
+ *            the worker threads
+ *            counts of stripes posted, taken by a worker and released,
+ *            which only grow; stripe k lives in slot k % nslots
+ *            whether the work on the stripe in each slot is finished
+ *            whether the client has posted its last stripe
+ *            a lock over the counts and flags, and one condition that
+ *            is broadcast whenever any of them changes
+ */
+struct T {
+        void **slots;
+        unsigned nslots;
+        Stripes_work *work;
+        void *cl;
+
+        pthread_t *workers;
+        unsigned threads;
+
+        unsigned posted, taken, released;
+        int *done;
+        int closed;
+
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+};
+
+static void *run_worker(void *arg);
+
+/*
+ * Function: Stripes_new
+ * Purpose: Sets up the ring and starts the workers
+ * Parameters: The number of threads, the number of slots, the slots,
+ *             the work function and its closure
+ * Returns: A new Stripes_T
+ * Expectations: threads and nslots are at least 1, slots and work are
+ *               not NULL
+ */
+T Stripes_new(unsigned threads, unsigned nslots, void **slots,
+              Stripes_work *work, void *cl)
+{
+        assert(threads >= 1 && nslots >= 1);
+        assert(slots != NULL && work != NULL);
+
+        T stripes = malloc(sizeof(*stripes));
+        assert(stripes != NULL);
+        stripes->slots = slots;
+        stripes->nslots = nslots;
+        stripes->work = work;
+        stripes->cl = cl;
+        stripes->posted = 0;
+        stripes->taken = 0;
+        stripes->released = 0;
+        stripes->done = calloc(nslots, sizeof(*stripes->done));
+        assert(stripes->done != NULL);
+        stripes->closed = 0;
+        pthread_mutex_init(&stripes->lock, NULL);
+        pthread_cond_init(&stripes->changed, NULL);
+
+        stripes->threads = threads;
+        stripes->workers = malloc(threads * sizeof(*stripes->workers));
+        assert(stripes->workers != NULL);
+        for (unsigned t = 0; t < threads; t++) {
+                int err = pthread_create(&stripes->workers[t], NULL,
+                                         run_worker, stripes);
+                assert(err == 0);
+        }
+
+        return stripes;
+}
+
+/*
+ * Function: Stripes_free
+ * Purpose: Closes the ring, joins the workers and frees the pool
+ * Parameters: Pointer to the Stripes_T to free
+ * Returns: Nothing
+ * Expectations: stripesp and *stripesp are not NULL
+ */
+void Stripes_free(T *stripesp)
+{
+        assert(stripesp != NULL && *stripesp != NULL);
+        T stripes = *stripesp;
+
+        Stripes_close(stripes);
+        for (unsigned t = 0; t < stripes->threads; t++) {
+                pthread_join(stripes->workers[t], NULL);
+        }
+
+        pthread_mutex_destroy(&stripes->lock);
+        pthread_cond_destroy(&stripes->changed);
+        free(stripes->workers);
+        free(stripes->done);
+        free(stripes);
+        *stripesp = NULL;
+}
+
+/*
+ * Function: Stripes_claim
+ * Purpose: Finds the slot for the next stripe
+ * Parameters: The pool
+ * Returns: The slot, or NULL if the ring is full
+ * Expectations: The ring is not closed
+ */
+void *Stripes_claim(T stripes)
+{
+        assert(stripes != NULL);
+
+        pthread_mutex_lock(&stripes->lock);
+        assert(!stripes->closed);
+        void *slot = NULL;
+        if (stripes->posted - stripes->released < stripes->nslots) {
+                slot = stripes->slots[stripes->posted % stripes->nslots];
+        }
+        pthread_mutex_unlock(&stripes->lock);
+
+        return slot;
+}
+
+/*
+ * Function: Stripes_post
+ * Purpose: Hands the claimed slot to the workers
+ * Parameters: The pool
+ * Returns: Nothing
+ * Expectations: A slot was claimed since the last post
+ */
+void Stripes_post(T stripes)
+{
+        assert(stripes != NULL);
+
+        pthread_mutex_lock(&stripes->lock);
+        assert(stripes->posted - stripes->released < stripes->nslots);
+        stripes->done[stripes->posted % stripes->nslots] = 0;
+        stripes->posted++;
+        pthread_cond_broadcast(&stripes->changed);
+        pthread_mutex_unlock(&stripes->lock);
+}
+
+/*
+ * Function: Stripes_close
+ * Purpose: Lets the workers exit once every posted stripe is taken
+ * Parameters: The pool
+ * Returns: Nothing
+ */
+void Stripes_close(T stripes)
+{
+        assert(stripes != NULL);
+
+        pthread_mutex_lock(&stripes->lock);
+        stripes->closed = 1;
+        pthread_cond_broadcast(&stripes->changed);
+        pthread_mutex_unlock(&stripes->lock);
+}
+
+/*
+ * Function: Stripes_oldest
+ * Purpose: Waits for the oldest unreleased stripe
+ * Parameters: The pool
+ * Returns: Its slot, or NULL if there is none
+ */
+void *Stripes_oldest(T stripes)
+{
+        assert(stripes != NULL);
+
+        pthread_mutex_lock(&stripes->lock);
+        void *slot = NULL;
+        if (stripes->released < stripes->posted) {
+                unsigned k = stripes->released % stripes->nslots;
+                while (!stripes->done[k]) {
+                        pthread_cond_wait(&stripes->changed, &stripes->lock);
+                }
+                slot = stripes->slots[k];
+        }
+        pthread_mutex_unlock(&stripes->lock);
+
+        return slot;
+}
+
+/*
+ * Function: Stripes_release
+ * Purpose: Frees the slot of the oldest stripe for reuse
+ * Parameters: The pool
+ * Returns: Nothing
+ * Expectations: Stripes_oldest returned that slot
+ */
+void Stripes_release(T stripes)
+{
+        assert(stripes != NULL);
+
+        pthread_mutex_lock(&stripes->lock);
+        assert(stripes->released < stripes->posted);
+        assert(stripes->done[stripes->released % stripes->nslots]);
+        stripes->released++;
+        pthread_mutex_unlock(&stripes->lock);
+}
+
+/*
+ * Function: run_worker
+ * Purpose: Body of each worker thread: works on posted stripes in the
+ *          order they were posted until the ring is closed and empty
+ * Parameters: The pool, as a void pointer
+ * Returns: NULL
+ */
+static void *run_worker(void *arg)
+{
+        T stripes = arg;
+
+        pthread_mutex_lock(&stripes->lock);
+        for (;;) {
+                while (stripes->taken == stripes->posted &&
+                       !stripes->closed) {
+                        pthread_cond_wait(&stripes->changed, &stripes->lock);
+                }
+                if (stripes->taken == stripes->posted) {
+                        break;
+                }
+                unsigned seq = stripes->taken++;
+                unsigned k = seq % stripes->nslots;
+                pthread_mutex_unlock(&stripes->lock);
+
+                stripes->work(stripes->slots[k], seq, stripes->cl);
+
+                pthread_mutex_lock(&stripes->lock);
+                stripes->done[k] = 1;
+                pthread_cond_broadcast(&stripes->changed);
+        }
+        pthread_mutex_unlock(&stripes->lock);
+
+        return NULL;
+}
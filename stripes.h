@@ -0,0 +1,54 @@
+/* stripes.h
+ *
+ * Interface for working on the stripes of an image on a pool of threads
+ * while keeping them in order
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * A Stripes_T owns a pool of worker threads and a ring of client slots,
+ * each big enough for one stripe. The client thread claims a slot, fills
+ * it with the input for the next stripe and posts it; a worker then runs
+ * the client's work function on it. Workers may finish out of order, but
+ * Stripes_oldest hands stripes back in the order they were posted, so
+ * the client can write its output as if the work had been serial. A slot
+ * is reused only after the client releases it.
+ */
+
+#ifndef STRIPES_INCLUDED
+#define STRIPES_INCLUDED
+
+#define T Stripes_T
+typedef struct T *T;
+
+/* Called on a worker thread with a posted slot and its stripe number,
+ * counting from 0 in the order stripes were posted
+ */
+typedef void Stripes_work(void *slot, unsigned seq, void *cl);
+
+/* Starts 'threads' workers on a ring of 'nslots' client slots */
+extern T     Stripes_new    (unsigned threads, unsigned nslots, void **slots,
+                             Stripes_work *work, void *cl);
+
+/* Closes the ring if the client has not, and waits for the workers to
+ * finish; the slots belong to the client and are not freed
+ */
+extern void  Stripes_free   (T *stripesp);
+
+/* The slot for the next stripe, or NULL if every slot is posted and not
+ * yet released
+ */
+extern void *Stripes_claim  (T stripes);
+extern void  Stripes_post   (T stripes);
+
+/* Tells the workers no more stripes will be posted */
+extern void  Stripes_close  (T stripes);
+
+/* Waits for the oldest unreleased stripe to be worked on and returns its
+ * slot, or returns NULL if nothing is posted and unreleased;
+ * Stripes_release then hands the slot back for reuse
+ */
+extern void *Stripes_oldest (T stripes);
+extern void  Stripes_release(T stripes);
+
+#undef T
+#endif
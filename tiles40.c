@@ -0,0 +1,229 @@
+/* tiles40.c
+ *
+ * Implementation file for the format 6 tile index in tiles40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ */
+
+#include "assert.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include "tiles40.h"
+
+#define T Tiles40_T
+
+/* Bytes of each offset in the index */
+#define OFFSET_BYTES 8
+
+struct T {
+    unsigned width, height, tile;
+    unsigned cols, rows;
+    size_t count;
+
+    /* count + 1 offsets, of which the first 'added' + 1 are known */
+    uint64_t *offsets;
+    size_t added;
+
+    /* For a decompressor: the file offset of the first byte after the
+     * index, or -1 if the input cannot seek, and how far past the index
+     * it has read if it cannot
+     */
+    off_t start;
+    uint64_t pos;
+};
+
+/*
+ * Function: Tiles40_new
+ * Purpose: Works out the tiles of an image
+ * Parameters: The width and height of the image, trimmed to even
+ *             numbers, and the side of a tile
+ * Returns: The tiles, to be released with Tiles40_free; if width or
+ *          height is 0 there are no tile columns and no tile rows
+ * Expectations: tile is even and not 0, and so are width and height
+ *               unless they are 0
+ */
+T Tiles40_new(unsigned width, unsigned height, unsigned tile)
+{
+    assert(tile > 0 && tile % 2 == 0 && width % 2 == 0 &&
+           height % 2 == 0);
+
+    T tiles = malloc(sizeof(*tiles));
+    assert(tiles != NULL);
+    tiles->width = width;
+    tiles->height = height;
+    tiles->tile = tile;
+    tiles->cols = width / tile + (width % tile != 0);
+    tiles->rows = height / tile + (height % tile != 0);
+
+    /* An image with no pixels has no tiles, even if one side is not 0 */
+    if (tiles->cols == 0 || tiles->rows == 0) {
+        tiles->cols = tiles->rows = 0;
+    }
+    tiles->count = (size_t)tiles->cols * tiles->rows;
+    tiles->offsets = malloc((tiles->count + 1) * sizeof(*tiles->offsets));
+    assert(tiles->offsets != NULL);
+    tiles->offsets[0] = 0;
+    tiles->added = 0;
+    tiles->start = -1;
+    tiles->pos = 0;
+    return tiles;
+}
+
+/* Tiles40_free
+ * Input: A pointer to tiles made by Tiles40_new
+ * Does:  Frees them and sets the pointer to NULL
+ * Returns: Nothing
+ */
+void Tiles40_free(T *tiles)
+{
+    assert(tiles != NULL && *tiles != NULL);
+    free((*tiles)->offsets);
+    free(*tiles);
+    *tiles = NULL;
+}
+
+unsigned Tiles40_cols(T tiles)
+{
+    assert(tiles != NULL);
+    return tiles->cols;
+}
+
+unsigned Tiles40_rows(T tiles)
+{
+    assert(tiles != NULL);
+    return tiles->rows;
+}
+
+/*
+ * Function: Tiles40_rect
+ * Purpose: Finds the pixels of a tile
+ * Parameters: The tiles, the column and row of one of them, and where to
+ *             put the position of its top left pixel and its size
+ * Returns: Nothing
+ * Expectations: The tile is in the image
+ */
+void Tiles40_rect(T tiles, unsigned col, unsigned row, unsigned *x,
+                  unsigned *y, unsigned *w, unsigned *h)
+{
+    assert(tiles != NULL && col < tiles->cols && row < tiles->rows);
+    *x = col * tiles->tile;
+    *y = row * tiles->tile;
+    *w = tiles->width - *x < tiles->tile ? tiles->width - *x : tiles->tile;
+    *h = tiles->height - *y < tiles->tile ? tiles->height - *y
+                                          : tiles->tile;
+}
+
+/*
+ * Function: Tiles40_add
+ * Purpose: Records the size of the next tile
+ * Parameters: The tiles and the size of the next one in bytes
+ * Returns: Nothing
+ * Expectations: Not every tile has been added yet
+ */
+void Tiles40_add(T tiles, size_t bytes)
+{
+    assert(tiles != NULL && tiles->added < tiles->count);
+    tiles->offsets[tiles->added + 1] = tiles->offsets[tiles->added] + bytes;
+    tiles->added++;
+}
+
+/*
+ * Function: Tiles40_write
+ * Purpose: Queues the index
+ * Parameters: The tiles and the writer, just past the header
+ * Returns: Nothing
+ * Expectations: Every tile has been added
+ */
+void Tiles40_write(T tiles, Codewords_T out)
+{
+    assert(tiles != NULL && tiles->added == tiles->count);
+    for (size_t k = 0; k <= tiles->count; k++) {
+        unsigned char bytes[OFFSET_BYTES];
+        for (unsigned b = 0; b < OFFSET_BYTES; b++) {
+            bytes[b] = tiles->offsets[k] >> (8 * (OFFSET_BYTES - 1 - b));
+        }
+        Codewords_write(out, bytes, OFFSET_BYTES);
+    }
+}
+
+/*
+ * Function: Tiles40_read
+ * Purpose: Reads the index and notes where it ends in the file, if the
+ *          input can seek
+ * Parameters: The tiles and the input, just past the header
+ * Returns: Nothing
+ * Expectations: The index is whole and its offsets go up from 0
+ */
+void Tiles40_read(T tiles, FILE *input)
+{
+    assert(tiles != NULL && input != NULL);
+    for (size_t k = 0; k <= tiles->count; k++) {
+        unsigned char bytes[OFFSET_BYTES];
+        size_t got = fread(bytes, 1, OFFSET_BYTES, input);
+        assert(got == OFFSET_BYTES);
+        uint64_t offset = 0;
+        for (unsigned b = 0; b < OFFSET_BYTES; b++) {
+            offset = offset << 8 | bytes[b];
+        }
+        assert(k == 0 ? offset == 0 : offset >= tiles->offsets[k - 1]);
+        tiles->offsets[k] = offset;
+    }
+    tiles->added = tiles->count;
+
+    /* A pipe has no position, and the tiles must then be read in order */
+    tiles->start = ftello(input);
+    tiles->pos = 0;
+}
+
+/*
+ * Function: Tiles40_locate
+ * Purpose: Finds the bytes of a tile in the file
+ * Parameters: The tiles, the column and row of one of them, and where to
+ *             put its offset and size
+ * Returns: Nothing
+ * Expectations: The index has been read
+ */
+void Tiles40_locate(T tiles, unsigned col, unsigned row, uint64_t *offset,
+                    size_t *bytes)
+{
+    assert(tiles != NULL && col < tiles->cols && row < tiles->rows);
+    assert(tiles->added == tiles->count);
+    size_t k = (size_t)row * tiles->cols + col;
+    *offset = tiles->offsets[k] + (tiles->start >= 0 ? tiles->start : 0);
+    *bytes = tiles->offsets[k + 1] - tiles->offsets[k];
+}
+
+/*
+ * Function: Tiles40_load
+ * Purpose: Reads the bytes of a tile, seeking to them if the input can
+ *          and otherwise reading past whatever comes before them
+ * Parameters: The tiles, the input the index was read from, the column
+ *             and row of a tile, and where to put its size
+ * Returns: The bytes, in a buffer the caller frees
+ * Expectations: The input holds the whole tile and, unless it can seek,
+ *               no later tile has been loaded
+ */
+unsigned char *Tiles40_load(T tiles, FILE *input, unsigned col,
+                            unsigned row, size_t *bytes)
+{
+    uint64_t offset;
+    Tiles40_locate(tiles, col, row, &offset, bytes);
+
+    if (tiles->start >= 0) {
+        int err = fseeko(input, (off_t)offset, SEEK_SET);
+        assert(err == 0);
+    } else {
+        assert(offset >= tiles->pos);
+        for (; tiles->pos < offset; tiles->pos++) {
+            int c = getc(input);
+            assert(c != EOF);
+        }
+        tiles->pos += *bytes;
+    }
+
+    unsigned char *buf = malloc(*bytes + 1);
+    assert(buf != NULL);
+    size_t got = fread(buf, 1, *bytes, input);
+    assert(got == *bytes);
+    return buf;
+}
@@ -0,0 +1,68 @@
+/* tiles40.h
+ *
+ * Interface for the tile index of COMP40 compressed image format 6
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Format 6 cuts an image, trimmed to even dimensions, into tiles of
+ * 'tile' by 'tile' pixels, 'tile' being even; the tiles in the last
+ * column and row are narrower or shorter when the image is not a
+ * multiple of the tile size. Every tile is compressed on its own into a
+ * complete compressed image of format 2 or 3, header included, so it
+ * can be decoded without anything else in the file.
+ *
+ * After the text header comes the index: the offset of every tile, in
+ * row-major order, and then the offset just past the last one, each as
+ * an 8-byte big-endian number counted from the first byte after the
+ * index. The first offset is always 0, and tile k is the bytes from
+ * offset k up to offset k + 1. Then come the tiles, in the same order.
+ */
+
+#ifndef TILES40_INCLUDED
+#define TILES40_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "codewords.h"
+
+#define T Tiles40_T
+typedef struct T *T;
+
+/* The tiles of a 'width' by 'height' image; both and 'tile' are even.
+ * If either side is 0 the image has no tiles at all.
+ */
+extern T    Tiles40_new (unsigned width, unsigned height, unsigned tile);
+extern void Tiles40_free(T *tiles);
+
+/* Tiles across and down the image */
+extern unsigned Tiles40_cols(T tiles);
+extern unsigned Tiles40_rows(T tiles);
+
+/* Where the tile in column 'col' and row 'row' is in the image */
+extern void Tiles40_rect(T tiles, unsigned col, unsigned row, unsigned *x,
+                         unsigned *y, unsigned *w, unsigned *h);
+
+/* For a compressor: records the size of every tile in turn, in
+ * row-major order, then writes the index once all of them are known
+ */
+extern void Tiles40_add  (T tiles, size_t bytes);
+extern void Tiles40_write(T tiles, Codewords_T out);
+
+/* For a decompressor: reads the index that follows the header in
+ * 'input'. A tile server can then fetch the bytes of a tile on its own
+ * with Tiles40_locate, whose offset counts from the start of the file
+ * when 'input' could tell where the index ended, and from the first
+ * byte after the index otherwise; Tiles40_load reads them into a buffer
+ * the caller frees. It is a checked runtime error for the index to be
+ * cut short or out of order, or, unless 'input' can seek, to load a
+ * tile that comes before one already loaded.
+ */
+extern void Tiles40_read  (T tiles, FILE *input);
+extern void Tiles40_locate(T tiles, unsigned col, unsigned row,
+                           uint64_t *offset, size_t *bytes);
+extern unsigned char *Tiles40_load(T tiles, FILE *input, unsigned col,
+                                   unsigned row, size_t *bytes);
+
+#undef T
+#endif
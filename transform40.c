@@ -0,0 +1,492 @@
+/* transform40.c
+ *
+ * Implementation file for the block transform in transform40.h
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Luma is taken to 10 bits, X = round(1023 * Y), before the transform.
+ * The HEVC matrices C are 64 * sqrt(n) times the orthonormal DCT matrix
+ * D, so Z = C X C^T is 4096 * n times the orthonormal coefficients and
+ * fits in 32 bits for n of 8. A coefficient k of the orthonormal DCT of
+ * Y is quantized with step q[k]; the DC coefficient is n times the mean
+ * of the block, which is from 0 to n, so its step is n / 511 and it
+ * takes 9 bits without a sign.
+ *
+ * The inverse works on levels times 256 * 1023 * q[k], rounded to an
+ * integer once for each coefficient. The first pass is shifted right
+ * by 9, which leaves the second 2048 * n times X, and both passes stay
+ * within 31 bits for every level a block can hold.
+ *
+ * Each pass is the even-odd butterfly of the HEVC reference decoder, so
+ * an 8-point transform is 22 multiplies instead of 64; a pass transposes
+ * its block, so two passes leave it the right way around.
+ */
+
+#include "assert.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pnm.h"
+#include "dct40.h"
+#include "chroma40.h"
+#include "transform40.h"
+
+#define T Transform40_T
+
+/* Largest block side, and the coefficients in such a block */
+#define MAX_N 8
+#define MAX_COEFS (MAX_N * MAX_N)
+
+/* Bits of the DC level, and the largest one */
+#define DC_BITS 9
+#define DC_MAX 511
+
+/* Bits of the Pb and Pr indices */
+#define CHROMA_BITS 4
+
+struct T {
+    unsigned n, shift;      /* side of a block, and 11 + log2 n */
+    unsigned blocks;        /* most blocks in a block row */
+    const unsigned char *zigzag;
+
+    unsigned ncoefs;                /* coefficients that get bits */
+    unsigned char index[MAX_COEFS]; /* where each one is in the block */
+    unsigned char bits[MAX_COEFS];
+    double scale[MAX_COEFS];        /* 1 / (4096 * n * 1023 * step) */
+    int32_t mult[MAX_COEFS];        /* 256 * 1023 * step, rounded */
+
+    /* n rows of component video, blocks * n pixels each */
+    float *y, *pb, *pr;
+
+    /* Pb and Pr of one row of pixel pairs, for Dct40_luma_to_pixels,
+     * and their chroma indices, Pb then Pr, as the blocks unpack them
+     */
+    float *pair_pb, *pair_pr;
+    unsigned *pair_index;
+    size_t pairs;
+};
+
+static const unsigned char zigzag4[4 * 4] = {
+    0,  1,  4,  8,  5,  2,  3,  6,  9, 12, 13, 10,  7, 11, 14, 15
+};
+
+static const unsigned char zigzag8[8 * 8] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* AC coefficients by zigzag position: up to the 'last' one they get
+ * 'bits' bits and a step of 'step'. A 4x4 block is 9 + 4 + 4 + 47 = 64
+ * bits and an 8x8 block 9 + 4 + 4 + 111 = 128.
+ */
+typedef struct Band {
+    unsigned last, bits;
+    double step;
+} Band;
+
+static const Band bands4[] = {
+    {  2, 6, 0.04 }, {  5, 5, 0.05 }, {  9, 4, 0.07 }, { 11, 2, 0.10 },
+    {  0, 0, 0 }
+};
+
+static const Band bands8[] = {
+    {  2, 7, 0.04 }, {  5, 6, 0.05 }, {  9, 5, 0.06 }, { 14, 4, 0.08 },
+    { 27, 3, 0.10 }, {  0, 0, 0 }
+};
+
+/* Writes fields MSB first into consecutive 32-bit words */
+typedef struct Bit_writer {
+    uint64_t acc;
+    unsigned nbits;
+    uint32_t *word;
+} Bit_writer;
+
+static inline void put_bits(Bit_writer *w, uint32_t value, unsigned bits)
+{
+    w->acc = (w->acc << bits) | (value & ((1u << bits) - 1));
+    w->nbits += bits;
+    if (w->nbits >= 32) {
+        w->nbits -= 32;
+        *w->word++ = (uint32_t)(w->acc >> w->nbits);
+    }
+}
+
+/* Reads back what a Bit_writer wrote */
+typedef struct Bit_reader {
+    uint64_t acc;
+    unsigned nbits;
+    const uint32_t *word;
+} Bit_reader;
+
+static inline uint32_t get_bits(Bit_reader *r, unsigned bits)
+{
+    if (r->nbits < bits) {
+        r->acc = (r->acc << 32) | *r->word++;
+        r->nbits += 32;
+    }
+    r->nbits -= bits;
+    return (uint32_t)(r->acc >> r->nbits) & ((1u << bits) - 1);
+}
+
+static inline int32_t get_signed(Bit_reader *r, unsigned bits)
+{
+    uint32_t value = get_bits(r, bits);
+    uint32_t sign = 1u << (bits - 1);
+    return (int32_t)(value ^ sign) - (int32_t)sign;
+}
+
+/* The 1-D transforms below work on the n rows of 'src' and write the
+ * transform of row j to column j of 'dst'. The forward ones multiply by
+ * the HEVC matrix
+ *
+ *     64  64  64  64  64  64  64  64
+ *     89  75  50  18 -18 -50 -75 -89
+ *     83  36 -36 -83 -83 -36  36  83
+ *     75 -18 -89 -50  50  89  18 -75
+ *     64 -64 -64  64  64 -64 -64  64
+ *     50 -89  18  75 -75 -18  89 -50
+ *     36 -83  83 -36 -36  83 -83  36
+ *     18 -50  75 -89  89 -75  50 -18
+ *
+ * or by its even rows at the left, 64 64, 83 36, 64 -64 and 36 -83 and
+ * their mirror images, for n of 4; the inverse ones multiply by its
+ * transpose and round off 'shift' bits.
+ */
+static inline void forward4(const int32_t *src, int32_t *dst)
+{
+    for (unsigned j = 0; j < 4; j++, src += 4) {
+        int32_t e0 = src[0] + src[3], o0 = src[0] - src[3];
+        int32_t e1 = src[1] + src[2], o1 = src[1] - src[2];
+        dst[j]      = 64 * (e0 + e1);
+        dst[8 + j]  = 64 * (e0 - e1);
+        dst[4 + j]  = 83 * o0 + 36 * o1;
+        dst[12 + j] = 36 * o0 - 83 * o1;
+    }
+}
+
+static inline void forward8(const int32_t *src, int32_t *dst)
+{
+    for (unsigned j = 0; j < 8; j++, src += 8) {
+        int32_t e[4], o[4];
+        for (unsigned k = 0; k < 4; k++) {
+            e[k] = src[k] + src[7 - k];
+            o[k] = src[k] - src[7 - k];
+        }
+        int32_t ee0 = e[0] + e[3], eo0 = e[0] - e[3];
+        int32_t ee1 = e[1] + e[2], eo1 = e[1] - e[2];
+        dst[j]      = 64 * (ee0 + ee1);
+        dst[32 + j] = 64 * (ee0 - ee1);
+        dst[16 + j] = 83 * eo0 + 36 * eo1;
+        dst[48 + j] = 36 * eo0 - 83 * eo1;
+        dst[8 + j]  = 89 * o[0] + 75 * o[1] + 50 * o[2] + 18 * o[3];
+        dst[24 + j] = 75 * o[0] - 18 * o[1] - 89 * o[2] - 50 * o[3];
+        dst[40 + j] = 50 * o[0] - 89 * o[1] + 18 * o[2] + 75 * o[3];
+        dst[56 + j] = 18 * o[0] - 50 * o[1] + 75 * o[2] - 89 * o[3];
+    }
+}
+
+static inline void inverse4(const int32_t *src, int32_t *dst,
+                            unsigned shift)
+{
+    int32_t round = 1 << (shift - 1);
+    for (unsigned j = 0; j < 4; j++, src += 4) {
+        int32_t o0 = 83 * src[1] + 36 * src[3];
+        int32_t o1 = 36 * src[1] - 83 * src[3];
+        int32_t e0 = 64 * (src[0] + src[2]);
+        int32_t e1 = 64 * (src[0] - src[2]);
+        dst[j]      = (e0 + o0 + round) >> shift;
+        dst[4 + j]  = (e1 + o1 + round) >> shift;
+        dst[8 + j]  = (e1 - o1 + round) >> shift;
+        dst[12 + j] = (e0 - o0 + round) >> shift;
+    }
+}
+
+static inline void inverse8(const int32_t *src, int32_t *dst,
+                            unsigned shift)
+{
+    int32_t round = 1 << (shift - 1);
+    for (unsigned j = 0; j < 8; j++, src += 8) {
+        int32_t o[4] = {
+            89 * src[1] + 75 * src[3] + 50 * src[5] + 18 * src[7],
+            75 * src[1] - 18 * src[3] - 89 * src[5] - 50 * src[7],
+            50 * src[1] - 89 * src[3] + 18 * src[5] + 75 * src[7],
+            18 * src[1] - 50 * src[3] + 75 * src[5] - 89 * src[7]
+        };
+        int32_t eo0 = 83 * src[2] + 36 * src[6];
+        int32_t eo1 = 36 * src[2] - 83 * src[6];
+        int32_t ee0 = 64 * (src[0] + src[4]);
+        int32_t ee1 = 64 * (src[0] - src[4]);
+        int32_t e[4] = { ee0 + eo0, ee1 + eo1, ee1 - eo1, ee0 - eo0 };
+        for (unsigned k = 0; k < 4; k++) {
+            dst[8 * k + j]       = (e[k] + o[k] + round) >> shift;
+            dst[8 * (7 - k) + j] = (e[k] - o[k] + round) >> shift;
+        }
+    }
+}
+
+/*
+ * Function: Transform40_supported
+ * Purpose: Tells whether n by n blocks have a transform
+ * Parameters: The side of a block
+ * Returns: 1 for 4 and 8, 0 for anything else
+ */
+int Transform40_supported(unsigned n)
+{
+    return n == 4 || n == 8;
+}
+
+/*
+ * Function: Transform40_words
+ * Purpose: Gives the size of a compressed n by n block
+ * Parameters: The side of a block
+ * Returns: Its codewords: 2 for 4x4 blocks and 4 for 8x8 blocks
+ * Expectations: Transform40_supported(n)
+ */
+unsigned Transform40_words(unsigned n)
+{
+    assert(Transform40_supported(n));
+    return n == 4 ? 2 : 4;
+}
+
+/*
+ * Function: Transform40_new
+ * Purpose: Builds the quantization tables for n by n blocks and the
+ *          scratch space for a block row
+ * Parameters: The side of a block and the most blocks in a block row
+ * Returns: The new Transform40_T
+ * Expectations: Transform40_supported(n); asserts that every allocation
+ *               succeeds
+ */
+T Transform40_new(unsigned n, unsigned blocks)
+{
+    assert(Transform40_supported(n));
+
+    T transform = malloc(sizeof(*transform));
+    assert(transform != NULL);
+    transform->n = n;
+    transform->shift = n == 4 ? 13 : 14;
+    transform->blocks = blocks;
+    transform->zigzag = n == 4 ? zigzag4 : zigzag8;
+
+    /* The DC coefficient first, then every AC band in turn */
+    const Band *band = n == 4 ? bands4 : bands8;
+    double step = (double)n / DC_MAX;
+    unsigned bits = DC_BITS;
+    unsigned k = 0;
+    for (unsigned z = 0; bits != 0; z++) {
+        transform->index[k] = transform->zigzag[z];
+        transform->bits[k] = bits;
+        transform->scale[k] = 1.0 / (4096.0 * n * 1023.0 * step);
+        transform->mult[k] = (int32_t)lround(256.0 * 1023.0 * step);
+        k++;
+        if (z == 0 || z == band->last) {
+            band += z != 0;
+            bits = band->bits;
+            step = band->step;
+        }
+    }
+    transform->ncoefs = k;
+
+    size_t pixels = (size_t)n * n * blocks;
+    transform->y = malloc(3 * pixels * sizeof(float) + 1);
+    assert(transform->y != NULL);
+    transform->pb = transform->y + pixels;
+    transform->pr = transform->pb + pixels;
+
+    size_t pairs = (size_t)n * blocks / 2;
+    transform->pair_pb = malloc(2 * pairs * sizeof(float) + 1);
+    assert(transform->pair_pb != NULL);
+    transform->pair_pr = transform->pair_pb + pairs;
+    transform->pair_index = malloc(2 * pairs * sizeof(unsigned) + 1);
+    assert(transform->pair_index != NULL);
+    transform->pairs = pairs;
+
+    return transform;
+}
+
+/*
+ * Function: Transform40_free
+ * Purpose: Frees a Transform40_T and sets the pointer to NULL
+ * Parameters: A pointer to the Transform40_T
+ * Returns: Nothing
+ * Expectations: The pointer and what it points to are not NULL
+ */
+void Transform40_free(T *transform)
+{
+    assert(transform != NULL && *transform != NULL);
+    free((*transform)->y);
+    free((*transform)->pair_pb);
+    free((*transform)->pair_index);
+    free(*transform);
+    *transform = NULL;
+}
+
+/* forward_block
+ * Input: A Transform40_T with a block row of component video in its
+ *        planes, the block to compress and where its codewords go
+ * Does:  Transforms the block's luma, quantizes the coefficients and
+ *        the mean Pb and Pr, and packs them into the codewords
+ * Returns: Nothing
+ */
+static void forward_block(T transform, unsigned block, uint32_t *words)
+{
+    unsigned n = transform->n;
+    size_t width = (size_t)n * transform->blocks;
+
+    int32_t x[MAX_COEFS];
+    float pb = 0, pr = 0;
+    for (unsigned i = 0; i < n; i++) {
+        size_t at = i * width + (size_t)block * n;
+        for (unsigned j = 0; j < n; j++) {
+            float y = transform->y[at + j];
+            y = y < 0 ? 0 : (y > 1 ? 1 : y);
+            x[i * n + j] = (int32_t)(y * 1023 + 0.5f);
+            pb += transform->pb[at + j];
+            pr += transform->pr[at + j];
+        }
+    }
+
+    /* Rows, then columns; z[k * n + l] has vertical frequency k */
+    int32_t t[MAX_COEFS], z[MAX_COEFS];
+    if (n == 4) {
+        forward4(x, t);
+        forward4(t, z);
+    } else {
+        forward8(x, t);
+        forward8(t, z);
+    }
+
+    Bit_writer w = { 0, 0, words };
+    long dc = lround(z[0] * transform->scale[0]);
+    put_bits(&w, dc > DC_MAX ? DC_MAX : (uint32_t)dc, DC_BITS);
+    put_bits(&w, Chroma40_index(pb / (n * n)), CHROMA_BITS);
+    put_bits(&w, Chroma40_index(pr / (n * n)), CHROMA_BITS);
+    for (unsigned k = 1; k < transform->ncoefs; k++) {
+        long level = lround(z[transform->index[k]] * transform->scale[k]);
+        long most = (1L << (transform->bits[k] - 1)) - 1;
+        level = level > most ? most : (level < -most ? -most : level);
+        put_bits(&w, (uint32_t)level, transform->bits[k]);
+    }
+}
+
+/*
+ * Function: Transform40_forward
+ * Purpose: Compresses one block row
+ * Parameters: The Transform40_T, the first of n source rows, the pixels
+ *             from one row to the next, the blocks in the row, the
+ *             source denominator and room for the codewords
+ * Returns: Nothing
+ * Expectations: Every source row has at least blocks * n pixels, and
+ *               blocks is at most what the Transform40_T was made for
+ */
+void Transform40_forward(T transform, const struct Pnm_rgb *rgb,
+                         size_t stride, unsigned blocks, float denom,
+                         uint32_t *words)
+{
+    assert(transform != NULL && blocks <= transform->blocks);
+    assert(blocks == 0 || (rgb != NULL && words != NULL));
+
+    unsigned n = transform->n;
+    size_t width = (size_t)n * transform->blocks;
+    for (unsigned i = 0; i < n; i++) {
+        Dct40_cv_planes cv = {
+            transform->y + i * width, transform->pb + i * width,
+            transform->pr + i * width
+        };
+        Dct40_pixels_to_planes(rgb + i * stride, n * blocks, denom, cv);
+    }
+
+    unsigned nwords = Transform40_words(n);
+    for (unsigned b = 0; b < blocks; b++) {
+        forward_block(transform, b, words + (size_t)b * nwords);
+    }
+}
+
+/* inverse_block
+ * Input: A Transform40_T, the codewords of one block and its number in
+ *        the block row
+ * Does:  Unpacks and dequantizes the block and puts its luma in the Y
+ *        plane, and puts its Pb and Pr indices under each of its pixel
+ *        pairs for Transform40_inverse to dequantize with the rest of
+ *        the row
+ * Returns: Nothing
+ */
+static void inverse_block(T transform, const uint32_t *words,
+                          unsigned block)
+{
+    unsigned n = transform->n;
+    size_t width = (size_t)n * transform->blocks;
+
+    Bit_reader r = { 0, 0, words };
+    int32_t g[MAX_COEFS] = { 0 };
+    g[0] = (int32_t)get_bits(&r, DC_BITS) * transform->mult[0];
+    unsigned pb = get_bits(&r, CHROMA_BITS);
+    unsigned pr = get_bits(&r, CHROMA_BITS);
+    for (unsigned k = 1; k < transform->ncoefs; k++) {
+        g[transform->index[k]] = get_signed(&r, transform->bits[k]) *
+                                 transform->mult[k];
+    }
+
+    /* Rows, then columns, of C^T G C */
+    int32_t t[MAX_COEFS], x[MAX_COEFS];
+    if (n == 4) {
+        inverse4(g, t, 9);
+        inverse4(t, x, transform->shift);
+    } else {
+        inverse8(g, t, 9);
+        inverse8(t, x, transform->shift);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        float *y = transform->y + i * width + (size_t)block * n;
+        for (unsigned j = 0; j < n; j++) {
+            int32_t v = x[i * n + j];
+            v = v < 0 ? 0 : (v > 1023 ? 1023 : v);
+            y[j] = v / 1023.0f;
+        }
+    }
+
+    unsigned *index = transform->pair_index + (size_t)block * n / 2;
+    for (unsigned p = 0; p < n / 2; p++) {
+        index[p] = pb;
+        index[transform->pairs + p] = pr;
+    }
+}
+
+/*
+ * Function: Transform40_inverse
+ * Purpose: Decompresses one block row into n rows of pixels
+ * Parameters: The Transform40_T, the codewords of the block row, the
+ *             blocks in it, the output denominator, the first of n output
+ *             rows and the pixels from one row to the next
+ * Returns: Nothing
+ * Expectations: Every output row has room for blocks * n pixels, and
+ *               blocks is at most what the Transform40_T was made for
+ */
+void Transform40_inverse(T transform, const uint32_t *words,
+                         unsigned blocks, unsigned maxval,
+                         struct Pnm_rgb *rgb, size_t stride)
+{
+    assert(transform != NULL && blocks <= transform->blocks);
+    assert(blocks == 0 || (rgb != NULL && words != NULL));
+
+    unsigned n = transform->n;
+    size_t width = (size_t)n * transform->blocks;
+    unsigned nwords = Transform40_words(n);
+    for (unsigned b = 0; b < blocks; b++) {
+        inverse_block(transform, words + (size_t)b * nwords, b);
+    }
+    unsigned pairs = n * blocks / 2;
+    Chroma40_value_batch(transform->pair_index, transform->pair_pb, pairs);
+    Chroma40_value_batch(transform->pair_index + transform->pairs,
+                         transform->pair_pr, pairs);
+
+    /* Every row of the block row has the same chroma */
+    for (unsigned i = 0; i < n; i++) {
+        Dct40_luma_to_pixels(transform->y + i * width, transform->pair_pb,
+                             transform->pair_pr, pairs, maxval,
+                             rgb + i * stride);
+    }
+}
@@ -0,0 +1,55 @@
+/* transform40.h
+ *
+ * Interface for the 4x4 and 8x8 block transform of COMP40 compressed
+ * image format 4
+ * Authors: Aryan Pandey and Arnav Kothari
+ * COMP40: arith
+ *
+ * Format 4 trades the 2x2 blocks of format 2 for n by n blocks, n being
+ * 4 or 8, and so spends fewer bits on each pixel: a 4x4 block is 64
+ * bits, 4 per pixel, and an 8x8 block 128 bits, 2 per pixel, against 8
+ * per pixel for format 2. The luma of a block goes through an integer
+ * DCT (the core transform matrices of HEVC) and its coefficients are
+ * quantized by a table that gives each one, in zigzag order, a step and
+ * a number of bits; the highest frequencies get none. The Pb and Pr of
+ * a block are averaged and quantized to 4-bit indices as in format 2.
+ *
+ * Every block is a fixed number of 32-bit codewords, so a format 4
+ * image can be read, skipped over and decoded a block row at a time
+ * just like a format 2 one.
+ */
+
+#ifndef TRANSFORM40_INCLUDED
+#define TRANSFORM40_INCLUDED
+
+#include <stdint.h>
+#include "pnm.h"
+
+#define T Transform40_T
+typedef struct T *T;
+
+/* Whether n by n blocks are supported, which is for n of 4 and 8 */
+extern int      Transform40_supported(unsigned n);
+
+/* Codewords in each n by n block */
+extern unsigned Transform40_words(unsigned n);
+
+/* Scratch space for block rows of up to 'blocks' n by n blocks */
+extern T    Transform40_new (unsigned n, unsigned blocks);
+extern void Transform40_free(T *transform);
+
+/* Compresses one block row: 'blocks' blocks from the n rows of pixels
+ * that start at 'rgb', each 'stride' pixels after the one before, into
+ * blocks * Transform40_words(n) codewords
+ */
+extern void Transform40_forward(T transform, const struct Pnm_rgb *rgb,
+                                size_t stride, unsigned blocks,
+                                float denom, uint32_t *words);
+
+/* The inverse of Transform40_forward, with samples scaled to 'maxval' */
+extern void Transform40_inverse(T transform, const uint32_t *words,
+                                unsigned blocks, unsigned maxval,
+                                struct Pnm_rgb *rgb, size_t stride);
+
+#undef T
+#endif
@@ -6,7 +6,7 @@
  *      COMP40: locality
  */
 
-#include <uarray2b.h>
+#include "uarray2b.h"
 #include <uarray2.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -34,6 +34,33 @@ struct UArray2b_T {
         UArray2_T uarray2;
 }; 
 
+/* 
+ * Function: block_extent()
+ * Purpose:  Works out how many of the blocksize rows (or columns) of a
+ *           block starting at 'first' are inside an array 'length' long
+ * Parameters: int length, int first, int bsize
+ * Returns: The count, which is less than bsize only for the last block
+ * Expectations: first is less than length
+ */
+static inline int block_extent(int length, int first, int bsize)
+{
+        return length - first < bsize ? length - first : bsize;
+}
+
+/* 
+ * Function: block_start()
+ * Purpose:  Finds the storage of a block; each block is one row of the
+ *           UArray2 underneath, so its elements are adjacent in memory
+ * Parameters: Pointer to a struct UArray2b_T, block column and block row
+ * Returns: Pointer to the block's first element
+ * Expectations: The block indices are in bounds
+ */
+static inline char *block_start(T array2b, int b_col, int b_row)
+{
+        return UArray2_at(array2b->uarray2, 0,
+                          b_row * array2b->b_width + b_col);
+}
+
 /* 
  * Function: UArray2b_new()
  * Purpose: Allocate enough memory for a 2D Blocked Uarray with the given
@@ -225,7 +252,8 @@ void *UArray2b_at(T array2b, int column, int row)
  * Function: UArray2b_map()
  * Purpose:  Visits every index of the stored array within the passed 
  *           UArray2b and performs the passed apply function within it.
- *           If index is supposed to be empty, it is skipped.
+ *           Indices past the right or bottom edge of the array are
+ *           skipped.
  * Parameters:  Pointer to a struct UArray2b_T, 
  *              Pointer to an apply function,
  *              void pointer to closure argument
@@ -236,35 +264,55 @@ void  UArray2b_map(T array2b, void apply(int col, int row, T uarray2b,
                                          void *elem, void *cl), void *cl)
 {
         assert(array2b != NULL && apply != NULL);
-        int block_h = array2b->b_height;
-        int block_w = array2b->b_width;
         int bsize = array2b->blocksize;
+        int size = array2b->size;
 
         /* 
-         * Iterates through each block stored in the UArray2 through the
-         * first loop and through each index within the block through
-         * the second loop.
+         * Goes block by block; inside a block, walks a pointer along each
+         * row of the block so no index has to be divided back out
          */
-        for (int height = 0; height < (block_h * block_w); height++){
-                for (int width = 0; width < (bsize * bsize); width++){
-                        
-                        /* Obtain 2D block index from 1D index */
-                        int b_col = height % block_w;
-                        int b_row = height / block_w;
-                        
-                        /* Obtain 2D array index from block indices */
-                        int a_col = (b_col * bsize) + (width % bsize); 
-                        int a_row = (b_row * bsize) + (width / bsize);
-                        
-                        /* If array indices are supposed to be empty, 
-                         * do nothing
-                         */
-                        if (a_row >= array2b->row || a_col >= array2b->col) {
-                                continue;
-                        }      
-                        apply(a_col, a_row, array2b, 
-                              UArray2_at(array2b->uarray2,  width , height),
-                                         cl);
+        for (int b_row = 0; b_row < array2b->b_height; b_row++) {
+                int top = b_row * bsize;
+                int rows = block_extent(array2b->row, top, bsize);
+                for (int b_col = 0; b_col < array2b->b_width; b_col++) {
+                        int left = b_col * bsize;
+                        int cols = block_extent(array2b->col, left, bsize);
+                        char *block = block_start(array2b, b_col, b_row);
+                        for (int r = 0; r < rows; r++) {
+                                char *elem = block + (size_t)r * bsize * size;
+                                for (int c = 0; c < cols; c++, elem += size) {
+                                        apply(left + c, top + r, array2b,
+                                              elem, cl);
+                                }
+                        }
+                }
+        }
+}
+
+/* 
+ * Function: UArray2b_map_blocks()
+ * Purpose:  Calls the passed apply function once for each block, in the
+ *           same order as UArray2b_map, with the address of the block's
+ *           storage and how much of the block lies inside the array
+ * Parameters:  Pointer to a struct UArray2b_T, 
+ *              Pointer to an apply function,
+ *              void pointer to closure argument
+ * Returns: Nothing
+ * Expectations: Pointers not being NULL (closure can be NULL)
+ */
+void UArray2b_map_blocks(T array2b, UArray2b_blockfun apply, void *cl)
+{
+        assert(array2b != NULL && apply != NULL);
+        int bsize = array2b->blocksize;
+
+        for (int b_row = 0; b_row < array2b->b_height; b_row++) {
+                int top = b_row * bsize;
+                int rows = block_extent(array2b->row, top, bsize);
+                for (int b_col = 0; b_col < array2b->b_width; b_col++) {
+                        int left = b_col * bsize;
+                        int cols = block_extent(array2b->col, left, bsize);
+                        apply(left, top, cols, rows, array2b,
+                              block_start(array2b, b_col, b_row), cl);
                 }
         }
-}
\ No newline at end of file
+}
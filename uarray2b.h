@@ -0,0 +1,60 @@
+/*      uarray2b.h
+ *
+ *      Interface for Blocked UArray2: the COMP40 interface, plus
+ *      UArray2b_map_blocks, which hands the client one whole block at a
+ *      time instead of one element at a time
+ *      Authors: Aryan Pandey and Sam Berman
+ *      COMP40: locality
+ *
+ *      A block is blocksize * blocksize elements in one allocation, row
+ *      after row, so row r of a block starts r * blocksize elements after
+ *      its first element. It is a checked runtime error to pass a NULL T
+ *      to any function in this interface.
+ */
+
+#ifndef UARRAY2B_INCLUDED
+#define UARRAY2B_INCLUDED
+
+#define T UArray2b_T
+typedef struct T *T;
+
+/* Apply function for UArray2b_map_blocks: the block whose top left
+ * element is (col, row) has width by height elements in use, starting
+ * at 'block'; blocks at the right and bottom edges may be cut short
+ */
+typedef void UArray2b_blockfun(int col, int row, int width, int height,
+                               T array2b, void *block, void *cl);
+
+/* new blocked 2d array: blocksize = square root of # of cells in block */
+extern T     UArray2b_new          (int width, int height, int size,
+                                    int blocksize);
+
+/* new blocked 2d array: blocksize as large as possible provided
+ * block occupies at most 64KB (if possible)
+ */
+extern T     UArray2b_new_64K_block(int width, int height, int size);
+
+extern void  UArray2b_free     (T *array2b);
+
+extern int   UArray2b_width    (T array2b);
+extern int   UArray2b_height   (T array2b);
+extern int   UArray2b_size     (T array2b);
+extern int   UArray2b_blocksize(T array2b);
+
+/* return a pointer to the cell in the given column and row;
+ * index out of range is a checked run-time error
+ */
+extern void *UArray2b_at(T array2b, int column, int row);
+
+/* visits every cell in one block before moving to another block */
+extern void  UArray2b_map(T array2b,
+                          void apply(int col, int row, T array2b,
+                                     void *elem, void *cl),
+                          void *cl);
+
+/* calls apply once per block, in the same block order as UArray2b_map */
+extern void  UArray2b_map_blocks(T array2b, UArray2b_blockfun apply,
+                                 void *cl);
+
+#undef T
+#endif
@@ -0,0 +1,116 @@
+/*      uarray2f.c
+ *
+ *      Implementation file for the flat UArray2 in uarray2f.h
+ *      Authors: Aryan Pandey and Arnav Kothari
+ *      COMP40: arith
+ */
+
+#include <stdlib.h>
+#include "assert.h"
+#include "uarray2f.h"
+
+#define T UArray2f_T
+
+/*
+ * Function: UArray2f_new
+ * Purpose: Allocates a width by height array of elements of 'size' bytes
+ *          in a single block of memory
+ * Parameters: int width, int height, int size
+ * Returns: A new UArray2f_T
+ * Expectations: width and height are not negative, size is positive and
+ *               memory is allocated correctly
+ */
+T UArray2f_new(int width, int height, int size)
+{
+        assert(width >= 0 && height >= 0 && size > 0);
+
+        T array2 = malloc(sizeof(*array2));
+        assert(array2 != NULL);
+        array2->width = width;
+        array2->height = height;
+        array2->size = size;
+        array2->stride = (size_t)width * size;
+
+        size_t bytes = array2->stride * height;
+        array2->elems = malloc(bytes > 0 ? bytes : 1);
+        assert(array2->elems != NULL);
+
+        return array2;
+}
+
+/*
+ * Function: UArray2f_free
+ * Purpose: Frees an array and its storage
+ * Parameters: Pointer to the UArray2f_T to free
+ * Returns: Nothing
+ * Expectations: array2 and *array2 are not NULL
+ */
+void UArray2f_free(T *array2)
+{
+        assert(array2 != NULL && *array2 != NULL);
+        free((*array2)->elems);
+        free(*array2);
+        *array2 = NULL;
+}
+
+int UArray2f_width(T array2)
+{
+        assert(array2 != NULL);
+        return array2->width;
+}
+
+int UArray2f_height(T array2)
+{
+        assert(array2 != NULL);
+        return array2->height;
+}
+
+int UArray2f_size(T array2)
+{
+        assert(array2 != NULL);
+        return array2->size;
+}
+
+/*
+ * Function: UArray2f_map_row_major
+ * Purpose: Calls apply on every element, row by row, walking a pointer
+ *          through the storage instead of computing each address
+ * Parameters: The array, the apply function and its closure
+ * Returns: Nothing
+ * Expectations: array2 is not NULL
+ */
+void UArray2f_map_row_major(T array2, UArray2f_applyfun apply, void *cl)
+{
+        assert(array2 != NULL);
+        int h = array2->height;
+        int w = array2->width;
+        int size = array2->size;
+
+        for (int j = 0; j < h; j++) {
+                char *elem = array2->elems + (size_t)j * array2->stride;
+                for (int i = 0; i < w; i++, elem += size) {
+                        apply(i, j, array2, elem, cl);
+                }
+        }
+}
+
+/*
+ * Function: UArray2f_map_col_major
+ * Purpose: Calls apply on every element, column by column
+ * Parameters: The array, the apply function and its closure
+ * Returns: Nothing
+ * Expectations: array2 is not NULL
+ */
+void UArray2f_map_col_major(T array2, UArray2f_applyfun apply, void *cl)
+{
+        assert(array2 != NULL);
+        int h = array2->height;
+        int w = array2->width;
+
+        for (int i = 0; i < w; i++) {
+                char *elem = array2->elems + (size_t)i * array2->size;
+                for (int j = 0; j < h; j++, elem += array2->stride) {
+                        apply(i, j, array2, elem, cl);
+                }
+        }
+}
@@ -0,0 +1,73 @@
+/*      uarray2f.h
+ *
+ *      Interface for a flat UArray2: the same operations as UArray2, but
+ *      every element lives in one allocation, row after row
+ *      Authors: Aryan Pandey and Arnav Kothari
+ *      COMP40: arith
+ *
+ *      Element (i, j) is at byte (j * stride + i * size) of the storage,
+ *      so UArray2f_at is one multiply-add and is defined here so callers
+ *      can inline it. The struct is visible only for that reason; clients
+ *      should still go through the functions.
+ */
+
+#ifndef UARRAY2F_INCLUDED
+#define UARRAY2F_INCLUDED
+
+#include <stddef.h>
+#include "assert.h"
+
+#define T UArray2f_T
+typedef struct T *T;
+
+typedef void UArray2f_applyfun(int i, int j, T array2, void *elem, void *cl);
+
+/*
+ * Struct to hold a flat UArray2
+ * Contains - width and height in elements
+ *            size of one element in bytes
+ *            stride, the number of bytes from one row to the next
+ *            the storage for every element
+ */
+struct T {
+        int width, height;
+        int size;
+        size_t stride;
+        char *elems;
+};
+
+extern T    UArray2f_new          (int width, int height, int size);
+extern void UArray2f_free         (T *array2);
+
+extern int  UArray2f_width        (T array2);
+extern int  UArray2f_height       (T array2);
+extern int  UArray2f_size         (T array2);
+
+extern void UArray2f_map_row_major(T array2, UArray2f_applyfun apply,
+                                   void *cl);
+extern void UArray2f_map_col_major(T array2, UArray2f_applyfun apply,
+                                   void *cl);
+
+/* Address of element (i, j); it is a checked runtime error for (i, j)
+ * to be out of bounds
+ */
+static inline void *UArray2f_at(T array2, int i, int j)
+{
+        assert(array2 != NULL);
+        assert(i >= 0 && i < array2->width && j >= 0 && j < array2->height);
+        return array2->elems + (size_t)j * array2->stride +
+               (size_t)i * array2->size;
+}
+
+/* Address of the first element of row j; the width elements of the row
+ * follow it contiguously
+ */
+static inline void *UArray2f_row(T array2, int j)
+{
+        assert(array2 != NULL);
+        assert(j >= 0 && j < array2->height);
+        return array2->elems + (size_t)j * array2->stride;
+}
+
+#undef T
+#endif